@@ -6,18 +6,48 @@
 #include "OpenMPQuantizer.h"
 #include <vector>
 
+// Распределение строк MCU между потоками OpenMP
+struct OpenMPTileSchedule {
+    enum class Kind {
+        Static,   // непрерывные полосы строк: соседние строки изображения остаются у одного потока
+        Dynamic,  // порции по chunk строк раздаются по мере освобождения потоков
+        Guided,   // убывающие порции, не меньше chunk строк
+        TaskLoop  // taskloop с grainsize(chunk): порции - задачи, свободные потоки забирают их из очереди
+    };
+
+    // Environment - размещение задают OMP_PROC_BIND/OMP_PLACES, Close/Spread - proc_bind параллельной области
+    // (как и у переменной окружения, без OMP_PLACES действует только при включённой привязке)
+    enum class Placement {
+        Environment,
+        Close,
+        Spread
+    };
+
+    Kind kind = Kind::Dynamic;
+    int chunk = 1;  // строк MCU в порции; для Static 0 - поровну между потоками
+    Placement placement = Placement::Environment;
+};
+
+// Одна параллельная область на изображение, единица работы - строка MCU (lumaV строк блоков Y и строка
+// блоков Cb, Cr). Блоки извлекаются, проходят DCT и квантование внутри строки и пишутся сразу на своё место
+// результата, без промежуточных массивов блоков. Порядок результата как у SequentialBlockProcessor
 class OpenMPBlockProcessor : public IBlockProcessor {
 private:
-    std::unique_ptr<OpenMPDctTransform> dct;
+    std::unique_ptr<IDctTransform> dct;
     std::unique_ptr<OpenMPQuantizer> quantizer;
+    OpenMPTileSchedule schedule;
 
-    std::vector<std::vector<double>> extractBlock(const YCbCrImage& image, int x, int y, int component);
+    void extractBlock(const YCbCrImage& image, int x, int y, int component, FloatBlock& block);
 
 public:
-    OpenMPBlockProcessor(std::unique_ptr<OpenMPDctTransform> dctTransform, 
-                        std::unique_ptr<OpenMPQuantizer> quantizer);
-    
+    OpenMPBlockProcessor(std::unique_ptr<IDctTransform> dctTransform,
+                        std::unique_ptr<OpenMPQuantizer> quantizer,
+                        OpenMPTileSchedule schedule = OpenMPTileSchedule());
+
     std::vector<QuantizedBlock> processBlocks(const YCbCrImage& image) override;
+    const std::shared_ptr<const QuantTable>& getQuantTable() const override { return quantizer->getQuantTable(); }
+
+    const OpenMPTileSchedule& getSchedule() const { return schedule; }
 };
 
-#endif
\ No newline at end of file
+#endif
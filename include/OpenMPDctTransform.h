@@ -2,15 +2,12 @@
 #define OPENMP_DCT_TRANSFORM_H
 
 #include "interfaces.h"
-#include <vector>
 
+// Эталонный DCT (прямая сумма) с векторизацией внутри блока. Параллельной области на блок нет:
+// потоки распределяет OpenMPBlockProcessor по строкам MCU
 class OpenMPDctTransform : public IDctTransform {
 public:
-    std::vector<std::vector<double>> forwardDct(const std::vector<std::vector<double>>& block) override;
-    
-    // Пакетная обработка с OpenMP
-    static std::vector<std::vector<std::vector<double>>> 
-    forwardDctBatch(const std::vector<std::vector<std::vector<double>>>& blocks);
+    void forwardDct(const FloatBlock& block, FloatBlock& out) override;
 };
 
-#endif
+#endif
\ No newline at end of file
@@ -2,25 +2,19 @@
 #define OPENMP_QUANTIZER_H
 
 #include "interfaces.h"
-#include <vector>
+#include "quant_table.h"
+#include <memory>
 
 class OpenMPQuantizer : public IQuantizer {
 private:
-    std::vector<std::vector<int>> quantizationTable;
-    
-    std::vector<std::vector<int>> generateQuantizationTable(int quality);
+    std::shared_ptr<const QuantTable> quantTables;
+    QuantMath::DctScaling inputScaling = QuantMath::DctScaling::Natural;
 
 public:
     OpenMPQuantizer(int quality = 50);
-    std::vector<std::vector<int>> quantize(const std::vector<std::vector<double>>& dctBlock) override;
-    
-    // Пакетная обработка
-    static std::vector<std::vector<std::vector<int>>> 
-    quantizeBatch(const std::vector<std::vector<std::vector<double>>>& dctBlocks,
-                  const std::vector<std::vector<int>>& quantTable);
-    
-    static std::vector<std::vector<int>> defaultQuantizationTable();
-    const std::vector<std::vector<int>>& getQuantizationTable() const { return quantizationTable; }
+    int quantize(const FloatBlock& dctBlock, int component, CoeffBlock& out) override;
+    const std::shared_ptr<const QuantTable>& getQuantTable() const override { return quantTables; }
+    void setInputScaling(QuantMath::DctScaling scaling) override { inputScaling = scaling; }
 };
 
 #endif
\ No newline at end of file
@@ -2,51 +2,77 @@
 #define BIT_READER_H
 
 #include <vector>
+#include <cstdint>
+#include <cstddef>
 #include <stdexcept>
 
+// Чтение энтропийно-кодированного потока JPEG.
+// Биты подгружаются в 64-битный буфер (выровнены по старшему биту), byte stuffing снимается при подгрузке.
+// На маркере или в конце данных буфер дополняется нулями; чтение этих нулей - ошибка потока
 class BitReader {
 private:
-    const std::vector<unsigned char>& stream;
-    size_t bytePosition;
-    int bitPosition; // 0-7, позиция в текущем байте (от старшего к младшему)
+    const unsigned char* data;
+    size_t size;
+    size_t position;     // следующий байт для подгрузки
+    uint64_t buffer;
+    int bitsInBuffer;
+    int fillBits;        // сколько младших бит буфера - искусственные нули
+    
+    void refill() {
+        while (bitsInBuffer <= 56) {
+            uint64_t byte = 0;
+            if (fillBits == 0 && position < size) {
+                byte = data[position];
+                if (byte == 0xFF) {
+                    if (position + 1 < size && data[position + 1] == 0x00) {
+                        position += 2;
+                    } else {
+                        // Маркер: дальше не читаем
+                        byte = 0;
+                        fillBits += 8;
+                    }
+                } else {
+                    position++;
+                }
+            } else {
+                fillBits += 8;
+            }
+            buffer |= byte << (56 - bitsInBuffer);
+            bitsInBuffer += 8;
+        }
+    }
     
 public:
-    explicit BitReader(const std::vector<unsigned char>& data) 
-        : stream(data), bytePosition(0), bitPosition(0) {}
+    BitReader(const unsigned char* bytes, size_t length)
+        : data(bytes), size(length), position(0), buffer(0), bitsInBuffer(0), fillBits(0) {}
+    
+    explicit BitReader(const std::vector<unsigned char>& stream)
+        : BitReader(stream.data(), stream.size()) {}
+    
+    // Следующие count бит (1-32) без продвижения
+    uint32_t peekBits(int count) {
+        if (bitsInBuffer < count) {
+            refill();
+        }
+        return static_cast<uint32_t>(buffer >> (64 - count));
+    }
+    
+    void skipBits(int count) {
+        buffer <<= count;
+        bitsInBuffer -= count;
+        if (bitsInBuffer < fillBits) {
+            throw std::runtime_error("End of stream reached");
+        }
+    }
     
     // Читает указанное количество бит и возвращает значение
     int readBits(int bitCount) {
         if (bitCount <= 0 || bitCount > 32) {
             throw std::invalid_argument("Bit count must be 1-32");
         }
-        
-        int result = 0;
-        
-        for (int i = 0; i < bitCount; i++) {
-            if (bytePosition >= stream.size()) {
-                throw std::runtime_error("End of stream reached");
-            }
-            
-            // Читаем бит от старшего к младшему
-            int bit = (stream[bytePosition] >> (7 - bitPosition)) & 1;
-            result = (result << 1) | bit;
-            
-            bitPosition++;
-            if (bitPosition == 8) {
-                bitPosition = 0;
-                bytePosition++;
-                
-                // Пропускаем stuff byte (0x00 после 0xFF)
-                if (bytePosition < stream.size() && 
-                    bytePosition > 0 && 
-                    stream[bytePosition - 1] == 0xFF && 
-                    stream[bytePosition] == 0x00) {
-                    bytePosition++;
-                }
-            }
-        }
-        
-        return result;
+        uint32_t value = peekBits(bitCount);
+        skipBits(bitCount);
+        return static_cast<int>(value);
     }
     
     // Читает один бит
@@ -54,20 +80,25 @@ public:
         return readBits(1);
     }
     
-    // Проверяет, достигнут ли конец потока
-    bool isEnd() const {
-        return bytePosition >= stream.size();
+    // Отбрасывает биты до границы байта (заполнение единицами перед маркером)
+    void alignToByte() {
+        int partial = (bitsInBuffer - fillBits) % 8;
+        if (partial > 0) {
+            skipBits(partial);
+        }
     }
     
-    // Возвращает текущую позицию в битах
-    size_t getPosition() const {
-        return bytePosition * 8 + bitPosition;
+    // Проверяет, прочитаны ли все данные до маркера или конца потока
+    bool isEnd() const {
+        return bitsInBuffer == fillBits && (fillBits > 0 || position >= size);
     }
     
     // Сбрасывает позицию в начало
     void reset() {
-        bytePosition = 0;
-        bitPosition = 0;
+        position = 0;
+        buffer = 0;
+        bitsInBuffer = 0;
+        fillBits = 0;
     }
 };
 
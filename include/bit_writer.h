@@ -2,18 +2,88 @@
 #define BIT_WRITER_H
 
 #include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
 
+// Запись энтропийно-кодированного потока JPEG.
+// Биты копятся в 64-битном регистре и сбрасываются по 32 бита сразу с byte stuffing (0xFF -> 0xFF 0x00)
 class BitWriter {
 private:
     std::vector<unsigned char> stream;
-    unsigned char currentByte;
-    int bitPosition; // 0-7, позиция в текущем байте
+    size_t used;
+    uint64_t accumulator;
+    int bitCount; // число бит в accumulator, всегда < 32 между вызовами writeBits
+    
+    void ensureCapacity(size_t extra);
+    void flushWord();
+    void flushSlow(uint32_t word);
 
 public:
-    BitWriter();
+    explicit BitWriter(size_t initialCapacity = 4096);
+    
+    // Пишет поверх переданного буфера: его память переиспользуется (например, скан прошлого изображения)
+    BitWriter(std::vector<unsigned char>&& buffer, size_t initialCapacity);
+    
+    inline void writeBits(int value, int count);
+    
+    // Дополняет последний байт единицами (T.81 F.1.2.3) и сбрасывает регистр
+    void padToByte();
+    
+    // Выравнивание и маркер RSTn (index берётся по модулю 8), без byte stuffing
+    void writeRestartMarker(int index);
+    
+    // Байты, уже сброшенные из регистра (с byte stuffing)
+    const unsigned char* data() const { return stream.data(); }
+    size_t size() const { return used; }
+    
+    // Забывает записанные байты, сохраняя буфер и незаписанные биты
+    void clearFlushed() { used = 0; }
     
-    void writeBits(int value, int bitCount);
     std::vector<unsigned char> toArray();
+    
+    // Как toArray, но без копирования: буфер отдаётся вызывающему, писатель после этого не используется
+    std::vector<unsigned char> release();
 };
 
-#endif
\ No newline at end of file
+inline void BitWriter::writeBits(int value, int count) {
+    if (count <= 0 || count > 32) {
+        throw std::invalid_argument("Bit count must be 1-32");
+    }
+    
+    uint64_t mask = (uint64_t(1) << count) - 1;
+    accumulator = (accumulator << count) | (static_cast<uint64_t>(static_cast<uint32_t>(value)) & mask);
+    bitCount += count;
+    
+    if (bitCount >= 32) {
+        flushWord();
+    }
+}
+
+inline void BitWriter::flushWord() {
+    bitCount -= 32;
+    uint32_t word = static_cast<uint32_t>(accumulator >> bitCount);
+    
+    ensureCapacity(8);
+    
+    // Быстрый путь: в слове нет байта 0xFF - пишем 4 байта без проверок
+    uint32_t hasFF = (word & 0x80808080u) & ((word & 0x7F7F7F7Fu) + 0x01010101u);
+    if (hasFF == 0) {
+        unsigned char* out = stream.data() + used;
+        out[0] = static_cast<unsigned char>(word >> 24);
+        out[1] = static_cast<unsigned char>(word >> 16);
+        out[2] = static_cast<unsigned char>(word >> 8);
+        out[3] = static_cast<unsigned char>(word);
+        used += 4;
+    } else {
+        flushSlow(word);
+    }
+}
+
+inline void BitWriter::ensureCapacity(size_t extra) {
+    if (used + extra > stream.size()) {
+        stream.resize((used + extra) * 2);
+    }
+}
+
+#endif
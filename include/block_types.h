@@ -0,0 +1,29 @@
+#ifndef BLOCK_TYPES_H
+#define BLOCK_TYPES_H
+
+#include <cstdint>
+
+// Блоки 8x8 фиксированного размера, построчно (index = row * 8 + col).
+// Выровнены по строке кэша; передаются по ссылке в память, которой владеет вызывающий.
+
+// Сэмплы со сдвигом уровня (-128..127) или коэффициенты DCT
+struct alignas(64) FloatBlock {
+    float data[64];
+    
+    float& operator[](int index) { return data[index]; }
+    float operator[](int index) const { return data[index]; }
+    float& at(int row, int col) { return data[row * 8 + col]; }
+    float at(int row, int col) const { return data[row * 8 + col]; }
+};
+
+// Квантованные коэффициенты
+struct alignas(64) CoeffBlock {
+    int16_t data[64];
+    
+    int16_t& operator[](int index) { return data[index]; }
+    int16_t operator[](int index) const { return data[index]; }
+    int16_t& at(int row, int col) { return data[row * 8 + col]; }
+    int16_t at(int row, int col) const { return data[row * 8 + col]; }
+};
+
+#endif
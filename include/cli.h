@@ -0,0 +1,17 @@
+#ifndef CLI_H
+#define CLI_H
+
+// Режим командной строки jpeg_compressor:
+//   jpeg_compressor encode [параметры] <файл или каталог>...   PPM/PGM/PAM -> JPEG
+//   jpeg_compressor decode [параметры] <файл или каталог>...   JPEG -> PPM
+// Каталоги обходятся без рекурсии, файлы обрабатываются параллельно (--jobs),
+// в конце печатается время по стадиям и пропускная способность в MP/s
+namespace Cli {
+    // true, если argv[1] - команда CLI, а не параметр бенчмарка
+    bool isCommand(const char* arg);
+
+    // argv[0] - команда (encode/decode); возвращает код завершения процесса
+    int run(int argc, char* argv[]);
+}
+
+#endif // CLI_H
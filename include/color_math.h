@@ -5,6 +5,33 @@
 namespace ColorMath {
     std::tuple<unsigned char, unsigned char, unsigned char> rgbToYCbCr(
         unsigned char r, unsigned char g, unsigned char b);
+    
+    // Реализации построчной конвертации. Все ядра обязаны совпадать с Reference бит в бит.
+    enum class RowKernel {
+        Reference, // скалярная целочисленная формула (коэффициенты с 14 дробными битами)
+        Sse41,     // 16 пикселей за итерацию
+        Avx2       // 32 пикселя за итерацию
+    };
+    
+    // Лучшее ядро для текущего CPU (определяется один раз через CPUID)
+    RowKernel activeRowKernel();
+    bool isRowKernelSupported(RowKernel kernel);
+    const char* rowKernelName(RowKernel kernel);
+    
+    // Конвертирует строку чередующегося RGB (count пикселей) в три плоских строки
+    void rgbRowToYCbCr(const unsigned char* rgb, unsigned char* y, unsigned char* cb,
+                       unsigned char* cr, int count);
+    
+    // То же, но конкретным ядром (для сверки и бенчмарков); ядро должно поддерживаться CPU
+    void rgbRowToYCbCr(RowKernel kernel, const unsigned char* rgb, unsigned char* y,
+                       unsigned char* cb, unsigned char* cr, int count);
+    
+    // Прореживание цветности 2:1 по горизонтали и усреднение строк row0 и row1 (box-фильтр, центрированная
+    // выборка JFIF): out[i] - среднее четырёх сэмплов столбцов 2i и 2i + 1. Пишет (srcCount + 1) / 2 байт;
+    // для 4:2:2 передаётся одна и та же строка дважды
+    void downsampleRow(const unsigned char* row0, const unsigned char* row1, unsigned char* out, int srcCount);
+    void downsampleRow(RowKernel kernel, const unsigned char* row0, const unsigned char* row1,
+                       unsigned char* out, int srcCount);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -2,10 +2,29 @@
 #define DCT_MATH_H
 
 #include <vector>
+#include <cstdint>
 
 namespace DctMath {
     double alpha(int u);
-    double computeDctCoefficient(const std::vector<std::vector<double>>& block, int u, int v);
+    // Эталонная формула DCT (прямая сумма по 64 сэмплам), block - 64 сэмпла построчно
+    double computeDctCoefficient(const float block[64], int u, int v);
+
+    // Нормировка выхода AAN: scale[u*8+v] = 1 / (8 * s[u] * s[v]).
+    // Её умножают на вход квантования (QuantMath::DctScaling::Aan), а не отдельным проходом
+    void aanOutputScale(float scale[64]);
+
+    // Быстрый сепарабельный DCT (Arai-Agui-Nakajima): 8 строк + 8 столбцов,
+    // 5 умножений на 1D-преобразование. Вход - 64 сэмпла со сдвигом уровня,
+    // построчно; выход не нормирован: коэффициент (u, v) больше обычного в 8 * s[u] * s[v] раз.
+    void fastForwardDct(const float in[64], float out[64]);
+
+    // Множители входа обратного AAN: q[u][v] * s[u] * s[v] / 8 (без таблицы q = 1).
+    // Деквантизация и нормировка обратного преобразования - одно умножение на коэффициент.
+    void aanInverseScale(float scale[64], const std::vector<std::vector<int>>* quantTable = nullptr);
+
+    // Быстрое обратное AAN DCT: вход - квантованные коэффициенты построчно, выход - 8x8 сэмплов
+    // со сдвигом уровня +128 и насыщением в [0, 255], строки с шагом outStride.
+    void fastInverseDct(const int16_t in[64], const float inputScale[64], unsigned char* out, int outStride);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,106 @@
+#ifndef ENCODER_SESSION_H
+#define ENCODER_SESSION_H
+
+#include "image_types.h"
+#include "output_sink.h"
+#include "thread_pool.h"
+#include "fused_mcu_processor.h"
+#include "sequential_processors.h"
+#include "scratch_arena.h"
+#include "bit_writer.h"
+#include "jpeg_format.h"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct EncoderSessionOptions {
+    int quality = 75;
+    ChromaSubsampling subsampling = ChromaSubsampling::Yuv420;
+    // > 0 - маркер RSTn через каждые restartInterval MCU
+    int restartInterval = 0;
+    // Standard - таблицы Annex K: мелкие изображения кодируются за один проход прямо в sink
+    // (меньше задержка до первого байта, файл на несколько процентов больше)
+    JpegFormat::HuffmanTables huffmanTables = JpegFormat::HuffmanTables::Optimized;
+    // Наибольшее число одновременных задач (0 - число рабочих пула + 1)
+    int numThreads = 0;
+    // Изображения от этого числа пикселей кодируются по одному с параллельными строками MCU,
+    // меньшие - целиком по одному на задачу
+    size_t intraImagePixels = 512 * 512;
+};
+
+// Сессия кодирования для потока множества изображений с одинаковыми параметрами.
+// Таблица квантования, обработчики MCU, кодеры Хаффмана и буферы блоков создаются один раз
+// и переиспользуются между вызовами; на каждое изображение остаётся только сама работа.
+// Конвейер - FusedMcuProcessor на FastDctTransform и SequentialHuffmanEncoder,
+// поток байт не зависит от того, как распараллелено изображение
+class EncoderSession {
+private:
+    // Контекст одной задачи: всё, что нужно для кодирования изображения без выделений на каждый вызов.
+    // Блоки и результат переиспользуют свою память, временные данные скана живут в арене
+    // и сбрасываются перед каждым изображением
+    struct Worker {
+        ScratchArena arena;
+        std::unique_ptr<FusedMcuProcessor> processor;
+        std::unique_ptr<SequentialHuffmanEncoder> huffman;
+        std::vector<QuantizedBlock> blocks;
+        JpegFormat::SymbolHistogram histogram;
+        JpegEncodedData encoded;
+        BitWriter writer;     // скан однопроходного пути
+        bool parallelRows;    // строки MCU параллельно: скан собирается из блоков, а не пишется по ходу
+    };
+
+    EncoderSessionOptions options;
+    ThreadPool& pool;
+    int maxTasks;
+    SequentialQuantizer quantizer;
+
+    // Контекст с параллельной обработкой строк MCU для больших изображений
+    std::unique_ptr<Worker> intraWorker;
+    std::mutex intraMutex;
+    // Свободные однопоточные контексты для пакетов мелких изображений
+    std::vector<std::unique_ptr<Worker>> idleWorkers;
+    std::mutex idleMutex;
+
+    std::unique_ptr<Worker> createWorker(int numThreads) const;
+    std::unique_ptr<Worker> acquireWorker();
+    void releaseWorker(std::unique_ptr<Worker> worker);
+    void encodeWith(Worker& worker, const RgbImage& image, IOutputSink& sink);
+    void encodeStandardWith(Worker& worker, const RgbImage& image, IOutputSink& sink);
+
+public:
+    explicit EncoderSession(const EncoderSessionOptions& options = EncoderSessionOptions(),
+                            ThreadPool& pool = ThreadPool::shared());
+
+    EncoderSession(const EncoderSession&) = delete;
+    EncoderSession& operator=(const EncoderSession&) = delete;
+
+    // Одно изображение; большие кодируются с параллельными строками MCU
+    void encode(const RgbImage& image, IOutputSink& sink);
+
+    // Пакет: мелкие изображения кодируются параллельно по одному на задачу, крупные - по очереди
+    // с параллелизмом внутри изображения. sinkFor(i) вызывается из рабочих потоков, для каждого i один раз
+    void encodeBatch(const std::vector<const RgbImage*>& images,
+                     const std::function<IOutputSink&(size_t)>& sinkFor);
+
+    // Пакет в памяти: JFIF файлы в порядке изображений
+    std::vector<std::vector<unsigned char>> encodeBatch(const std::vector<const RgbImage*>& images);
+    std::vector<std::vector<unsigned char>> encodeBatch(const std::vector<RgbImage>& images);
+
+    template <typename ImageIterator>
+    std::vector<std::vector<unsigned char>> encodeBatch(ImageIterator first, ImageIterator last) {
+        std::vector<const RgbImage*> images;
+        for (; first != last; ++first) {
+            images.push_back(&*first);
+        }
+        return encodeBatch(images);
+    }
+
+    const EncoderSessionOptions& getOptions() const { return options; }
+
+    // Таблицы квантования, записываемые в DQT
+    const std::shared_ptr<const QuantTable>& getQuantTable() const { return quantizer.getQuantTable(); }
+};
+
+#endif // ENCODER_SESSION_H
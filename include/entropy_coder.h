@@ -0,0 +1,62 @@
+#ifndef ENTROPY_CODER_H
+#define ENTROPY_CODER_H
+
+#include "bit_writer.h"
+#include "huffman_math.h"
+#include "jpeg_format.h"
+#include "quantized_block.h"
+
+// Энтропийное кодирование одного блока baseline JPEG (T.81 F.1.2), общее для всех кодеров
+namespace EntropyCoder {
+
+    // Дополнительные биты значения категории category (отрицательные - в обратном коде)
+    inline int magnitudeBits(int value, int category) {
+        return value >= 0 ? value : value + (1 << category) - 1;
+    }
+
+    // DC разность с предыдущим блоком компоненты, затем AC в zigzag порядке:
+    // ZRL для серий длиннее 15 нулей, EOB после последнего ненулевого коэффициента.
+    // lastNonZero - zigzag-индекс последнего ненулевого коэффициента от квантователя
+    // (коэффициенты после него не читаются); по умолчанию блок просматривается целиком
+    inline void encodeBlock(BitWriter& writer, const CoeffBlock& coefficients, int& lastDc,
+                            const HuffmanCodeTable& dcTable, const HuffmanCodeTable& acTable,
+                            int lastNonZero = 63) {
+        int dc = coefficients[0];
+        int dcDiff = dc - lastDc;
+        lastDc = dc;
+
+        int dcCategory = JpegFormat::magnitudeCategory(dcDiff);
+        writer.writeBits(dcTable.code[dcCategory], dcTable.length[dcCategory]);
+        if (dcCategory > 0) {
+            writer.writeBits(magnitudeBits(dcDiff, dcCategory), dcCategory);
+        }
+
+        int zeroRun = 0;
+        for (int i = 1; i <= lastNonZero; i++) {
+            int ac = coefficients[JpegFormat::zigzagOrder[i]];
+
+            if (ac == 0) {
+                zeroRun++;
+                continue;
+            }
+
+            while (zeroRun > 15) {
+                writer.writeBits(acTable.code[0xF0], acTable.length[0xF0]);
+                zeroRun -= 16;
+            }
+
+            int category = JpegFormat::magnitudeCategory(ac);
+            int symbol = (zeroRun << 4) | category;
+            writer.writeBits(acTable.code[symbol], acTable.length[symbol]);
+            writer.writeBits(magnitudeBits(ac, category), category);
+
+            zeroRun = 0;
+        }
+
+        if (zeroRun > 0 || lastNonZero < 63) {
+            writer.writeBits(acTable.code[0x00], acTable.length[0x00]);
+        }
+    }
+}
+
+#endif // ENTROPY_CODER_H
@@ -0,0 +1,15 @@
+#ifndef FAST_DCT_TRANSFORM_H
+#define FAST_DCT_TRANSFORM_H
+
+#include "interfaces.h"
+
+// Быстрый DCT на основе сепарабельного AAN-алгоритма.
+// Выдаёт коэффициенты без нормировки AAN: её вместе с шагом квантования досчитывает IQuantizer
+// по таблице QuantMath::DctScaling::Aan, так что отдельного прохода масштабирования нет
+class FastDctTransform : public IDctTransform {
+public:
+    void forwardDct(const FloatBlock& block, FloatBlock& out) override;
+    QuantMath::DctScaling outputScaling() const override { return QuantMath::DctScaling::Aan; }
+};
+
+#endif
\ No newline at end of file
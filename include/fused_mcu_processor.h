@@ -0,0 +1,74 @@
+#ifndef FUSED_MCU_PROCESSOR_H
+#define FUSED_MCU_PROCESSOR_H
+
+#include "interfaces.h"
+#include "thread_pool.h"
+#include "jpeg_format.h"
+#include "bit_writer.h"
+#include "output_sink.h"
+#include <climits>
+#include <memory>
+#include <vector>
+
+// Слитый обработчик MCU: плитка RGB размером MCU (до 16x16) читается из изображения один раз,
+// конвертируется в YCbCr во временные массивы на стеке (768 байт, не покидают L1),
+// цветность прореживается тем же ядром, что и YCbCrImage::downsampleChroma,
+// и всё сразу проходит DCT и квантование - блоки Y, Cb и Cr.
+// Полное YCbCrImage не создаётся, поэтому изображение проходит через память один раз.
+// Блоки выдаются в том же порядке, что и у SequentialBlockProcessor (Y построчно, затем Cb, затем Cr)
+class FusedMcuProcessor : public IMcuProcessor {
+private:
+    std::unique_ptr<IDctTransform> dct;
+    std::unique_ptr<IQuantizer> quantizer;
+    int numThreads;
+    ThreadPool& pool;
+
+    // Наибольшее число блоков в MCU: 4 блока Y (4:2:0) + Cb + Cr
+    static constexpr int kMaxBlocksPerMcu = 6;
+
+    // Предсказание DC первого блока компоненты в строке MCU: предыдущую строку могла считать другая задача
+    static constexpr int kUnknownDc = INT_MIN;
+
+    // Квантованные блоки MCU в порядке скана: lumaH x lumaV блоков Y, затем Cb и Cr;
+    // lastNonZero - индексы последних ненулевых коэффициентов от квантователя для тех же блоков
+    void quantizeMcu(const RgbImage& image, const JpegFormat::McuLayout& layout, int mcuX, int mcuY,
+                     CoeffBlock (&blocks)[kMaxBlocksPerMcu], int (&lastNonZero)[kMaxBlocksPerMcu]) const;
+
+    // histogram != nullptr - символы блоков MCU добавляются к ней, lastDc - предсказание DC по компонентам
+    void processMcu(const RgbImage& image, const JpegFormat::McuLayout& layout, int mcuX, int mcuY,
+                    std::vector<QuantizedBlock>& result,
+                    JpegFormat::SymbolHistogram* histogram = nullptr, int* lastDc = nullptr) const;
+
+    void processRows(const RgbImage& image, const JpegFormat::McuLayout& layout, size_t firstRow, size_t lastRow,
+                     std::vector<QuantizedBlock>& result, int restartInterval,
+                     JpegFormat::SymbolHistogram* histogram) const;
+
+public:
+    // numThreads - наибольшее число одновременных задач по строкам MCU (1 - в вызывающем потоке)
+    FusedMcuProcessor(std::unique_ptr<IDctTransform> dctTransform,
+                      std::unique_ptr<IQuantizer> quantizer,
+                      int numThreads = 1,
+                      ThreadPool& pool = ThreadPool::shared());
+
+    std::vector<QuantizedBlock> processImage(const RgbImage& image, ChromaSubsampling subsampling) override;
+    const std::shared_ptr<const QuantTable>& getQuantTable() const override { return quantizer->getQuantTable(); }
+
+    // То же в переданный вектор: при повторных вызовах его память переиспользуется (EncoderSession)
+    void processImage(const RgbImage& image, ChromaSubsampling subsampling, std::vector<QuantizedBlock>& result);
+
+    // То же с гистограммами символов скана (интервал перезапуска restartInterval MCU), собранными
+    // по ходу квантования: у каждой задачи своя гистограмма, в конце они складываются.
+    // DC первых блоков строк MCU досчитывается после всех задач по готовым блокам предыдущей строки.
+    // Готовые гистограммы принимает SequentialHuffmanEncoder::encode, отдельный проход подсчёта не нужен
+    void processImage(const RgbImage& image, ChromaSubsampling subsampling, std::vector<QuantizedBlock>& result,
+                      int restartInterval, JpegFormat::SymbolHistogram& histogram);
+
+    // Однопроходный быстрый путь: каждый MCU сразу после квантования кодируется стандартными таблицами
+    // Annex K, без буфера блоков и без подсчёта символов. Скан пишется в writer (без выравнивания в конце);
+    // с sink готовые байты уходят в него после каждой строки MCU - первые байты скана появляются
+    // после первой строки. Всегда в вызывающем потоке: биты скана идут строго по порядку
+    void encodeStandard(const RgbImage& image, ChromaSubsampling subsampling, int restartInterval,
+                        BitWriter& writer, IOutputSink* sink = nullptr) const;
+};
+
+#endif // FUSED_MCU_PROCESSOR_H
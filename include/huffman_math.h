@@ -1,27 +1,38 @@
 #ifndef HUFFMAN_MATH_H
 #define HUFFMAN_MATH_H
 
-#include <unordered_map>
+#include <array>
 #include <vector>
+#include <cstdint>
 
-struct HuffmanNode {
-    int symbol;
-    int frequency;
-    HuffmanNode* left;
-    HuffmanNode* right;
-    
-    HuffmanNode();
-    HuffmanNode(int sym, int freq);
-    ~HuffmanNode();
-    
-    bool isLeaf() const { return left == nullptr && right == nullptr; }
+// Таблица Хаффмана в виде сегмента DHT (JPEG Annex C):
+// counts[i] - число кодов длины i + 1, symbols - символы по возрастанию длины кода
+struct HuffmanSpec {
+    uint8_t counts[16] = {};
+    std::vector<uint8_t> symbols;
+};
+
+// Частоты 8-битных символов JPEG (категории DC, пары run/size AC)
+using HuffmanFrequencies = std::array<uint32_t, 256>;
+
+// Плотная таблица кодов для энтропийного кодера: индекс - символ.
+// length == 0 означает, что символа нет в таблице
+struct HuffmanCodeTable {
+    uint16_t code[256] = {};
+    uint8_t length[256] = {};
 };
 
 namespace HuffmanMath {
-    HuffmanNode* buildTree(const std::unordered_map<int, int>& frequencies);
-    std::unordered_map<int, std::pair<int, int>> buildCodeTable(HuffmanNode* root);
-    void buildCodeTableRecursive(HuffmanNode* node, int code, int depth, 
-                                std::unordered_map<int, std::pair<int, int>>& table);
+    constexpr int kMaxCodeLength = 16;
+    
+    // Оптимальная таблица по частотам (Annex K.2) с ограничением длины кода 16 бит (K.3).
+    // Коды из одних единиц не выдаются; символы с нулевой частотой в таблицу не попадают
+    HuffmanSpec buildSpec(const HuffmanFrequencies& frequencies);
+    // То же в существующую спецификацию: память под символы переиспользуется
+    void buildSpec(const HuffmanFrequencies& frequencies, HuffmanSpec& spec);
+    
+    // Канонические коды из спецификации DHT (Annex C.2)
+    HuffmanCodeTable buildCodeTable(const HuffmanSpec& spec);
 }
 
-#endif
\ No newline at end of file
+#endif
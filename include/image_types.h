@@ -1,84 +1,172 @@
 #ifndef IMAGE_TYPES_H
 #define IMAGE_TYPES_H
 
+#include "aligned_allocator.h"
+#include "huffman_math.h"
 #include <vector>
 #include <memory>
+#include <tuple>
+#include <cstddef>
+#include <string>
 #include <unordered_map>
 
+// Шаг строки выравнивается до строки кэша, чтобы каждая строка начиналась с выровненного адреса
+constexpr int kRowAlignment = 64;
+
+inline int alignedStride(int bytesPerRow) {
+    return (bytesPerRow + kRowAlignment - 1) / kRowAlignment * kRowAlignment;
+}
+
+// Прореживание цветности (Cb, Cr) относительно яркости
+enum class ChromaSubsampling {
+    Yuv444,  // без прореживания, MCU 8x8
+    Yuv422,  // 2:1 по горизонтали, MCU 16x8
+    Yuv420   // 2:1 по обеим осям, MCU 16x16
+};
+
+// Во сколько раз цветность прорежена по осям; это же факторы выборки Y в SOF0 (у Cb/Cr всегда 1x1)
+inline int subsamplingFactorX(ChromaSubsampling subsampling) {
+    return subsampling == ChromaSubsampling::Yuv444 ? 1 : 2;
+}
+inline int subsamplingFactorY(ChromaSubsampling subsampling) {
+    return subsampling == ChromaSubsampling::Yuv420 ? 2 : 1;
+}
+
+// Одна плоскость 8-битных сэмплов: один выровненный буфер и явный шаг строки
+class ImagePlane {
+private:
+    AlignedVector<unsigned char> data;
+    int width;
+    int height;
+    int stride;
+
+public:
+    ImagePlane(int width, int height, unsigned char fill = 0);
+    
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getStride() const { return stride; }
+    
+    unsigned char* row(int y) { return data.data() + static_cast<size_t>(y) * stride; }
+    const unsigned char* row(int y) const { return data.data() + static_cast<size_t>(y) * stride; }
+    
+    unsigned char at(int x, int y) const { return row(y)[x]; }
+    unsigned char& at(int x, int y) { return row(y)[x]; }
+    
+    void fill(unsigned char value);
+};
+
+// Чередующийся RGB (R, G, B подряд), строки с шагом getStride().
+// Либо владеет выровненным буфером, либо является представлением чужой памяти (view(): например,
+// отображённого в память файла PNM) - тогда строки не выровнены, а шаг равен шагу источника
 class RgbImage {
 private:
-    std::vector<unsigned char> data;
+    AlignedVector<unsigned char> data;
+    unsigned char* pixels;
+    // Держит источник представления живым (для своего буфера пусто)
+    std::shared_ptr<void> storage;
     int width;
     int height;
+    int stride;
+
+    RgbImage(unsigned char* pixels, int width, int height, int stride, std::shared_ptr<void> storage);
 
 public:
     RgbImage(int width, int height);
     RgbImage(int width, int height, const std::vector<unsigned char>& rgbData);
     
+    // Копия своего буфера - новый буфер, копия представления ссылается на те же байты
+    RgbImage(const RgbImage& other);
+    RgbImage& operator=(const RgbImage& other);
+    RgbImage(RgbImage&& other) noexcept = default;
+    RgbImage& operator=(RgbImage&& other) noexcept = default;
+    
+    // Представление без копирования: stride >= width * 3, storage продлевает жизнь памяти pixels
+    static RgbImage view(unsigned char* pixels, int width, int height, int stride,
+                         std::shared_ptr<void> storage = nullptr);
+    bool isView() const { return pixels != data.data(); }
+    
     int getWidth() const { return width; }
     int getHeight() const { return height; }
+    int getStride() const { return stride; }
     int getPixelCount() const { return width * height; }
     
+    unsigned char* row(int y) { return pixels + static_cast<size_t>(y) * stride; }
+    const unsigned char* row(int y) const { return pixels + static_cast<size_t>(y) * stride; }
+    
     std::tuple<unsigned char, unsigned char, unsigned char> getPixel(int x, int y) const;
     void setPixel(int x, int y, unsigned char r, unsigned char g, unsigned char b);
     
-    const std::vector<unsigned char>& getRawData() const { return data; }
     
     static RgbImage createTestImage(int width, int height);
-    // static RgbImage loadFromFile(const std::string& path); // Пока без реализации файлового ввода
+    // Бинарные PPM/PGM/PAM (PnmIo::load): 8-битный RGB отображается в память без копирования
+    static RgbImage loadFromFile(const std::string& path);
 };
 
+// Планарное YCbCr: по одной плоскости на компоненту.
+// Плоскости цветности после downsampleChroma меньше яркости: ceil(width / fx) x ceil(height / fy)
 class YCbCrImage {
 private:
-    std::vector<std::vector<unsigned char>> Y;
-    std::vector<std::vector<unsigned char>> Cb;
-    std::vector<std::vector<unsigned char>> Cr;
+    ImagePlane Y;
+    ImagePlane Cb;
+    ImagePlane Cr;
     int width;
     int height;
+    ChromaSubsampling subsampling = ChromaSubsampling::Yuv444;
 
 public:
     YCbCrImage(int width, int height);
     
     int getWidth() const { return width; }
     int getHeight() const { return height; }
+    ChromaSubsampling getSubsampling() const { return subsampling; }
+    
+    // Стадия прореживания: заменяет полноразмерные Cb/Cr усреднёнными (ColorMath::downsampleRow).
+    // Только из 4:4:4; Yuv444 ничего не делает
+    void downsampleChroma(ChromaSubsampling target);
     
+    // getPixel/setPixel трогают все три плоскости и требуют 4:4:4 - для горячих циклов используйте plane()/row()
     std::tuple<unsigned char, unsigned char, unsigned char> getPixel(int x, int y) const;
     void setPixel(int x, int y, unsigned char yVal, unsigned char cbVal, unsigned char crVal);
     
-    const std::vector<std::vector<unsigned char>>& getY() const { return Y; }
-    const std::vector<std::vector<unsigned char>>& getCb() const { return Cb; }
-    const std::vector<std::vector<unsigned char>>& getCr() const { return Cr; }
+    const ImagePlane& getY() const { return Y; }
+    const ImagePlane& getCb() const { return Cb; }
+    const ImagePlane& getCr() const { return Cr; }
+    
+    // component: 0 = Y, 1 = Cb, 2 = Cr
+    const ImagePlane& plane(int component) const;
+    ImagePlane& plane(int component);
 };
 
 // Forward declaration
 class QuantizedBlock;
+class QuantTable;
 
 struct JpegEncodedData {
+    // Энтропийно-кодированный скан (с byte stuffing), без маркеров
     std::vector<unsigned char> compressedData;
     
-    // Huffman таблицы для каждого компонента (symbol -> (code, length))
-    std::unordered_map<int, std::pair<int, int>> yHuffmanTable;
-    std::unordered_map<int, std::pair<int, int>> cbHuffmanTable;
-    std::unordered_map<int, std::pair<int, int>> crHuffmanTable;
-    
-    // Legacy поля для совместимости
-    std::unordered_map<int, std::pair<int, int>> dcLuminanceTable;
-    std::unordered_map<int, std::pair<int, int>> acLuminanceTable;
+    // Таблицы Хаффмана скана в виде сегментов DHT
+    HuffmanSpec dcLuminanceTable;
+    HuffmanSpec acLuminanceTable;
+    HuffmanSpec dcChrominanceTable;
+    HuffmanSpec acChrominanceTable;
     
-    std::vector<std::vector<int>> quantizationTable;
+    // Таблицы квантования яркости и цветности (сегмент DQT), общие с квантователем
+    std::shared_ptr<const QuantTable> quantTables;
     int width;
     int height;
     
+    // Интервал перезапуска в MCU (сегмент DRI), 0 - без маркеров RSTn
+    int restartInterval = 0;
+    
+    // Факторы выборки в SOF0 и раскладка MCU скана
+    ChromaSubsampling subsampling = ChromaSubsampling::Yuv420;
+    
     // Количество блоков каждого компонента (для декодирования)
     int yBlockCount = 0;
     int cbBlockCount = 0;
     int crBlockCount = 0;
-    
-    // Квантованные блоки для прямого декодирования (bypass Huffman)
-    // Используется для верификации качества
-    std::vector<std::vector<std::vector<int>>> yBlocks;   // [blockIdx][8][8]
-    std::vector<std::vector<std::vector<int>>> cbBlocks;
-    std::vector<std::vector<std::vector<int>>> crBlocks;
 };
 
 #endif
\ No newline at end of file
@@ -2,7 +2,10 @@
 #define INTERFACES_H
 
 #include "image_types.h"
+#include "block_types.h"
 #include "quantized_block.h"
+#include "quant_table.h"
+#include <memory>
 #include <vector>
 #include <unordered_map>
 
@@ -10,6 +13,8 @@ class IBlockProcessor {
 public:
     virtual ~IBlockProcessor() = default;
     virtual std::vector<QuantizedBlock> processBlocks(const YCbCrImage& image) = 0;
+    // Таблицы, которыми квантуются блоки; их же кодер пишет в DQT
+    virtual const std::shared_ptr<const QuantTable>& getQuantTable() const = 0;
 };
 
 class IColorConverter {
@@ -18,16 +23,33 @@ public:
     virtual YCbCrImage convert(const RgbImage& image) = 0;
 };
 
+// Слитый путь: RGB сразу в квантованные блоки (с прореживанием цветности), без промежуточного YCbCrImage
+class IMcuProcessor {
+public:
+    virtual ~IMcuProcessor() = default;
+    virtual std::vector<QuantizedBlock> processImage(const RgbImage& image, ChromaSubsampling subsampling) = 0;
+    virtual const std::shared_ptr<const QuantTable>& getQuantTable() const = 0;
+};
+
 class IDctTransform {
 public:
     virtual ~IDctTransform() = default;
-    virtual std::vector<std::vector<double>> forwardDct(const std::vector<std::vector<double>>& block) = 0;
+    // Реализации не должны хранить состояние между вызовами: бэкенды вызывают их из нескольких потоков
+    virtual void forwardDct(const FloatBlock& block, FloatBlock& out) = 0;
+    // Масштаб коэффициентов на выходе; процессоры передают его своему IQuantizer
+    virtual QuantMath::DctScaling outputScaling() const { return QuantMath::DctScaling::Natural; }
 };
 
 class IQuantizer {
 public:
     virtual ~IQuantizer() = default;
-    virtual std::vector<std::vector<int>> quantize(const std::vector<std::vector<double>>& dctBlock) = 0;
+    // component (0 = Y, 1 = Cb, 2 = Cr) выбирает таблицу яркости или цветности.
+    // Возвращает zigzag-индекс последнего ненулевого коэффициента (0 - все AC нулевые),
+    // энтропийный кодер по нему пропускает хвост нулей
+    virtual int quantize(const FloatBlock& dctBlock, int component, CoeffBlock& out) = 0;
+    virtual const std::shared_ptr<const QuantTable>& getQuantTable() const = 0;
+    // Масштаб коэффициентов, которые приходят в quantize (по умолчанию обычные коэффициенты DCT)
+    virtual void setInputScaling(QuantMath::DctScaling scaling) = 0;
 };
 
 struct HuffmanTable {
@@ -38,9 +60,12 @@ struct HuffmanTable {
 class IHuffmanEncoder {
 public:
     virtual ~IHuffmanEncoder() = default;
+    // subsampling задаёт раскладку MCU скана и должен совпадать с тем, как получены блоки цветности.
+    // quantTables - таблицы, которыми квантованы блоки: результат ссылается на них для DQT
     virtual JpegEncodedData encode(const std::vector<QuantizedBlock>& blocks, 
                                   int width, int height, 
-                                  const std::vector<std::vector<int>>& quantTable) = 0;
+                                  const std::shared_ptr<const QuantTable>& quantTables,
+                                  ChromaSubsampling subsampling = ChromaSubsampling::Yuv420) = 0;
 };
 
 #endif
\ No newline at end of file
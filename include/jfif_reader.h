@@ -0,0 +1,16 @@
+#ifndef JFIF_READER_H
+#define JFIF_READER_H
+
+#include "image_types.h"
+#include <vector>
+#include <cstddef>
+
+// Разбор baseline JFIF в том виде, который пишет JfifWriter: 8-битные сэмплы, 3 компонента
+// 4:4:4, 4:2:2 или 4:2:0 (цветность 1x1), один чередующийся скан, интервал перезапуска из DRI,
+// таблицы квантования по Tq компонентов (у Cb и Cr общая)
+namespace JfifReader {
+    JpegEncodedData read(const unsigned char* data, size_t size);
+    JpegEncodedData read(const std::vector<unsigned char>& data);
+}
+
+#endif
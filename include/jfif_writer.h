@@ -0,0 +1,31 @@
+#ifndef JFIF_WRITER_H
+#define JFIF_WRITER_H
+
+#include "image_types.h"
+#include "output_sink.h"
+#include <cstdint>
+#include <cstddef>
+
+// Запись baseline JFIF: SOI, APP0, DQT, SOF0, DHT, [DRI], SOS, скан, EOI.
+// Заголовки и скан пишутся раздельно, чтобы скан можно было передавать частями.
+class JfifWriter {
+private:
+    IOutputSink& sink;
+    
+    void writeMarker(uint8_t marker);
+    void writeWord(int value);
+    void writeHuffmanTable(int tableClass, int tableId, const HuffmanSpec& spec);
+
+public:
+    explicit JfifWriter(IOutputSink& output);
+    
+    // Всё до начала энтропийно-кодированных данных (включая SOS)
+    void writeHeaders(const JpegEncodedData& data);
+    void writeScanData(const unsigned char* data, size_t size);
+    void writeEnd();
+    
+    // Полный файл из готовых данных кодера
+    static void write(const JpegEncodedData& data, IOutputSink& output);
+};
+
+#endif
@@ -5,51 +5,108 @@
 #include "interfaces.h"
 #include "quantized_block.h"
 #include "sequential_processors.h"
+#include "huffman_math.h"
+#include "bit_reader.h"
+#include "jpeg_format.h"
+#include "thread_pool.h"
 #include <vector>
 #include <memory>
-#include <unordered_map>
+#include <cstdint>
 
-// Интерфейс обратного DCT
+// Интерфейс обратного DCT: деквантизация, обратное преобразование, сдвиг уровня +128 и насыщение за один шаг
 class IDctInverseTransform {
 public:
     virtual ~IDctInverseTransform() = default;
-    virtual std::vector<std::vector<double>> inverseDct(const std::vector<std::vector<int>>& quantizedBlock) = 0;
+    // Таблицы квантования, на которые умножаются коэффициенты; задаются до inverseDct
+    virtual void setQuantTable(const QuantTable& tables) = 0;
+    // Пишет 8x8 сэмплов в out со строками через stride; channel - QuantTable::Luma или Chroma.
+    // Не меняет состояние: можно вызывать из нескольких потоков
+    virtual void inverseDct(const CoeffBlock& coefficients, int channel, unsigned char* out, int stride) const = 0;
 };
 
-// Последовательная реализация обратного DCT
+// Эталонное обратное DCT прямой суммой (double)
 class SequentialDctInverseTransform : public IDctInverseTransform {
+private:
+    double multipliers[2][64];
+
+public:
+    SequentialDctInverseTransform();
+    void setQuantTable(const QuantTable& tables) override;
+    void inverseDct(const CoeffBlock& coefficients, int channel, unsigned char* out, int stride) const override;
+};
+
+// Быстрое обратное DCT (AAN, float) с деквантизацией, сложенной во входные множители
+class FastDctInverseTransform : public IDctInverseTransform {
+private:
+    float inputScale[2][64];
+
 public:
-    std::vector<std::vector<double>> inverseDct(const std::vector<std::vector<int>>& quantizedBlock) override;
+    FastDctInverseTransform();
+    void setQuantTable(const QuantTable& tables) override;
+    void inverseDct(const CoeffBlock& coefficients, int channel, unsigned char* out, int stride) const override;
 };
 
-// Huffman декодер
+// Табличный Huffman декодер одной таблицы DHT.
+// Коды до kLookupBits бит декодируются одним обращением к таблице, длинные - по maxCode (Annex F.2.2.3)
 class HuffmanDecoder {
+public:
+    static constexpr int kLookupBits = 9;
+
 private:
-    // Построение обратной таблицы: (code, length) -> symbol
-    struct DecodingEntry {
-        int symbol;
-        int codeLength;
-    };
+    // (длина << 8) | символ; 0 - код длиннее kLookupBits или недопустимый префикс
+    uint16_t lookup[1 << kLookupBits];
+    int32_t maxCode[17];
+    int32_t valueOffset[17];
+    std::vector<uint8_t> symbols;
     
-    std::unordered_map<int, DecodingEntry> buildDecodingTable(
-        const std::unordered_map<int, std::pair<int, int>>& encodingTable);
+    int decodeSlow(BitReader& reader) const;
 
 public:
-    // Декодирует поток обратно в коэффициенты
-    std::vector<std::vector<std::vector<int>>> decode(
-        const std::vector<unsigned char>& compressedData,
-        const std::unordered_map<int, std::pair<int, int>>& huffmanTable,
-        int expectedBlocks);
+    explicit HuffmanDecoder(const HuffmanSpec& spec);
+    
+    int decodeSymbol(BitReader& reader) const {
+        uint16_t entry = lookup[reader.peekBits(kLookupBits)];
+        if (entry != 0) {
+            reader.skipBits(entry >> 8);
+            return entry & 0xFF;
+        }
+        return decodeSlow(reader);
+    }
 };
 
 // Основной JPEG декодер
 class JpegDecoder {
 private:
     std::unique_ptr<IDctInverseTransform> idct;
-    std::vector<std::vector<int>> quantizationTable;
+    std::shared_ptr<const QuantTable> quantTables;  // для decodeFromBlocks
+    ThreadPool& pool;
+    int threadCount;  // 0 - по размеру пула
+    
+    // Участок скана между маркерами RSTn: независимый интервал перезапуска
+    struct ScanSegment {
+        const unsigned char* data;
+        size_t size;
+        int firstMcu;
+        int mcuCount;
+    };
+    
+    // Разбиение скана по RST0..RST7 с проверкой номеров и числа интервалов
+    static std::vector<ScanSegment> splitScan(const JpegEncodedData& encodedData, int totalMcus);
+    
+    // Энтропийное декодирование MCU сегмента; sink(coefficients, blockX, blockY, component)
+    // получает каждый блок, включая блоки Y за границей изображения
+    template <typename BlockSink>
+    static void decodeSegment(const ScanSegment& segment, const HuffmanDecoder* dcDecoders,
+                              const HuffmanDecoder* acDecoders, const JpegFormat::McuLayout& layout,
+                              BlockSink&& sink);
     
-    // Деквантизация блока
-    std::vector<std::vector<int>> dequantize(const std::vector<std::vector<int>>& quantized);
+    // Декодирование одного блока: DC разность и пары run/size AC (F.2.2)
+    static void decodeBlock(BitReader& reader, const HuffmanDecoder& dcDecoder, const HuffmanDecoder& acDecoder,
+                           int& lastDc, CoeffBlock& out);
+    
+    // Деквантизация, обратное DCT и сборка изображения
+    RgbImage reconstruct(const std::vector<QuantizedBlock>& blocks, int width, int height,
+                         const QuantTable& tables, ChromaSubsampling subsampling);
     
     // Обратный zigzag scan
     static std::vector<std::vector<int>> inverseZigzag(const std::vector<int>& zigzagData);
@@ -57,18 +114,32 @@ private:
     // Конвертация YCbCr -> RGB
     RgbImage ycbcrToRgb(const YCbCrImage& ycbcr);
     
-    // Помещение блока обратно в изображение
-    void placeBlock(YCbCrImage& image, const std::vector<std::vector<double>>& block,
-                   int blockX, int blockY, int component);
+    // Конвертация прямоугольника [x0, x1) x [y0, y1) (обрезается по изображению)
+    static void ycbcrToRgb(const YCbCrImage& ycbcr, RgbImage& rgb, int x0, int y0, int x1, int y1);
+    
+    // Обратное DCT блока прямо в плоскость изображения
+    // (цветность растягивается на lumaH x lumaV пикселей повторением сэмплов)
+    void placeBlock(YCbCrImage& image, const CoeffBlock& coefficients,
+                   int blockX, int blockY, int component, const JpegFormat::McuLayout& layout) const;
 
 public:
-    explicit JpegDecoder(std::vector<std::vector<int>> quantTable);
+    explicit JpegDecoder(std::shared_ptr<const QuantTable> quantTables,
+                         std::unique_ptr<IDctInverseTransform> inverseTransform = nullptr,
+                         ThreadPool& pool = ThreadPool::shared());
     
-    // Декодирование из закодированных данных
+    // Сколько интервалов перезапуска декодируется одновременно (по умолчанию - рабочие пула + вызывающий поток)
+    void setThreadCount(int threads);
+    
+    // Декодирование из закодированных данных (таблицы квантования берутся из encodedData).
+    // При restartInterval > 0 сегменты между RSTn декодируются параллельно вместе с IDCT и конвертацией цвета
     RgbImage decode(const JpegEncodedData& encodedData);
     
+    // Энтропийное декодирование скана в квантованные блоки (блоки Y вне изображения отбрасываются)
+    std::vector<QuantizedBlock> decodeScan(const JpegEncodedData& encodedData);
+    
     // Декодирование напрямую из квантованных блоков (для тестирования)
-    RgbImage decodeFromBlocks(const std::vector<QuantizedBlock>& blocks, int width, int height);
+    RgbImage decodeFromBlocks(const std::vector<QuantizedBlock>& blocks, int width, int height,
+                              ChromaSubsampling subsampling = ChromaSubsampling::Yuv420);
 };
 
 // Расширенная структура для хранения промежуточных данных (для тестирования)
@@ -79,6 +150,6 @@ struct JpegTestData {
 
 // Фабричные функции
 std::unique_ptr<JpegEncoder> createJpegEncoder(int quality = 75);
-std::unique_ptr<JpegDecoder> createJpegDecoder(const std::vector<std::vector<int>>& quantTable);
+std::unique_ptr<JpegDecoder> createJpegDecoder(std::shared_ptr<const QuantTable> quantTables);
 
 #endif
@@ -0,0 +1,180 @@
+#ifndef JPEG_FORMAT_H
+#define JPEG_FORMAT_H
+
+#include "huffman_math.h"
+#include "quantized_block.h"
+#include "image_types.h"
+#include "scratch_arena.h"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Константы и общие правила формата baseline JPEG (ITU T.81)
+namespace JpegFormat {
+    // Маркеры
+    constexpr uint8_t SOI  = 0xD8;
+    constexpr uint8_t EOI  = 0xD9;
+    constexpr uint8_t SOF0 = 0xC0;
+    constexpr uint8_t DHT  = 0xC4;
+    constexpr uint8_t DQT  = 0xDB;
+    constexpr uint8_t SOS  = 0xDA;
+    constexpr uint8_t APP0 = 0xE0;
+    constexpr uint8_t DRI  = 0xDD;
+    constexpr uint8_t RST0 = 0xD0;  // RST0..RST7 = 0xD0..0xD7
+    
+    // zigzagOrder[k] - индекс (row * 8 + col) k-го коэффициента в порядке zigzag
+    extern const int zigzagOrder[64];
+    
+    // Категория (число значащих бит) значения коэффициента, F.1.2.1
+    inline int magnitudeCategory(int value) {
+        return value == 0 ? 0 : 32 - __builtin_clz(static_cast<unsigned>(value < 0 ? -value : value));
+    }
+    
+    // Добавляет символы блока к гистограммам DC и AC (тот же проход, что и у энтропийного кодера).
+    // lastNonZero - как в EntropyCoder::encodeBlock
+    void countBlockSymbols(const CoeffBlock& coefficients, int& lastDc,
+                           HuffmanFrequencies& dcFrequencies, HuffmanFrequencies& acFrequencies,
+                           int lastNonZero = 63);
+    
+    // Только символы run/size AC: от порядка блоков в скане они не зависят.
+    // lastNonZero - как в EntropyCoder::encodeBlock
+    void countAcSymbols(const CoeffBlock& coefficients, HuffmanFrequencies& acFrequencies, int lastNonZero = 63);
+    
+    // Гистограммы символов всего скана, индекс 0 - яркость, 1 - цветность.
+    // Собирается по частям (например, по задачам стадии блоков) и складывается через add
+    struct SymbolHistogram {
+        HuffmanFrequencies dc[2] = {};
+        HuffmanFrequencies ac[2] = {};
+        
+        void clear();
+        void add(const SymbolHistogram& other);
+    };
+    
+    // Типовые таблицы Хаффмана из Annex K.3 в виде данных сегмента DHT (counts, symbols)
+    inline constexpr uint8_t kStandardDcLuminanceCounts[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+    inline constexpr uint8_t kStandardDcLuminanceSymbols[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+    inline constexpr uint8_t kStandardDcChrominanceCounts[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+    inline constexpr uint8_t kStandardDcChrominanceSymbols[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+    inline constexpr uint8_t kStandardAcLuminanceCounts[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+    inline constexpr uint8_t kStandardAcLuminanceSymbols[162] = {
+        0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+        0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+        0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+        0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+        0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+        0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+        0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+        0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+        0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+        0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+        0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+        0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+        0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+        0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+        0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+        0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+        0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+        0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+        0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+        0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa
+    };
+    inline constexpr uint8_t kStandardAcChrominanceCounts[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+    inline constexpr uint8_t kStandardAcChrominanceSymbols[162] = {
+        0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+        0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+        0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+        0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+        0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+        0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+        0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+        0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+        0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+        0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+        0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+        0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+        0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+        0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+        0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+        0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+        0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+        0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+        0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+        0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa
+    };
+    
+    // Канонические коды по данным DHT (Annex C.2); для стандартных таблиц считаются при компиляции
+    template <size_t N>
+    constexpr HuffmanCodeTable canonicalCodeTable(const uint8_t (&counts)[16], const uint8_t (&symbols)[N]) {
+        HuffmanCodeTable table{};
+        int code = 0;
+        size_t next = 0;
+        for (int length = 1; length <= 16; length++) {
+            for (int i = 0; i < counts[length - 1] && next < N; i++, next++) {
+                table.code[symbols[next]] = static_cast<uint16_t>(code++);
+                table.length[symbols[next]] = static_cast<uint8_t>(length);
+            }
+            code <<= 1;
+        }
+        return table;
+    }
+    
+    // Готовые коды стандартных таблиц: однопроходному кодеру не нужно ни считать символы, ни строить коды
+    inline constexpr HuffmanCodeTable kStandardDcLuminanceCodes =
+        canonicalCodeTable(kStandardDcLuminanceCounts, kStandardDcLuminanceSymbols);
+    inline constexpr HuffmanCodeTable kStandardAcLuminanceCodes =
+        canonicalCodeTable(kStandardAcLuminanceCounts, kStandardAcLuminanceSymbols);
+    inline constexpr HuffmanCodeTable kStandardDcChrominanceCodes =
+        canonicalCodeTable(kStandardDcChrominanceCounts, kStandardDcChrominanceSymbols);
+    inline constexpr HuffmanCodeTable kStandardAcChrominanceCodes =
+        canonicalCodeTable(kStandardAcChrominanceCounts, kStandardAcChrominanceSymbols);
+    
+    // Те же таблицы как HuffmanSpec для заголовка
+    const HuffmanSpec& standardDcLuminance();
+    const HuffmanSpec& standardAcLuminance();
+    const HuffmanSpec& standardDcChrominance();
+    const HuffmanSpec& standardAcChrominance();
+    
+    // Выбор таблиц Хаффмана кодера:
+    // Optimized - построенные по гистограммам символов изображения (меньше байт, нужен подсчёт до записи),
+    // Standard - из Annex K (один проход, скан можно писать сразу после первого MCU)
+    enum class HuffmanTables {
+        Optimized,
+        Standard
+    };
+    
+    // Заполняет заголовочную часть результата стандартными таблицами (память спецификаций переиспользуется)
+    void setStandardTables(JpegEncodedData& result);
+    
+    // Раскладка MCU: lumaH x lumaV блоков Y + 1 Cb + 1 Cr.
+    // 4:2:0 - MCU 16x16 (4 блока Y), 4:2:2 - 16x8 (2 блока Y), 4:4:4 - 8x8 (1 блок Y)
+    struct McuLayout {
+        int mcusX;
+        int mcusY;
+        int lumaH;
+        int lumaV;
+        
+        int mcuWidth() const { return 8 * lumaH; }
+        int mcuHeight() const { return 8 * lumaV; }
+        int blocksPerMcu() const { return lumaH * lumaV + 2; }
+    };
+    McuLayout mcuLayout(int width, int height, ChromaSubsampling subsampling);
+    
+    // Перед блоком скана с этим номером стоит маркер RSTn и предсказание DC сбрасывается
+    inline bool startsRestartInterval(size_t blockIndex, int restartInterval, int blocksPerMcu) {
+        return restartInterval > 0 && blockIndex > 0 &&
+               blockIndex % (static_cast<size_t>(blocksPerMcu) * restartInterval) == 0;
+    }
+    
+    // Блоки в порядке чередующегося скана: для каждого MCU блоки Y построчно, затем Cb и Cr.
+    // Бэкенды выдают блоки Y только внутри изображения, а MCU покрывает кратное своему размеру;
+    // недостающие блоки Y на краю заменяются ближайшим существующим (декодер их обрежет).
+    // Блоков цветности по одному на MCU: сетка плоскости цветности совпадает с сеткой MCU
+    // arena != nullptr - порядок и временные сетки выделяются в арене (живут до её reset())
+    using BlockOrder = ArenaVector<const QuantizedBlock*>;
+    BlockOrder interleaveBlocks(const std::vector<QuantizedBlock>& blocks, int width, int height,
+                                ChromaSubsampling subsampling, ScratchArena* arena = nullptr);
+}
+
+#endif
@@ -4,36 +4,65 @@
 #include "interfaces.h"
 #include "dct_math.h"
 #include "color_math.h"
+#include "huffman_math.h"
+#include "bit_writer.h"
+#include "thread_pool.h"
 #include <vector>
 #include <memory>
 #include <thread>
 
-// Параллельный конвертер RGB -> YCbCr
+// Параллельный конвертер RGB -> YCbCr (полосы строк на общем пуле потоков)
 class MultiThreadColorConverter : public IColorConverter {
 private:
     int numThreads;
+    ThreadPool& pool;
 
 public:
-    explicit MultiThreadColorConverter(int numThreads = std::thread::hardware_concurrency());
+    explicit MultiThreadColorConverter(int numThreads = std::thread::hardware_concurrency(),
+                                       ThreadPool& pool = ThreadPool::shared());
     YCbCrImage convert(const RgbImage& image) override;
 };
 
-// Параллельный обработчик блоков (DCT + квантование)
+// Параллельный обработчик блоков (DCT + квантование) на общем пуле потоков.
+// numThreads - наибольшее число одновременных задач, а не число создаваемых потоков
 class MultiThreadBlockProcessor : public IBlockProcessor {
 private:
     std::unique_ptr<IDctTransform> dct;
     std::unique_ptr<IQuantizer>    quantizer;
     int numThreads;
+    ThreadPool& pool;
 
-    static std::vector<std::vector<double>> extractBlock(const YCbCrImage& image,
-                                                         int x, int y, int component);
+    static void extractBlock(const YCbCrImage& image,
+                             int x, int y, int component, FloatBlock& block);
 
 public:
     MultiThreadBlockProcessor(std::unique_ptr<IDctTransform> dctTransform,
                               std::unique_ptr<IQuantizer>    quantizer,
-                              int numThreads = std::thread::hardware_concurrency());
+                              int numThreads = std::thread::hardware_concurrency(),
+                              ThreadPool& pool = ThreadPool::shared());
 
     std::vector<QuantizedBlock> processBlocks(const YCbCrImage& image) override;
+    const std::shared_ptr<const QuantTable>& getQuantTable() const override { return quantizer->getQuantTable(); }
+};
+
+// Параллельное энтропийное кодирование: скан делится на интервалы перезапуска по mcuRowsPerInterval
+// строк MCU, каждый интервал кодируется своим потоком в отдельный буфер, буферы склеиваются через RSTn.
+// Поток байт не зависит от числа потоков
+class MultiThreadHuffmanEncoder : public IHuffmanEncoder {
+private:
+    int numThreads;
+    int mcuRowsPerInterval;
+    ThreadPool& pool;
+
+public:
+    explicit MultiThreadHuffmanEncoder(int numThreads = std::thread::hardware_concurrency(),
+                                       int mcuRowsPerInterval = 1,
+                                       ThreadPool& pool = ThreadPool::shared());
+
+    JpegEncodedData encode(const std::vector<QuantizedBlock>& blocks,
+                           int width, int height,
+                           const std::shared_ptr<const QuantTable>& quantTables,
+                           ChromaSubsampling subsampling = ChromaSubsampling::Yuv420) override;
 };
 
 #endif // MULTY_THREAD_H
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+// Приёмник выходных байтов: кодер пишет в него по мере готовности данных,
+// поэтому весь файл не обязан собираться в памяти
+class IOutputSink {
+public:
+    virtual ~IOutputSink() = default;
+    virtual void write(const unsigned char* data, size_t size) = 0;
+    virtual void flush() {}
+    
+    void writeByte(unsigned char value) { write(&value, 1); }
+};
+
+// Накопление в памяти
+class MemorySink : public IOutputSink {
+private:
+    std::vector<unsigned char> buffer;
+
+public:
+    void write(const unsigned char* data, size_t size) override;
+    
+    const std::vector<unsigned char>& getData() const { return buffer; }
+    std::vector<unsigned char> takeData();
+};
+
+// Запись в файловый дескриптор через внутренний буфер (дескриптор не закрывается)
+class FileDescriptorSink : public IOutputSink {
+private:
+    int fd;
+    std::vector<unsigned char> buffer;
+    size_t used = 0;
+    
+    void writeAll(const unsigned char* data, size_t size);
+
+public:
+    explicit FileDescriptorSink(int fd, size_t bufferSize = 64 * 1024);
+    ~FileDescriptorSink() override;
+    
+    void write(const unsigned char* data, size_t size) override;
+    void flush() override;
+};
+
+// Передача данных пользовательской функции
+class CallbackSink : public IOutputSink {
+public:
+    using Callback = std::function<void(const unsigned char* data, size_t size)>;
+
+private:
+    Callback callback;
+
+public:
+    explicit CallbackSink(Callback callback);
+    void write(const unsigned char* data, size_t size) override;
+};
+
+#endif
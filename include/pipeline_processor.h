@@ -6,6 +6,11 @@
 #include "color_math.h"
 #include "huffman_math.h"
 #include "bit_writer.h"
+#include "output_sink.h"
+#include "thread_pool.h"
+#include "ring_queue.h"
+#include "jpeg_format.h"
+#include "quant_table.h"
 #include <vector>
 #include <memory>
 #include <queue>
@@ -19,113 +24,135 @@
 using namespace std;
 
 // Структуры для передачи данных между стадиями конвейера
-struct RawBlock {
-    vector<vector<double>> data;
-    int x, y, component;
-};
-
+// Блоки хранятся по значению: перемещение по очереди не требует аллокаций
 struct DctBlock {
-    vector<vector<double>> dctCoeffs;
+    FloatBlock dctCoeffs;
     int x, y, component;
 };
 
 struct QuantizedBlockData {
-    vector<vector<int>> quantized;
+    CoeffBlock quantized;
     int x, y, component;
 };
 
 // ========== Producer-Consumer Pipeline BlockProcessor ==========
+// Извлечение блоков идёт в вызывающем потоке, DCT и квантование - задачи общего пула.
+// Между стадиями ходят номера пакетов по kBatchBlocks блоков через lock-free кольца:
+// свободные -> извлечённые -> после DCT -> снова свободные. Пакетов фиксированное число,
+// поэтому извлечение упирается в обратное давление, а не растит очередь.
+// Коэффициенты пишутся по номеру блока, так что порядок результата как у SequentialBlockProcessor
 class PipelineBlockProcessor : public IBlockProcessor {
 private:
+    static constexpr int kBatchBlocks = 32;
+    static constexpr size_t kBatchCount = 16;  // степень двойки: это и ёмкость колец
+    
+    struct BlockBatch {
+        int firstIndex;
+        int count;
+        FloatBlock blocks[kBatchBlocks];
+        int components[kBatchBlocks];  // выбирают таблицу квантования
+    };
+    
+    // Раскладка блоков: сначала все Y, затем Cb, затем Cr, внутри компоненты - построчно
+    struct BlockLayout {
+        int yBlocksX, yBlocksY;
+        int cBlocksX, cBlocksY;
+        
+        int yCount() const { return yBlocksX * yBlocksY; }
+        int cCount() const { return cBlocksX * cBlocksY; }
+        int total() const { return yCount() + 2 * cCount(); }
+        void position(int index, int& component, int& blockX, int& blockY) const;
+    };
+    
+    // Состояние одного вызова processBlocks
+    struct PipelineRun {
+        BoundedRing<int> freeBatches{kBatchCount};
+        BoundedRing<int> extractedBatches{kBatchCount};
+        BoundedRing<int> transformedBatches{kBatchCount};
+        atomic<bool> extractionDone{false};
+    };
+    
     unique_ptr<IDctTransform> dct;
     unique_ptr<IQuantizer> quantizer;
     int numThreads;
+    ThreadPool& pool;
     
-    // Очереди для конвейера
-    queue<RawBlock> extractQueue;
-    queue<DctBlock> dctQueue;
-    queue<QuantizedBlockData> quantQueue;
-    vector<QuantizedBlock> finalBlocks;
+    vector<BlockBatch> batches;
+    vector<CoeffBlock> coefficients;  // по номеру блока
+    vector<int> lastNonZero;          // результат квантователя, по номеру блока
     
-    // Синхронизация
-    mutex extractMutex, dctMutex, quantMutex, finalMutex;
-    condition_variable extractCV, dctCV, quantCV;
-    atomic<bool> extractionDone{false};
-    atomic<bool> dctDone{false};
-    atomic<bool> quantDone{false};
+    // Один шаг DCT или квантования (приоритет у стадии ближе к выходу); false - работы нет
+    bool runStageStep(PipelineRun& run);
+    void stageWorker(PipelineRun& run);
     
-    // Потоки конвейера
-    vector<thread> extractThreads;
-    vector<thread> dctThreads;
-    vector<thread> quantThreads;
-    
-    // Стадии конвейера
-    void extractionStage(const YCbCrImage& image);
-    void dctStage();
-    void quantizationStage();
-    
-    static vector<vector<double>> extractBlock(const YCbCrImage& image, int x, int y, int component);
+    static void extractBlock(const YCbCrImage& image, int x, int y, int component, FloatBlock& block);
 
 public:
     PipelineBlockProcessor(unique_ptr<IDctTransform> dctTransform, 
                           unique_ptr<IQuantizer> quantizer,
-                          int numThreads = thread::hardware_concurrency());
-    ~PipelineBlockProcessor();
+                          int numThreads = thread::hardware_concurrency(),
+                          ThreadPool& pool = ThreadPool::shared());
     
     vector<QuantizedBlock> processBlocks(const YCbCrImage& image) override;
+    const shared_ptr<const QuantTable>& getQuantTable() const override { return quantizer->getQuantTable(); }
 };
 
 // ========== Async Pipeline компоненты ==========
 
 // Конвейерный конвертер цветов
 class PipelineColorConverter : public IColorConverter {
+private:
+    ThreadPool& pool;
+
 public:
+    explicit PipelineColorConverter(ThreadPool& pool = ThreadPool::shared());
     YCbCrImage convert(const RgbImage& image) override;
 };
 
 // Конвейерный DCT
 class PipelineDctTransform : public IDctTransform {
 public:
-    vector<vector<double>> forwardDct(const vector<vector<double>>& block) override;
+    void forwardDct(const FloatBlock& block, FloatBlock& out) override;
 };
 
 // Конвейерный квантователь
 class PipelineQuantizer : public IQuantizer {
 private:
-    vector<vector<int>> quantizationTable;
-    static vector<vector<int>> generateQuantizationTable(int quality);
+    shared_ptr<const QuantTable> quantTables;
+    QuantMath::DctScaling inputScaling = QuantMath::DctScaling::Natural;
 
 public:
     PipelineQuantizer(int quality = 50);
-    vector<vector<int>> quantize(const vector<vector<double>>& dctBlock) override;
-    
-    static vector<vector<int>> defaultQuantizationTable();
-    const vector<vector<int>>& getQuantizationTable() const { return quantizationTable; }
+    int quantize(const FloatBlock& dctBlock, int component, CoeffBlock& out) override;
+    const shared_ptr<const QuantTable>& getQuantTable() const override { return quantTables; }
+    void setInputScaling(QuantMath::DctScaling scaling) override { inputScaling = scaling; }
 };
 
 // Конвейерный Huffman encoder
 class PipelineHuffmanEncoder : public IHuffmanEncoder {
 private:
-    struct ComponentData {
-        vector<QuantizedBlock> blocks;
-        unordered_map<int, pair<int, int>> huffmanTable;
+    // Таблицы DC/AC одного класса компонентов: спецификация DHT и готовые коды
+    struct TableSet {
+        HuffmanSpec dcSpec;
+        HuffmanSpec acSpec;
+        HuffmanCodeTable dcCodes;
+        HuffmanCodeTable acCodes;
     };
     
-    int lastDc = 0;
-    
-    void encodeBlock(BitWriter& writer, const vector<int>& zigzag,
-                    const unordered_map<int, pair<int, int>>& dcTable,
-                    const unordered_map<int, pair<int, int>>& acTable);
-    
-    static int getCategory(int value);
-    static int getMagnitude(int value, int category);
+    int restartInterval;
+    ThreadPool& pool;
     
-    ComponentData processComponent(const vector<QuantizedBlock>& blocks, const string& name);
+    // Гистограмма символов яркости или цветности и построенные по ней таблицы
+    TableSet prepareTables(const JpegFormat::BlockOrder& order, int blocksPerMcu, bool chroma);
 
 public:
+    // restartInterval > 0 - маркер RSTn через каждые restartInterval MCU
+    explicit PipelineHuffmanEncoder(int restartInterval = 0, ThreadPool& pool = ThreadPool::shared());
+    
     JpegEncodedData encode(const vector<QuantizedBlock>& blocks, 
                           int width, int height, 
-                          const vector<vector<int>>& quantTable) override;
+                          const shared_ptr<const QuantTable>& quantTables,
+                          ChromaSubsampling subsampling = ChromaSubsampling::Yuv420) override;
 };
 
 // Вспомогательный конвейер обработки (async-based)
@@ -161,6 +188,7 @@ public:
     ~ProcessingPipeline();
     
     vector<QuantizedBlock> processImage(const YCbCrImage& image);
+    const shared_ptr<const QuantTable>& getQuantTable() const { return quantizer->getQuantTable(); }
 };
 
 // Высокоуровневый Pipeline JPEG encoder
@@ -169,15 +197,20 @@ private:
     unique_ptr<IColorConverter> colorConverter;
     unique_ptr<ProcessingPipeline> pipeline;
     unique_ptr<IHuffmanEncoder> encoder;
+    ChromaSubsampling subsampling;
 
 public:
     PipelineJpegEncoder(unique_ptr<IColorConverter> colorConv,
                        unique_ptr<IDctTransform> dctTransform,
                        unique_ptr<IQuantizer> quantizer,
                        unique_ptr<IHuffmanEncoder> huffmanEnc,
-                       int threadCount = thread::hardware_concurrency());
+                       int threadCount = thread::hardware_concurrency(),
+                       ChromaSubsampling subsampling = ChromaSubsampling::Yuv420);
     
     JpegEncodedData encode(const RgbImage& image);
+    
+    // Кодирует изображение и пишет готовый JFIF файл в sink
+    void encode(const RgbImage& image, IOutputSink& sink);
 };
 
 #endif
@@ -0,0 +1,38 @@
+#ifndef PNM_IO_H
+#define PNM_IO_H
+
+#include "image_types.h"
+#include "output_sink.h"
+#include <cstddef>
+#include <string>
+
+// Файл, отображённый в память только для чтения (MAP_PRIVATE: запись в страницы не доходит до файла)
+class MappedFile {
+private:
+    unsigned char* address = nullptr;
+    size_t length = 0;
+
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    unsigned char* data() const { return address; }
+    size_t size() const { return length; }
+};
+
+// Бинарные Netpbm: P5 (PGM), P6 (PPM) и P7 (PAM с TUPLTYPE GRAYSCALE, RGB, RGB_ALPHA и их _ALPHA).
+// 8-битный RGB (P6 или PAM с DEPTH 3, MAXVAL 255) отдаётся как RgbImage::view поверх отображения файла -
+// пиксели не копируются, отображение живёт, пока жива любая копия изображения.
+// Остальные варианты (серый, альфа, MAXVAL != 255, 16 бит) приводятся к 8-битному RGB в свой буфер
+namespace PnmIo {
+    RgbImage load(const std::string& path);
+
+    // P6 с MAXVAL 255
+    void write(const RgbImage& image, IOutputSink& sink);
+    void save(const RgbImage& image, const std::string& path);
+}
+
+#endif // PNM_IO_H
@@ -0,0 +1,55 @@
+#ifndef QUANT_MATH_H
+#define QUANT_MATH_H
+
+#include "block_types.h"
+#include <cstdint>
+#include <vector>
+
+// Квантование без деления: шаг q заменяется 16-битной обратной величиной (схема libjpeg-turbo).
+// Коэффициент DCT переводится в целое n с kFractionBits дробными битами, после чего
+// round(|n| / 16q) = mulhi(mulhi(|n| + bias, reciprocal), scale), знак n возвращается в конце.
+// Для целых |n| <= 32768 это точное деление с округлением половины от нуля; от round(dct / q)
+// результат может отличаться на 1 только у коэффициентов в пределах 1/32 от середины между уровнями
+namespace QuantMath {
+    // |dct| <= 1024 для сэмплов -128..127, поэтому n помещается в int16
+    constexpr int kFractionBits = 4;
+
+    // Масштаб коэффициентов на входе квантования
+    enum class DctScaling {
+        Natural, // обычные коэффициенты DCT
+        Aan      // выход быстрого AAN без нормировки: коэффициент (u, v) умножен на 8 * s[u] * s[v]
+    };
+
+    // Множители по коэффициентам в построчном порядке (row * 8 + col), строятся один раз на таблицу
+    struct alignas(64) ReciprocalTable {
+        float inputScale[64];  // перевод в n: 2^kFractionBits, для DctScaling::Aan - ещё и нормировка AAN
+        uint16_t reciprocal[64];
+        uint16_t bias[64];   // половина делителя (+1, если обратная величина округлена вниз)
+        uint16_t scale[64];  // 2^(32 - shift): сдвиг на разное для коэффициентов число бит как второй mulhi
+    };
+
+    // quantTable - 8x8 шагов 1..255 (иначе std::invalid_argument). Для DctScaling::Aan нормировка
+    // выхода быстрого DCT складывается в inputScale, как делители ifast/float DCT в libjpeg-turbo:
+    // отдельного прохода масштабирования у DCT нет, а делитель остаётся целым 16q
+    void buildReciprocalTable(const std::vector<std::vector<int>>& quantTable, ReciprocalTable& table,
+                              DctScaling scaling = DctScaling::Natural);
+
+    // Реализации квантования блока. Все ядра обязаны совпадать с Reference бит в бит
+    enum class Kernel {
+        Reference, // скалярная формула с теми же 16-битными умножениями
+        Sse41,     // 8 коэффициентов за инструкцию
+        Avx2       // 16 коэффициентов за инструкцию
+    };
+
+    // Лучшее ядро для текущего CPU (определяется один раз через CPUID)
+    Kernel activeKernel();
+    bool isKernelSupported(Kernel kernel);
+    const char* kernelName(Kernel kernel);
+
+    // Квантует блок коэффициентов DCT и возвращает zigzag-индекс последнего ненулевого коэффициента
+    // для энтропийного кодера: 0 - все AC нулевые (блок - это DC и EOB), 63 - EOB не нужен
+    int quantizeBlock(const ReciprocalTable& table, const FloatBlock& dctBlock, CoeffBlock& out);
+    int quantizeBlock(Kernel kernel, const ReciprocalTable& table, const FloatBlock& dctBlock, CoeffBlock& out);
+}
+
+#endif // QUANT_MATH_H
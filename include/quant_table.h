@@ -0,0 +1,62 @@
+#ifndef QUANT_TABLE_H
+#define QUANT_TABLE_H
+
+#include "quant_math.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Таблицы квантования изображения: Tq 0 для яркости и Tq 1 для цветности (Cb и Cr делят одну таблицу).
+// Каждая хранится в трёх видах: 8x8 построчно (обратное DCT), в порядке zigzag (сегмент DQT)
+// и обратными величинами для QuantMath::quantizeBlock (для обычного и для ненормированного AAN выхода DCT).
+// Объект неизменяем, квантователи, JpegEncodedData и декодер разделяют его через shared_ptr
+class QuantTable {
+public:
+    enum Channel {
+        Luma = 0,
+        Chroma = 1
+    };
+
+    // component: 0 = Y, 1 = Cb, 2 = Cr
+    static int channelOf(int component) { return component == 0 ? Luma : Chroma; }
+
+    // Таблицы Annex K.1 и K.2, масштабированные по качеству 1..100 как в IJG (иначе std::invalid_argument)
+    explicit QuantTable(int quality);
+
+    // Таблицы из сегментов DQT в порядке zigzag, шаги 1..255 (иначе std::invalid_argument)
+    QuantTable(const uint8_t (&lumaZigzag)[64], const uint8_t (&chromaZigzag)[64]);
+
+    // Качество, по которому построены таблицы; 0 - таблицы прочитаны из файла
+    int getQuality() const { return quality; }
+
+    const std::vector<std::vector<int>>& getTable(int channel) const { return tables[channel]; }
+    const uint8_t* getZigzag(int channel) const { return zigzagTables[channel]; }
+    // scaling - масштаб выхода DCT, который квантуется (IDctTransform::outputScaling)
+    const QuantMath::ReciprocalTable& getReciprocals(int channel,
+                                                     QuantMath::DctScaling scaling = QuantMath::DctScaling::Natural) const {
+        return reciprocalTables[static_cast<int>(scaling)][channel];
+    }
+
+    // Сравниваются только шаги обоих каналов
+    bool operator==(const QuantTable& other) const;
+    bool operator!=(const QuantTable& other) const { return !(*this == other); }
+
+    // Общие таблицы качества quality: строятся при первом запросе, дальше отдаются из кэша.
+    // Можно вызывать из нескольких потоков
+    static std::shared_ptr<const QuantTable> forQuality(int quality);
+
+    // Базовые таблицы Annex K (качество 50), построчно
+    static const int annexKLuminance[64];
+    static const int annexKChrominance[64];
+
+private:
+    QuantMath::ReciprocalTable reciprocalTables[2][2];  // [DctScaling][канал]
+    std::vector<std::vector<int>> tables[2];
+    uint8_t zigzagTables[2][64];
+    int quality;
+
+    // По построчным tables заполняет zigzagTables и reciprocalTables
+    void buildForms();
+};
+
+#endif // QUANT_TABLE_H
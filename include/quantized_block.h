@@ -1,26 +1,30 @@
 #ifndef QUANTIZED_BLOCK_H
 #define QUANTIZED_BLOCK_H
 
+#include "block_types.h"
 #include <vector>
 
 class QuantizedBlock {
 private:
-    std::vector<int> coefficients; // 64 квантованных коэффициента
+    CoeffBlock coefficients; // 64 квантованных коэффициента, построчно
     int blockX;
     int blockY;
     int component; // 0 = Y, 1 = Cb, 2 = Cr
+    int lastNonZero; // zigzag-индекс последнего ненулевого коэффициента от квантователя, 63 - неизвестен
     
-    static const std::vector<int> zigzagIndices;
-    static std::vector<int> zigzagScan(const std::vector<int>& coefficients);
+    static const int zigzagIndices[64];
+    static std::vector<int> zigzagScan(const CoeffBlock& coefficients);
 
 public:
-    QuantizedBlock(const std::vector<std::vector<int>>& coefficients, 
-                  int blockX = 0, int blockY = 0, int component = 0);
+    QuantizedBlock(const CoeffBlock& coefficients, 
+                  int blockX = 0, int blockY = 0, int component = 0, int lastNonZero = 63);
     
     int getBlockX() const { return blockX; }
     int getBlockY() const { return blockY; }
     int getComponent() const { return component; }
+    int getLastNonZero() const { return lastNonZero; }
     int getCoefficient(int i, int j) const;
+    const CoeffBlock& getCoefficients() const { return coefficients; }
     
     std::vector<int> getZigzagOrder() const;
     static std::pair<int, int> zigzagToRowCol(int zigzagIndex);
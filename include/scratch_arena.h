@@ -0,0 +1,92 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Арена для временных данных одного изображения (сетки блоков, порядок скана и т.п.).
+// Выделение - сдвиг указателя, освобождения по одному нет: reset() забывает всё сразу.
+// Если изображению не хватило одного куска, при reset() куски сливаются в один общего размера,
+// поэтому после первых изображений арена работает без обращений к куче
+class ScratchArena {
+private:
+    struct Chunk {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size;
+    };
+
+    std::vector<Chunk> chunks;
+    size_t current = 0; // заполняемый кусок
+    size_t offset = 0;  // занято в текущем куске
+    size_t chunkAllocations = 0;
+
+    void* allocateSlow(size_t bytes, size_t alignment);
+    void addChunk(size_t bytes);
+
+public:
+    explicit ScratchArena(size_t initialBytes = 64 * 1024);
+
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    // alignment - степень двойки не больше 64
+    inline void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    void reset();
+
+    size_t capacity() const;
+    // Сколько раз арена обращалась к куче за всё время (для проверки установившегося режима)
+    size_t getChunkAllocations() const { return chunkAllocations; }
+};
+
+inline void* ScratchArena::allocate(size_t bytes, size_t alignment) {
+    Chunk& chunk = chunks[current];
+    uintptr_t base = reinterpret_cast<uintptr_t>(chunk.data.get());
+    size_t aligned = ((base + offset + alignment - 1) & ~(uintptr_t(alignment) - 1)) - base;
+    if (aligned + bytes <= chunk.size) {
+        offset = aligned + bytes;
+        return chunk.data.get() + aligned;
+    }
+    return allocateSlow(bytes, alignment);
+}
+
+// STL-аллокатор поверх арены: deallocate ничего не делает, память вернётся при ScratchArena::reset().
+// Без арены (nullptr) работает как обычный new/delete, поэтому одни и те же контейнеры
+// подходят и кодерам с ареной, и без неё
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    ScratchArena* arena = nullptr;
+
+    ArenaAllocator() noexcept = default;
+    explicit ArenaAllocator(ScratchArena* arena) noexcept : arena(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+
+    T* allocate(std::size_t n) {
+        if (arena) {
+            return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept {
+        if (!arena) {
+            ::operator delete(p);
+        }
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const noexcept { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const noexcept { return arena != other.arena; }
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif // SCRATCH_ARENA_H
@@ -6,6 +6,10 @@
 #include "color_math.h"
 #include "huffman_math.h"
 #include "bit_writer.h"
+#include "output_sink.h"
+#include "scratch_arena.h"
+#include "jpeg_format.h"
+#include "quant_table.h"
 #include <vector>
 #include <memory>
 #include <cmath>
@@ -18,12 +22,13 @@ private:
     unique_ptr<IDctTransform> dct;
     unique_ptr<IQuantizer> quantizer;
 
-    vector<vector<double>> extractBlock(const YCbCrImage& image, int x, int y, int component);
+    void extractBlock(const YCbCrImage& image, int x, int y, int component, FloatBlock& block);
 
 public:
     SequentialBlockProcessor(unique_ptr<IDctTransform> dctTransform, 
                            unique_ptr<IQuantizer> quantizer);
     vector<QuantizedBlock> processBlocks(const YCbCrImage& image) override;
+    const shared_ptr<const QuantTable>& getQuantTable() const override { return quantizer->getQuantTable(); }
 };
 
 class SequentialColorConverter : public IColorConverter {
@@ -33,54 +38,83 @@ public:
 
 class SequentialDctTransform : public IDctTransform {
 public:
-    vector<vector<double>> forwardDct(const vector<vector<double>>& block) override;
+    void forwardDct(const FloatBlock& block, FloatBlock& out) override;
 };
 
 class SequentialHuffmanEncoder : public IHuffmanEncoder {
 private:
-    int lastDc = 0;
-    
-    void encodeBlock(BitWriter& writer, const vector<int>& zigzag,
-                    const unordered_map<int, pair<int, int>>& dcTable,
-                    const unordered_map<int, pair<int, int>>& acTable);
-    
-    static int getCategory(int value);
-    static int getMagnitude(int value, int category);
-    
-    unordered_map<int, pair<int, int>> buildHuffmanTable(const vector<QuantizedBlock>& blocks);
+    int restartInterval;
+    ScratchArena* arena;
+    JpegFormat::HuffmanTables tables;
 
 public:
+    // restartInterval > 0 - маркер RSTn через каждые restartInterval MCU.
+    // arena - временные данные скана (порядок блоков); сбрасывает её владелец между изображениями.
+    // tables == Standard - таблицы Annex K, без прохода подсчёта символов
+    explicit SequentialHuffmanEncoder(int restartInterval = 0, ScratchArena* arena = nullptr,
+                                      JpegFormat::HuffmanTables tables = JpegFormat::HuffmanTables::Optimized);
+    
     JpegEncodedData encode(const vector<QuantizedBlock>& blocks, 
                           int width, int height, 
-                          const vector<vector<int>>& quantTable) override;
+                          const shared_ptr<const QuantTable>& quantTables,
+                          ChromaSubsampling subsampling = ChromaSubsampling::Yuv420) override;
+    
+    // То же в существующий результат: буферы скана и таблиц Хаффмана переиспользуются,
+    // и при повторных вызовах с ареной кодирование не обращается к куче
+    void encode(const vector<QuantizedBlock>& blocks, int width, int height,
+                const shared_ptr<const QuantTable>& quantTables, ChromaSubsampling subsampling,
+                JpegEncodedData& result);
+    
+    // Гистограммы символов уже собраны стадией блоков с тем же интервалом перезапуска
+    // (FusedMcuProcessor::processImage): таблицы строятся по ним, скан проходится один раз.
+    // Со стандартными таблицами гистограммы не нужны и не читаются
+    void encode(const vector<QuantizedBlock>& blocks, int width, int height,
+                const shared_ptr<const QuantTable>& quantTables, ChromaSubsampling subsampling,
+                const JpegFormat::SymbolHistogram& histogram, JpegEncodedData& result);
+
+private:
+    void encodeScan(const vector<QuantizedBlock>& blocks, int width, int height,
+                    const shared_ptr<const QuantTable>& quantTables, ChromaSubsampling subsampling,
+                    const JpegFormat::SymbolHistogram* histogram, JpegEncodedData& result);
 };
 
 class SequentialQuantizer : public IQuantizer {
 private:
-    vector<vector<int>> quantizationTable;
-
-    static vector<vector<int>> generateQuantizationTable(int quality);
+    shared_ptr<const QuantTable> quantTables;
+    QuantMath::DctScaling inputScaling = QuantMath::DctScaling::Natural;
 
 public:
+    // Таблицы берутся из общего кэша QuantTable::forQuality
     SequentialQuantizer(int quality = 50);
-    vector<vector<int>> quantize(const vector<vector<double>>& dctBlock) override;
-    
-    static vector<vector<int>> defaultQuantizationTable();
-    const vector<vector<int>>& getQuantizationTable() const { return quantizationTable; }
+    int quantize(const FloatBlock& dctBlock, int component, CoeffBlock& out) override;
+    const shared_ptr<const QuantTable>& getQuantTable() const override { return quantTables; }
+    void setInputScaling(QuantMath::DctScaling scaling) override { inputScaling = scaling; }
 };
 
 class JpegEncoder {
 private:
     unique_ptr<IColorConverter> colorConverter;
     unique_ptr<IBlockProcessor> blockProcessor;
+    unique_ptr<IMcuProcessor> mcuProcessor;
     unique_ptr<IHuffmanEncoder> encoder;
+    ChromaSubsampling subsampling;
 
 public:
+    // subsampling: после конвертации цвета плоскости Cb/Cr прореживаются (YCbCrImage::downsampleChroma)
     JpegEncoder(unique_ptr<IColorConverter> colorConv,
                 unique_ptr<IBlockProcessor> blockProc,
-                unique_ptr<IHuffmanEncoder> huffmanEnc);
+                unique_ptr<IHuffmanEncoder> huffmanEnc,
+                ChromaSubsampling subsampling = ChromaSubsampling::Yuv420);
+    
+    // Слитый путь: конвертация цвета, прореживание и обработка блоков за один проход (FusedMcuProcessor)
+    JpegEncoder(unique_ptr<IMcuProcessor> mcuProc,
+                unique_ptr<IHuffmanEncoder> huffmanEnc,
+                ChromaSubsampling subsampling = ChromaSubsampling::Yuv420);
     
     JpegEncodedData encode(const RgbImage& image);
+    
+    // Кодирует изображение и пишет готовый JFIF файл в sink
+    void encode(const RgbImage& image, IOutputSink& sink);
 };
 
 #endif
\ No newline at end of file
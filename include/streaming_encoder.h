@@ -0,0 +1,68 @@
+#ifndef STREAMING_ENCODER_H
+#define STREAMING_ENCODER_H
+
+#include "interfaces.h"
+#include "image_types.h"
+#include "huffman_math.h"
+#include "bit_writer.h"
+#include "output_sink.h"
+#include "sequential_processors.h"
+#include "jpeg_format.h"
+#include <memory>
+#include <cstddef>
+
+// Потоковый JPEG кодер с ограниченной памятью:
+//   begin(width, height, quality); writeScanlines(...) сколько угодно раз; finish().
+// В памяти только одна строка MCU (до 16 строк YCbCr) и байты скана текущей строки MCU:
+// как только строка MCU набрана, её цветность прореживается, она проходит DCT, квантование
+// и энтропийное кодирование и уходит в sink.
+// Таблицы Хаффмана стандартные (Annex K), потому что статистику всего изображения заранее не собрать
+class StreamingJpegEncoder {
+private:
+    IOutputSink& sink;
+    std::unique_ptr<IDctTransform> dct;
+    std::unique_ptr<SequentialQuantizer> quantizer;
+
+    int width = 0;
+    int height = 0;
+    int restartInterval = 0;
+    bool active = false;
+    JpegFormat::McuLayout layout{};
+
+    // Текущая строка MCU: layout.mcuHeight() строк изображения начиная с mcuRow * layout.mcuHeight()
+    std::unique_ptr<YCbCrImage> rowBuffer;
+    // Прореженные Cb и Cr текущей строки MCU (8 строк)
+    std::vector<ImagePlane> chromaRows;
+    int bufferedRows = 0;
+    int nextScanline = 0;
+    int mcuRow = 0;
+
+    BitWriter writer;
+    int lastDc[3] = {0, 0, 0};
+    int mcusEncoded = 0;
+
+    // Блок 8x8 из плоскости с повтором последнего столбца и строки (validRows строк заполнено)
+    static void extractBlock(const ImagePlane& plane, int x, int y, int validRows, FloatBlock& block);
+    void encodeMcuRow();
+
+public:
+    // dctTransform == nullptr - FastDctTransform
+    explicit StreamingJpegEncoder(IOutputSink& output, std::unique_ptr<IDctTransform> dctTransform = nullptr);
+
+    // Пишет заголовки JFIF. restartInterval > 0 - маркер RSTn через каждые restartInterval MCU
+    void begin(int imageWidth, int imageHeight, int quality = 75, int restartInterval = 0,
+               ChromaSubsampling subsampling = ChromaSubsampling::Yuv420);
+
+    // rowCount строк RGB (width * 3 байт) с шагом stride байт. Строки сверх высоты изображения - ошибка
+    void writeScanlines(const unsigned char* rgb, int rowCount, size_t stride);
+
+    // Дописывает последнюю строку MCU, выравнивание скана и EOI
+    void finish();
+
+    int getNextScanline() const { return nextScanline; }
+
+    // Таблицы квантования, записанные в DQT
+    const std::shared_ptr<const QuantTable>& getQuantTable() const;
+};
+
+#endif // STREAMING_ENCODER_H
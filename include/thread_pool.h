@@ -0,0 +1,89 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Пул потоков с перехватом работы (work stealing).
+// У каждого рабочего своя очередь: свои задачи он берёт с конца (LIFO, данные ещё в кэше),
+// чужие - с начала. Задачи извне раскладываются по очередям по кругу.
+// Поток, ожидающий TaskGroup, сам выполняет задачи из очередей, поэтому вложенный parallelFor не блокирует пул
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(int threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Общий пул процесса, создаётся при первом обращении (по числу аппаратных потоков)
+    static ThreadPool& shared();
+
+    int getThreadCount() const { return static_cast<int>(workers.size()); }
+
+    // body(begin, end) для диапазонов [first, last) длиной не больше grain.
+    // Одновременно работают не больше maxTasks задач, включая вызывающий поток
+    // (0 - число рабочих + 1). Возвращается после всех диапазонов, первое исключение пробрасывается
+    void parallelFor(size_t first, size_t last, size_t grain,
+                     const std::function<void(size_t, size_t)>& body, int maxTasks = 0);
+
+private:
+    friend class TaskGroup;
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+
+    // Сон рабочих. queuedTasks не меньше числа задач в очередях: submit увеличивает его под sleepMutex
+    // до публикации задачи (пробуждение не теряется, счётчик не уходит ниже нуля), popTask уменьшает
+    // без блокировки после извлечения - уменьшение не может сделать условие пробуждения истинным
+    std::mutex sleepMutex;
+    std::condition_variable sleepCV;
+    std::atomic<size_t> queuedTasks{0};
+    std::atomic<size_t> nextQueue{0};
+    bool stopping = false;
+
+    void submit(Task task);
+    // Берёт и выполняет одну задачу; self - индекс рабочего этого пула или -1
+    bool tryRunTask(int self);
+    bool popTask(int self, Task& task);
+    void workerLoop(int index);
+    int currentWorkerIndex() const;
+};
+
+// Группа задач пула: run() ставит задачу, wait() дожидается всех и пробрасывает первое исключение.
+// Пока группа не завершена, ожидающий поток помогает выполнять задачи пула
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool = ThreadPool::shared());
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void run(std::function<void()> task);
+    void wait();
+
+private:
+    ThreadPool& pool;
+    std::atomic<int> pending{0};
+    std::mutex groupMutex;
+    std::condition_variable doneCV;
+    std::exception_ptr error;
+};
+
+#endif // THREAD_POOL_H
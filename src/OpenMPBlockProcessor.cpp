@@ -1,80 +1,128 @@
 #include "OpenMPBlockProcessor.h"
+#include "jpeg_format.h"
+#include <algorithm>
+#include <stdexcept>
 #include <omp.h>
 
 using namespace std;
 
-OpenMPBlockProcessor::OpenMPBlockProcessor(unique_ptr<OpenMPDctTransform> dctTransform, 
-                                         unique_ptr<OpenMPQuantizer> quantizer)
-    : dct(move(dctTransform)), quantizer(move(quantizer)) {}
-
-vector<QuantizedBlock> OpenMPBlockProcessor::processBlocks(const YCbCrImage& image) {
-    vector<QuantizedBlock> blocks;
-    
-    int width = image.getWidth();
-    int height = image.getHeight();
-    
-    // Собираем все блоки для обработки
-    vector<vector<vector<double>>> allBlocks;
-    vector<tuple<int, int, int>> blockInfo; // (x, y, component)
-    
-    // Y компоненты
-    for (int by = 0; by < height; by += 8) {
-        for (int bx = 0; bx < width; bx += 8) {
-            allBlocks.push_back(extractBlock(image, bx, by, 0));
-            blockInfo.emplace_back(bx / 8, by / 8, 0);
+namespace {
+    // Тело выполняется каждым потоком команды: раздаёт номера строк 0..count - 1 по расписанию.
+    // Конструкции orphaned - привязываются к области, открытой в runTiles
+    template<typename Body>
+    void shareTiles(const OpenMPTileSchedule& schedule, int count, const Body& body) {
+        if (schedule.kind == OpenMPTileSchedule::Kind::TaskLoop) {
+            int grain = max(1, schedule.chunk);
+            #pragma omp single
+            {
+                #pragma omp taskloop grainsize(grain)
+                for (int tile = 0; tile < count; tile++) {
+                    body(tile);
+                }
+            }
+        } else {
+            #pragma omp for schedule(runtime)
+            for (int tile = 0; tile < count; tile++) {
+                body(tile);
+            }
         }
     }
-    
-    // Cb компоненты
-    for (int by = 0; by < height; by += 16) {
-        for (int bx = 0; bx < width; bx += 16) {
-            allBlocks.push_back(extractBlock(image, bx, by, 1));
-            blockInfo.emplace_back(bx / 16, by / 16, 1);
+
+    template<typename Body>
+    void runTiles(const OpenMPTileSchedule& schedule, int count, const Body& body) {
+        // schedule(runtime) читает run-sched-var вызывающего потока; восстанавливаем его после области
+        omp_sched_t previousKind;
+        int previousChunk;
+        omp_get_schedule(&previousKind, &previousChunk);
+        switch (schedule.kind) {
+            case OpenMPTileSchedule::Kind::Static: omp_set_schedule(omp_sched_static, schedule.chunk); break;
+            case OpenMPTileSchedule::Kind::Guided: omp_set_schedule(omp_sched_guided, max(1, schedule.chunk)); break;
+            default: omp_set_schedule(omp_sched_dynamic, max(1, schedule.chunk)); break;
         }
-    }
-    
-    // Cr компоненты
-    for (int by = 0; by < height; by += 16) {
-        for (int bx = 0; bx < width; bx += 16) {
-            allBlocks.push_back(extractBlock(image, bx, by, 2));
-            blockInfo.emplace_back(bx / 16, by / 16, 2);
+
+        switch (schedule.placement) {
+            case OpenMPTileSchedule::Placement::Close:
+                #pragma omp parallel proc_bind(close)
+                shareTiles(schedule, count, body);
+                break;
+            case OpenMPTileSchedule::Placement::Spread:
+                #pragma omp parallel proc_bind(spread)
+                shareTiles(schedule, count, body);
+                break;
+            default:
+                #pragma omp parallel
+                shareTiles(schedule, count, body);
+                break;
         }
+
+        omp_set_schedule(previousKind, previousChunk);
     }
-    
-    // Параллельная обработка DCT
-    auto dctResults = OpenMPDctTransform::forwardDctBatch(allBlocks);
-    
-    // Параллельное квантование
-    auto quantResults = OpenMPQuantizer::quantizeBatch(dctResults, quantizer->getQuantizationTable());
-    
-    // Собираем результаты
-    blocks.reserve(quantResults.size());
-    for (size_t i = 0; i < quantResults.size(); i++) {
-        auto [bx, by, comp] = blockInfo[i];
-        blocks.emplace_back(quantResults[i], bx, by, comp);
+}
+
+OpenMPBlockProcessor::OpenMPBlockProcessor(unique_ptr<IDctTransform> dctTransform,
+                                         unique_ptr<OpenMPQuantizer> quantizer,
+                                         OpenMPTileSchedule schedule)
+    : dct(move(dctTransform)), quantizer(move(quantizer)), schedule(schedule) {
+    if (schedule.chunk < 0) {
+        throw invalid_argument("OpenMP tile chunk must be non-negative");
     }
-    
+    this->quantizer->setInputScaling(dct->outputScaling());
+}
+
+vector<QuantizedBlock> OpenMPBlockProcessor::processBlocks(const YCbCrImage& image) {
+    int width = image.getWidth();
+    int height = image.getHeight();
+    auto layout = JpegFormat::mcuLayout(width, height, image.getSubsampling());
+
+    // Блоки по сетке своей плоскости: Y построчно, затем Cb, затем Cr
+    int yBlocksX = (width + 7) / 8;
+    int yBlocksY = (height + 7) / 8;
+    int cBlocksX = (image.plane(1).getWidth() + 7) / 8;
+    int cBlocksY = (image.plane(1).getHeight() + 7) / 8;
+    size_t yCount = static_cast<size_t>(yBlocksX) * yBlocksY;
+    size_t cCount = static_cast<size_t>(cBlocksX) * cBlocksY;
+
+    vector<QuantizedBlock> blocks(yCount + 2 * cCount, QuantizedBlock(CoeffBlock{}));
+
+    // Строка MCU: lumaV строк блоков Y и по строке блоков Cb, Cr (их столько же, сколько строк MCU)
+    runTiles(schedule, cBlocksY, [&](int tile) {
+        FloatBlock samples;
+        FloatBlock coeffs;
+        CoeffBlock quantized;
+        auto process = [&](int component, int bx, int by, size_t index) {
+            extractBlock(image, bx * 8, by * 8, component, samples);
+            dct->forwardDct(samples, coeffs);
+            int last = quantizer->quantize(coeffs, component, quantized);
+            blocks[index] = QuantizedBlock(quantized, bx, by, component, last);
+        };
+
+        int lastY = min(yBlocksY, (tile + 1) * layout.lumaV);
+        for (int by = tile * layout.lumaV; by < lastY; by++) {
+            for (int bx = 0; bx < yBlocksX; bx++) {
+                process(0, bx, by, static_cast<size_t>(by) * yBlocksX + bx);
+            }
+        }
+        for (int component = 1; component <= 2; component++) {
+            size_t base = yCount + (component - 1) * cCount;
+            for (int bx = 0; bx < cBlocksX; bx++) {
+                process(component, bx, tile, base + static_cast<size_t>(tile) * cBlocksX + bx);
+            }
+        }
+    });
+
     return blocks;
 }
 
-vector<vector<double>> OpenMPBlockProcessor::extractBlock(const YCbCrImage& image, 
-                                                         int x, int y, int component) {
-    vector<vector<double>> block(8, vector<double>(8));
-    
+void OpenMPBlockProcessor::extractBlock(const YCbCrImage& image,
+                                       int x, int y, int component, FloatBlock& block) {
+    const ImagePlane& plane = image.plane(component);
+    int maxX = plane.getWidth() - 1;
+    int maxY = plane.getHeight() - 1;
+
     for (int i = 0; i < 8; i++) {
+        const unsigned char* src = plane.row(min(y + i, maxY));
         for (int j = 0; j < 8; j++) {
-            int px = min(x + j, image.getWidth() - 1);
-            int py = min(y + i, image.getHeight() - 1);
-            auto pixel = image.getPixel(px, py);
-            
-            switch (component) {
-                case 0: block[i][j] = get<0>(pixel) - 128; break;
-                case 1: block[i][j] = get<1>(pixel) - 128; break;
-                case 2: block[i][j] = get<2>(pixel) - 128; break;
-                default: block[i][j] = 0;
-            }
+            block.at(i, j) = src[min(x + j, maxX)] - 128;
         }
     }
-    
-    return block;
-}
\ No newline at end of file
+}
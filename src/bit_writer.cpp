@@ -1,43 +1,60 @@
 #include "bit_writer.h"
-#include <stdexcept>
 #include <algorithm>
 
-BitWriter::BitWriter() : currentByte(0), bitPosition(0) {}
+BitWriter::BitWriter(size_t initialCapacity)
+    : stream(std::max<size_t>(initialCapacity, 16)), used(0), accumulator(0), bitCount(0) {}
 
-void BitWriter::writeBits(int value, int bitCount) {
-    if (bitCount <= 0 || bitCount > 32) {
-        throw std::invalid_argument("Bit count must be 1-32");
-    }
-    
-    for (int i = bitCount - 1; i >= 0; i--) {
-        int bit = (value >> i) & 1;
-        currentByte = (currentByte << 1) | bit;
-        bitPosition++;
-        
-        if (bitPosition == 8) {
-            stream.push_back(currentByte);
-            currentByte = 0;
-            bitPosition = 0;
+BitWriter::BitWriter(std::vector<unsigned char>&& buffer, size_t initialCapacity)
+    : stream(std::move(buffer)), used(0), accumulator(0), bitCount(0) {
+    // Размер до ёмкости не перевыделяет память
+    stream.resize(std::max({stream.capacity(), initialCapacity, size_t(16)}));
+}
+
+void BitWriter::flushSlow(uint32_t word) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        unsigned char b = static_cast<unsigned char>(word >> shift);
+        stream[used++] = b;
+        if (b == 0xFF) {
+            stream[used++] = 0x00; // stuff byte
         }
     }
 }
 
-std::vector<unsigned char> BitWriter::toArray() {
-    // Дописываем последний байт если не заполнен
-    if (bitPosition > 0) {
-        currentByte <<= (8 - bitPosition);
-        stream.push_back(currentByte);
+void BitWriter::padToByte() {
+    // Дописываем последний байт если не заполнен (JPEG требует заполнение единицами)
+    int padding = (8 - bitCount % 8) % 8;
+    if (padding > 0) {
+        accumulator = (accumulator << padding) | ((uint64_t(1) << padding) - 1);
+        bitCount += padding;
     }
     
-    // Byte stuffing: после каждого 0xFF вставляем 0x00
-    std::vector<unsigned char> stuffedStream;
-    
-    for (unsigned char b : stream) {
-        stuffedStream.push_back(b);
+    ensureCapacity(static_cast<size_t>(bitCount / 8) * 2);
+    while (bitCount > 0) {
+        bitCount -= 8;
+        unsigned char b = static_cast<unsigned char>(accumulator >> bitCount);
+        stream[used++] = b;
         if (b == 0xFF) {
-            stuffedStream.push_back(0x00); // stuff byte
+            stream[used++] = 0x00; // stuff byte
         }
     }
-    
-    return stuffedStream;
-}
\ No newline at end of file
+    accumulator = 0;
+}
+
+void BitWriter::writeRestartMarker(int index) {
+    padToByte();
+    ensureCapacity(2);
+    stream[used++] = 0xFF;
+    stream[used++] = static_cast<unsigned char>(0xD0 + (index & 7));
+}
+
+std::vector<unsigned char> BitWriter::toArray() {
+    padToByte();
+    return std::vector<unsigned char>(stream.begin(), stream.begin() + used);
+}
+
+std::vector<unsigned char> BitWriter::release() {
+    padToByte();
+    stream.resize(used);
+    used = 0;
+    return std::move(stream);
+}
@@ -0,0 +1,560 @@
+#include "cli.h"
+#include "sequential_processors.h"
+#include "multy_thread.h"
+#include "pipeline_processor.h"
+#include "OpenMPBlockProcessor.h"
+#include "OpenMPQuantizer.h"
+#include "fast_dct_transform.h"
+#include "fused_mcu_processor.h"
+#include "jfif_writer.h"
+#include "jfif_reader.h"
+#include "jpeg_decoder.h"
+#include "pnm_io.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <omp.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+namespace fs = std::filesystem;
+
+namespace {
+    constexpr int kStageCount = 5;
+    const char* const kEncodeStages[kStageCount] = {"read", "color", "blocks", "entropy", "write"};
+    const char* const kDecodeStages[kStageCount] = {"read", "parse", "entropy", "reconstruct", "write"};
+
+    struct Options {
+        bool decode = false;
+        vector<string> inputs;
+        string output;  // файл (один вход) или каталог; пусто - рядом со входом
+        int quality = 75;
+        string backend = "fused";
+        int threads = 1;  // потоков на одно изображение
+        int jobs = 0;     // файлов одновременно; 0 - рабочие пула + вызывающий поток
+        ChromaSubsampling subsampling = ChromaSubsampling::Yuv420;
+        int restartInterval = 0;
+        JpegFormat::HuffmanTables huffmanTables = JpegFormat::HuffmanTables::Optimized;
+        OpenMPTileSchedule ompSchedule;
+
+        bool standardTables() const { return huffmanTables == JpegFormat::HuffmanTables::Standard; }
+        // Слитый однопоточный бэкенд со стандартными таблицами кодирует скан прямо в проходе по MCU
+        bool singlePass() const { return backend == "fused" && standardTables() && threads == 1; }
+    };
+
+    // Итоги по всем файлам; время стадий суммируется по файлам, поэтому при --jobs > 1 превышает общее
+    struct Totals {
+        mutex lock;
+        double stageSeconds[kStageCount] = {};
+        double pixels = 0;
+        size_t jpegBytes = 0;
+        int succeeded = 0;
+        int failed = 0;
+    };
+
+    // Результат обработки одного файла
+    struct FileResult {
+        double stageSeconds[kStageCount] = {};
+        double pixels = 0;
+        size_t jpegBytes = 0;  // размер JPEG файла (выход кодера или вход декодера)
+    };
+
+    // Замер стадий подряд: lap(i) относит время с прошлой отметки к стадии i
+    class StageClock {
+    private:
+        FileResult& result;
+        steady_clock::time_point last = steady_clock::now();
+
+    public:
+        explicit StageClock(FileResult& result) : result(result) {}
+
+        void lap(int stage) {
+            auto now = steady_clock::now();
+            result.stageSeconds[stage] += duration<double>(now - last).count();
+            last = now;
+        }
+    };
+
+    // Стадии кодера выбранного бэкенда. У слитого бэкенда цвет, DCT и квантование - один проход mcuProcessor,
+    // он же собирает гистограммы символов для scanEncoder
+    struct EncoderStages {
+        unique_ptr<IColorConverter> colorConverter;
+        unique_ptr<IBlockProcessor> blockProcessor;
+        unique_ptr<IHuffmanEncoder> huffmanEncoder;
+        unique_ptr<FusedMcuProcessor> mcuProcessor;
+        unique_ptr<SequentialHuffmanEncoder> scanEncoder;
+        shared_ptr<const QuantTable> quantTables;
+    };
+
+    void printUsage(ostream& out) {
+        out << "Usage:\n"
+            << "  jpeg_compressor encode [options] <input.ppm|directory>...\n"
+            << "  jpeg_compressor decode [options] <input.jpg|directory>...\n"
+            << "\n"
+            << "Options:\n"
+            << "  -o, --output <path>        output file (single input) or directory; default: next to input\n"
+            << "  -q, --quality <1-100>      encoder quality (default 75)\n"
+            << "  --backend <name>           sequential | openmp | multithread | pipeline | fused (default fused)\n"
+            << "  --threads <n>              threads per image (default 1); decode: restart intervals in parallel\n"
+            << "  --jobs <n>                 files processed concurrently (default: hardware threads)\n"
+            << "  --subsampling <mode>       444 | 422 | 420 (default 420)\n"
+            << "  --restart-interval <n>     RSTn marker every n MCU; not with multithread backend (always every MCU row)\n"
+            << "  --huffman <tables>         optimized | standard (default optimized); standard = Annex K tables,\n"
+            << "                             single pass (fused in the block stage for fused backend with 1 thread);\n"
+            << "                             not with multithread or pipeline backends\n"
+            << "  --omp-schedule <kind>[:n]  openmp backend: static | dynamic | guided | taskloop, n MCU rows\n"
+            << "                             per chunk (default dynamic:1; static:0 = equal bands)\n"
+            << "  --omp-bind <placement>     openmp backend: env | close | spread (default env = OMP_PROC_BIND)\n"
+            << "\n"
+            << "Encoder input: binary PPM/PGM/PAM. Decoder output: PPM.\n"
+            << "Directories are scanned non-recursively for .ppm/.pgm/.pnm/.pam (encode) or .jpg/.jpeg (decode).\n";
+    }
+
+    int parseNumber(const string& option, const char* value, int minValue, int maxValue) {
+        char* end = nullptr;
+        errno = 0;
+        long number = strtol(value, &end, 10);
+        if (errno != 0 || end == value || *end != '\0' || number < minValue || number > maxValue) {
+            throw invalid_argument(option + " expects an integer in [" + to_string(minValue) + ", " +
+                                   to_string(maxValue) + "], got '" + value + "'");
+        }
+        return static_cast<int>(number);
+    }
+
+    // kind[:chunk] для --omp-schedule
+    OpenMPTileSchedule::Kind parseScheduleKind(const string& spec, int& chunk) {
+        size_t colon = spec.find(':');
+        string kind = spec.substr(0, colon);
+        if (colon != string::npos) {
+            chunk = parseNumber("--omp-schedule", spec.c_str() + colon + 1, 0, 1 << 20);
+        }
+        if (kind == "static") {
+            return OpenMPTileSchedule::Kind::Static;
+        }
+        if (kind == "dynamic") {
+            return OpenMPTileSchedule::Kind::Dynamic;
+        }
+        if (kind == "guided") {
+            return OpenMPTileSchedule::Kind::Guided;
+        }
+        if (kind == "taskloop") {
+            return OpenMPTileSchedule::Kind::TaskLoop;
+        }
+        throw invalid_argument("Unknown OpenMP schedule: " + kind + " (expected static, dynamic, guided or taskloop)");
+    }
+
+    Options parseOptions(int argc, char* argv[]) {
+        Options options;
+        options.decode = strcmp(argv[0], "decode") == 0;
+
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            auto value = [&]() -> const char* {
+                if (i + 1 >= argc) {
+                    throw invalid_argument(arg + " requires a value");
+                }
+                return argv[++i];
+            };
+
+            if (arg == "-o" || arg == "--output") {
+                options.output = value();
+            } else if (arg == "-q" || arg == "--quality") {
+                options.quality = parseNumber(arg, value(), 1, 100);
+            } else if (arg == "--backend") {
+                options.backend = value();
+                if (options.backend != "sequential" && options.backend != "openmp" &&
+                    options.backend != "multithread" && options.backend != "pipeline" && options.backend != "fused") {
+                    throw invalid_argument("Unknown backend: " + options.backend);
+                }
+            } else if (arg == "--threads") {
+                options.threads = parseNumber(arg, value(), 1, 1024);
+            } else if (arg == "--jobs") {
+                options.jobs = parseNumber(arg, value(), 1, 1024);
+            } else if (arg == "--subsampling") {
+                string mode = value();
+                if (mode == "444") {
+                    options.subsampling = ChromaSubsampling::Yuv444;
+                } else if (mode == "422") {
+                    options.subsampling = ChromaSubsampling::Yuv422;
+                } else if (mode == "420") {
+                    options.subsampling = ChromaSubsampling::Yuv420;
+                } else {
+                    throw invalid_argument("Unknown subsampling mode: " + mode + " (expected 444, 422 or 420)");
+                }
+            } else if (arg == "--restart-interval") {
+                options.restartInterval = parseNumber(arg, value(), 0, 65535);
+            } else if (arg == "--huffman") {
+                string tables = value();
+                if (tables == "optimized") {
+                    options.huffmanTables = JpegFormat::HuffmanTables::Optimized;
+                } else if (tables == "standard") {
+                    options.huffmanTables = JpegFormat::HuffmanTables::Standard;
+                } else {
+                    throw invalid_argument("Unknown Huffman tables: " + tables + " (expected optimized or standard)");
+                }
+            } else if (arg == "--omp-schedule") {
+                options.ompSchedule.kind = parseScheduleKind(value(), options.ompSchedule.chunk);
+            } else if (arg == "--omp-bind") {
+                string placement = value();
+                if (placement == "env") {
+                    options.ompSchedule.placement = OpenMPTileSchedule::Placement::Environment;
+                } else if (placement == "close") {
+                    options.ompSchedule.placement = OpenMPTileSchedule::Placement::Close;
+                } else if (placement == "spread") {
+                    options.ompSchedule.placement = OpenMPTileSchedule::Placement::Spread;
+                } else {
+                    throw invalid_argument("Unknown OpenMP placement: " + placement + " (expected env, close or spread)");
+                }
+            } else if (arg.size() > 1 && arg[0] == '-') {
+                throw invalid_argument("Unknown option: " + arg);
+            } else {
+                options.inputs.push_back(arg);
+            }
+        }
+
+        if (options.inputs.empty()) {
+            throw invalid_argument("No input files");
+        }
+        // Кодер multithread режет скан на интервалы по строкам MCU сам, другой интервал он не выдаст
+        if (!options.decode && options.backend == "multithread" && options.restartInterval != 0) {
+            throw invalid_argument("--restart-interval is not supported by the multithread backend "
+                                   "(it restarts every MCU row)");
+        }
+        // Их кодеры всегда строят оптимальные таблицы; подмена на последовательный кодер исказила бы замер
+        if (!options.decode && options.standardTables() &&
+            (options.backend == "multithread" || options.backend == "pipeline")) {
+            throw invalid_argument("--huffman standard is not supported by the " + options.backend + " backend");
+        }
+        return options;
+    }
+
+    bool hasExtension(const fs::path& path, initializer_list<const char*> extensions) {
+        string extension = path.extension().string();
+        transform(extension.begin(), extension.end(), extension.begin(),
+                  [](unsigned char c) { return static_cast<char>(tolower(c)); });
+        for (const char* candidate : extensions) {
+            if (extension == candidate) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Файлы из аргументов как есть, из каталогов - с подходящими расширениями, по имени
+    vector<fs::path> collectInputs(const Options& options) {
+        vector<fs::path> files;
+        for (const auto& input : options.inputs) {
+            fs::path path(input);
+            if (!fs::is_directory(path)) {
+                files.push_back(path);
+                continue;
+            }
+            vector<fs::path> entries;
+            for (const auto& entry : fs::directory_iterator(path)) {
+                if (!entry.is_regular_file()) {
+                    continue;
+                }
+                bool matches = options.decode
+                    ? hasExtension(entry.path(), {".jpg", ".jpeg"})
+                    : hasExtension(entry.path(), {".ppm", ".pgm", ".pnm", ".pam"});
+                if (matches) {
+                    entries.push_back(entry.path());
+                }
+            }
+            sort(entries.begin(), entries.end());
+            files.insert(files.end(), entries.begin(), entries.end());
+        }
+        return files;
+    }
+
+    // -o с одним входом, не являющийся каталогом, - имя выходного файла; иначе каталог для <имя>.jpg/.ppm
+    fs::path outputPath(const Options& options, const fs::path& input, size_t inputCount) {
+        fs::path renamed = input.filename();
+        renamed.replace_extension(options.decode ? ".ppm" : ".jpg");
+        if (options.output.empty()) {
+            return input.parent_path() / renamed;
+        }
+        fs::path output(options.output);
+        if (inputCount == 1 && !fs::is_directory(output)) {
+            return output;
+        }
+        return output / renamed;
+    }
+
+    EncoderStages makeEncoderStages(const Options& options) {
+        EncoderStages stages;
+        if (options.backend == "openmp") {
+            auto quantizer = make_unique<OpenMPQuantizer>(options.quality);
+            stages.quantTables = quantizer->getQuantTable();
+            stages.colorConverter = make_unique<SequentialColorConverter>();
+            stages.blockProcessor = make_unique<OpenMPBlockProcessor>(make_unique<FastDctTransform>(), move(quantizer),
+                                                                      options.ompSchedule);
+            stages.huffmanEncoder = make_unique<SequentialHuffmanEncoder>(options.restartInterval);
+        } else if (options.backend == "multithread") {
+            auto quantizer = make_unique<SequentialQuantizer>(options.quality);
+            stages.quantTables = quantizer->getQuantTable();
+            stages.colorConverter = make_unique<MultiThreadColorConverter>(options.threads);
+            stages.blockProcessor = make_unique<MultiThreadBlockProcessor>(
+                make_unique<FastDctTransform>(), move(quantizer), options.threads);
+            stages.huffmanEncoder = make_unique<MultiThreadHuffmanEncoder>(options.threads);
+        } else if (options.backend == "pipeline") {
+            auto quantizer = make_unique<PipelineQuantizer>(options.quality);
+            stages.quantTables = quantizer->getQuantTable();
+            stages.colorConverter = make_unique<PipelineColorConverter>();
+            stages.blockProcessor = make_unique<PipelineBlockProcessor>(
+                make_unique<FastDctTransform>(), move(quantizer), options.threads);
+            stages.huffmanEncoder = make_unique<PipelineHuffmanEncoder>(options.restartInterval);
+        } else if (options.backend == "fused") {
+            auto quantizer = make_unique<SequentialQuantizer>(options.quality);
+            stages.quantTables = quantizer->getQuantTable();
+            stages.mcuProcessor = make_unique<FusedMcuProcessor>(
+                make_unique<FastDctTransform>(), move(quantizer), options.threads);
+            stages.scanEncoder = make_unique<SequentialHuffmanEncoder>(options.restartInterval, nullptr,
+                                                                       options.huffmanTables);
+        } else {
+            auto quantizer = make_unique<SequentialQuantizer>(options.quality);
+            stages.quantTables = quantizer->getQuantTable();
+            stages.colorConverter = make_unique<SequentialColorConverter>();
+            stages.blockProcessor = make_unique<SequentialBlockProcessor>(make_unique<FastDctTransform>(), move(quantizer));
+            stages.huffmanEncoder = make_unique<SequentialHuffmanEncoder>(options.restartInterval);
+        }
+        // Стандартные таблицы поддерживает только последовательный кодер: один проход по скану без подсчёта.
+        // Он и так стоит у sequential и openmp, multithread и pipeline отклоняет parseOptions
+        if (options.standardTables() && stages.huffmanEncoder) {
+            stages.huffmanEncoder = make_unique<SequentialHuffmanEncoder>(options.restartInterval, nullptr,
+                                                                          options.huffmanTables);
+        }
+        return stages;
+    }
+
+    void writeJpegFile(const JpegEncodedData& encoded, const string& path) {
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw system_error(errno, generic_category(), "Cannot create " + path);
+        }
+        try {
+            FileDescriptorSink sink(fd);
+            JfifWriter::write(encoded, sink);
+            sink.flush();
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+        if (::close(fd) != 0) {
+            throw system_error(errno, generic_category(), "Cannot close " + path);
+        }
+    }
+
+    // Для P6 с MAXVAL 255 "read" - только разбор заголовка: растр отображён в память,
+    // и его страницы подгружаются уже при конвертации цвета (или в слитом проходе)
+    FileResult encodeFile(const Options& options, const fs::path& input, const fs::path& output) {
+        EncoderStages stages = makeEncoderStages(options);
+        FileResult result;
+        StageClock clock(result);
+
+        RgbImage image = PnmIo::load(input.string());
+        clock.lap(0);
+
+        vector<QuantizedBlock> blocks;
+        JpegEncodedData encoded;
+        if (options.singlePass()) {
+            // color и entropy остаются нулевыми: всё в одном проходе по MCU
+            BitWriter writer(static_cast<size_t>(image.getWidth()) * image.getHeight() / 4 + 4096);
+            stages.mcuProcessor->encodeStandard(image, options.subsampling, options.restartInterval, writer);
+            writer.padToByte();
+            encoded.compressedData = writer.release();
+            encoded.width = image.getWidth();
+            encoded.height = image.getHeight();
+            encoded.quantTables = stages.quantTables;
+            encoded.restartInterval = options.restartInterval;
+            encoded.subsampling = options.subsampling;
+            JpegFormat::setStandardTables(encoded);
+            clock.lap(2);
+        } else if (stages.mcuProcessor) {
+            // Стадия color остаётся нулевой: конвертация идёт внутри прохода по MCU
+            JpegFormat::SymbolHistogram histogram;
+            stages.mcuProcessor->processImage(image, options.subsampling, blocks, options.restartInterval, histogram);
+            clock.lap(2);
+            stages.scanEncoder->encode(blocks, image.getWidth(), image.getHeight(), stages.quantTables,
+                                       options.subsampling, histogram, encoded);
+        } else {
+            YCbCrImage ycbcr = stages.colorConverter->convert(image);
+            ycbcr.downsampleChroma(options.subsampling);
+            clock.lap(1);
+            blocks = stages.blockProcessor->processBlocks(ycbcr);
+            clock.lap(2);
+            encoded = stages.huffmanEncoder->encode(
+                blocks, image.getWidth(), image.getHeight(), stages.quantTables, options.subsampling);
+        }
+        clock.lap(3);
+
+        writeJpegFile(encoded, output.string());
+        clock.lap(4);
+
+        result.pixels = static_cast<double>(image.getWidth()) * image.getHeight();
+        result.jpegBytes = fs::file_size(output);
+        return result;
+    }
+
+    FileResult decodeFile(const Options& options, const fs::path& input, const fs::path& output) {
+        FileResult result;
+        StageClock clock(result);
+
+        MappedFile file(input.string());
+        clock.lap(0);
+
+        JpegEncodedData encoded = JfifReader::read(file.data(), file.size());
+        clock.lap(1);
+
+        // Стадия entropy остаётся нулевой: интервалы перезапуска декодируются параллельно (до --threads задач)
+        // вместе с обратным DCT и конвертацией цвета, без вектора блоков всего изображения
+        JpegDecoder decoder(encoded.quantTables, make_unique<FastDctInverseTransform>());
+        decoder.setThreadCount(options.threads);
+        RgbImage image = decoder.decode(encoded);
+        clock.lap(3);
+
+        PnmIo::save(image, output.string());
+        clock.lap(4);
+
+        result.pixels = static_cast<double>(encoded.width) * encoded.height;
+        result.jpegBytes = file.size();
+        return result;
+    }
+
+    void printReport(const Options& options, const Totals& totals, int jobs, double wallSeconds) {
+        const char* const* names = options.decode ? kDecodeStages : kEncodeStages;
+        double megapixels = totals.pixels / 1e6;
+
+        cout << (options.decode ? "Decoded " : "Encoded ") << totals.succeeded << " file(s)";
+        if (totals.failed > 0) {
+            cout << ", " << totals.failed << " failed";
+        }
+        cout << " | backend " << (options.decode ? "decoder" : options.backend)
+             << ", " << jobs << " job(s) x " << options.threads << " thread(s)";
+        if (!options.decode) {
+            const char* mode = options.subsampling == ChromaSubsampling::Yuv444 ? "4:4:4"
+                             : options.subsampling == ChromaSubsampling::Yuv422 ? "4:2:2" : "4:2:0";
+            cout << ", quality " << options.quality << ", " << mode
+                 << ", " << (options.standardTables() ? "standard" : "optimized") << " Huffman tables";
+        }
+        cout << endl;
+
+        double stageTotal = 0;
+        for (double seconds : totals.stageSeconds) {
+            stageTotal += seconds;
+        }
+
+        cout << fixed;
+        cout << left << setw(14) << "Stage" << right << setw(12) << "Time (ms)" << setw(10) << "Share"
+             << setw(12) << "MP/s" << endl;
+        for (int stage = 0; stage < kStageCount; stage++) {
+            double seconds = totals.stageSeconds[stage];
+            string stageName = names[stage];
+            // Учтено в blocks
+            bool fused = !options.decode &&
+                         ((options.backend == "fused" && stage == 1) || (options.singlePass() && stage == 3));
+            if (fused) {
+                stageName += " (fused)";
+            }
+            cout << left << setw(14) << stageName << right
+                 << setw(12) << setprecision(2) << seconds * 1000
+                 << setw(9) << setprecision(1) << (stageTotal > 0 ? seconds / stageTotal * 100 : 0) << "%"
+                 << setw(12) << setprecision(1);
+            if (seconds > 0 && !fused) {
+                cout << megapixels / seconds;
+            } else {
+                cout << "-";
+            }
+            cout << endl;
+        }
+        cout << left << setw(14) << "sum" << right << setw(12) << setprecision(2) << stageTotal * 1000
+             << setw(10) << "" << setw(12) << setprecision(1) << (stageTotal > 0 ? megapixels / stageTotal : 0)
+             << endl;
+
+        cout << "Wall time " << setprecision(3) << wallSeconds << " s, " << setprecision(2) << megapixels
+             << " MP, throughput " << setprecision(1) << (wallSeconds > 0 ? megapixels / wallSeconds : 0) << " MP/s";
+        if (totals.jpegBytes > 0) {
+            // Степень сжатия относительно 24-битного RGB
+            cout << ", " << setprecision(2) << totals.jpegBytes / 1e6 << " MB JPEG ("
+                 << setprecision(1) << totals.pixels * 3 / totals.jpegBytes << ":1)";
+        }
+        cout << defaultfloat << endl;
+    }
+}
+
+namespace Cli {
+    bool isCommand(const char* arg) {
+        return strcmp(arg, "encode") == 0 || strcmp(arg, "decode") == 0;
+    }
+
+    int run(int argc, char* argv[]) {
+        if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+            printUsage(cout);
+            return 0;
+        }
+
+        Options options;
+        vector<fs::path> files;
+        try {
+            options = parseOptions(argc, argv);
+            files = collectInputs(options);
+            if (files.empty()) {
+                throw invalid_argument("No matching input files");
+            }
+            if (!options.output.empty() && files.size() > 1) {
+                fs::create_directories(options.output);
+            }
+        } catch (const exception& e) {
+            cerr << "error: " << e.what() << "\n\n";
+            printUsage(cerr);
+            return 2;
+        }
+
+        ThreadPool& pool = ThreadPool::shared();
+        int jobs = options.jobs > 0 ? options.jobs : pool.getThreadCount() + 1;
+        jobs = static_cast<int>(min<size_t>(jobs, files.size()));
+
+        Totals totals;
+        auto wallStart = steady_clock::now();
+
+        pool.parallelFor(0, files.size(), 1, [&](size_t first, size_t last) {
+            // Число потоков OpenMP - свойство вызывающего потока, поэтому задаётся в каждой задаче
+            omp_set_num_threads(options.threads);
+            for (size_t i = first; i < last; i++) {
+                fs::path output = outputPath(options, files[i], files.size());
+                try {
+                    FileResult result = options.decode ? decodeFile(options, files[i], output)
+                                                       : encodeFile(options, files[i], output);
+                    lock_guard<mutex> guard(totals.lock);
+                    for (int stage = 0; stage < kStageCount; stage++) {
+                        totals.stageSeconds[stage] += result.stageSeconds[stage];
+                    }
+                    totals.pixels += result.pixels;
+                    totals.jpegBytes += result.jpegBytes;
+                    totals.succeeded++;
+                } catch (const exception& e) {
+                    lock_guard<mutex> guard(totals.lock);
+                    cerr << "error: " << files[i].string() << ": " << e.what() << endl;
+                    totals.failed++;
+                }
+            }
+        }, jobs);
+
+        double wallSeconds = duration<double>(steady_clock::now() - wallStart).count();
+        printReport(options, totals, jobs, wallSeconds);
+        return totals.failed == 0 ? 0 : 1;
+    }
+}
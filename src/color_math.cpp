@@ -16,4 +16,4 @@ ColorMath::rgbToYCbCr(unsigned char r, unsigned char g, unsigned char b) {
     return {static_cast<unsigned char>(y), 
             static_cast<unsigned char>(cb), 
             static_cast<unsigned char>(cr)};
-}
\ No newline at end of file
+}
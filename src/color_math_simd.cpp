@@ -0,0 +1,293 @@
+#include "color_math.h"
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COLOR_MATH_X86 1
+#endif
+
+// Целочисленная конвертация RGB -> YCbCr (ITU-R BT.601, полный диапазон).
+// Коэффициенты умножены на 2^14 и округлены; суммы по строкам точно равны 2^14 и 0,
+// поэтому результат всегда попадает в 0..255 без ограничения.
+// Смещение Cb/Cr использует ONE_HALF - 1 (как в libjpeg), иначе B = 255 даёт 256.
+
+namespace {
+    constexpr int kShift = 14;
+
+    constexpr int16_t kYR = 4899, kYG = 9617, kYB = 1868;
+    constexpr int16_t kCbR = -2765, kCbG = -5427, kCbB = 8192;
+    constexpr int16_t kCrR = 8192, kCrG = -6860, kCrB = -1332;
+
+    constexpr int32_t kYBias = 1 << (kShift - 1);
+    constexpr int32_t kChromaBias = (128 << kShift) + (1 << (kShift - 1)) - 1;
+
+    void rgbRowReference(const unsigned char* rgb, unsigned char* y, unsigned char* cb,
+                         unsigned char* cr, int count) {
+        for (int x = 0; x < count; x++) {
+            int r = rgb[x * 3];
+            int g = rgb[x * 3 + 1];
+            int b = rgb[x * 3 + 2];
+            y[x]  = static_cast<unsigned char>((kYR * r + kYG * g + kYB * b + kYBias) >> kShift);
+            cb[x] = static_cast<unsigned char>((kCbR * r + kCbG * g + kCbB * b + kChromaBias) >> kShift);
+            cr[x] = static_cast<unsigned char>((kCrR * r + kCrG * g + kCrB * b + kChromaBias) >> kShift);
+        }
+    }
+
+    // Box-фильтр 2x2 (для 4:2:2 row1 == row0). Смещение округления чередуется 1, 2 по выходным столбцам,
+    // как в libjpeg: постоянное +2 давало бы систематический сдвиг цветности вверх.
+    // Выходы начиная с first; у нечётного srcCount последний столбец повторяется
+    void downsampleRowReference(const unsigned char* row0, const unsigned char* row1, unsigned char* out,
+                                int srcCount, int first) {
+        int outCount = (srcCount + 1) / 2;
+        for (int i = first; i < outCount; i++) {
+            int x0 = 2 * i;
+            int x1 = x0 + 1 < srcCount ? x0 + 1 : x0;
+            out[i] = static_cast<unsigned char>((row0[x0] + row0[x1] + row1[x0] + row1[x1] + 1 + (i & 1)) >> 2);
+        }
+    }
+
+#ifdef COLOR_MATH_X86
+    // Разбирает 48 байт RGB (16 пикселей) на три регистра по 16 байт R, G, B
+    __attribute__((target("ssse3")))
+    inline void deinterleave16(const unsigned char* src, __m128i& r, __m128i& g, __m128i& b) {
+        const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+        const __m128i a2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+
+        const char z = -128; // pshufb обнуляет байт при установленном старшем бите
+        r = _mm_or_si128(_mm_or_si128(
+                _mm_shuffle_epi8(a0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, z, z, z, z, z, z, z, z, z, z)),
+                _mm_shuffle_epi8(a1, _mm_setr_epi8(z, z, z, z, z, z, 2, 5, 8, 11, 14, z, z, z, z, z))),
+                _mm_shuffle_epi8(a2, _mm_setr_epi8(z, z, z, z, z, z, z, z, z, z, z, 1, 4, 7, 10, 13)));
+        g = _mm_or_si128(_mm_or_si128(
+                _mm_shuffle_epi8(a0, _mm_setr_epi8(1, 4, 7, 10, 13, z, z, z, z, z, z, z, z, z, z, z)),
+                _mm_shuffle_epi8(a1, _mm_setr_epi8(z, z, z, z, z, 0, 3, 6, 9, 12, 15, z, z, z, z, z))),
+                _mm_shuffle_epi8(a2, _mm_setr_epi8(z, z, z, z, z, z, z, z, z, z, z, 2, 5, 8, 11, 14)));
+        b = _mm_or_si128(_mm_or_si128(
+                _mm_shuffle_epi8(a0, _mm_setr_epi8(2, 5, 8, 11, 14, z, z, z, z, z, z, z, z, z, z, z)),
+                _mm_shuffle_epi8(a1, _mm_setr_epi8(z, z, z, z, z, 1, 4, 7, 10, 13, z, z, z, z, z, z))),
+                _mm_shuffle_epi8(a2, _mm_setr_epi8(z, z, z, z, z, z, z, z, z, z, 0, 3, 6, 9, 12, 15)));
+    }
+
+    // ---------- SSE4.1 ----------
+
+    // cR*R + cG*G + cB*B + bias для 4 пикселей: (R,G) и (B,0) попарно через pmaddwd
+    __attribute__((target("sse4.1")))
+    inline __m128i dot4(__m128i rg, __m128i b0, __m128i coeffRG, __m128i coeffB0, __m128i bias) {
+        __m128i sum = _mm_add_epi32(_mm_madd_epi16(rg, coeffRG), _mm_madd_epi16(b0, coeffB0));
+        return _mm_srai_epi32(_mm_add_epi32(sum, bias), kShift);
+    }
+
+    // Один выходной канал для 8 пикселей (R, G, B уже расширены до 16 бит)
+    __attribute__((target("sse4.1")))
+    inline __m128i channel8(__m128i r16, __m128i g16, __m128i b16,
+                            int16_t cR, int16_t cG, int16_t cB, int32_t biasValue) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i coeffRG = _mm_set1_epi32((static_cast<uint16_t>(cG) << 16) | static_cast<uint16_t>(cR));
+        const __m128i coeffB0 = _mm_set1_epi32(static_cast<uint16_t>(cB));
+        const __m128i bias = _mm_set1_epi32(biasValue);
+
+        __m128i lo = dot4(_mm_unpacklo_epi16(r16, g16), _mm_unpacklo_epi16(b16, zero), coeffRG, coeffB0, bias);
+        __m128i hi = dot4(_mm_unpackhi_epi16(r16, g16), _mm_unpackhi_epi16(b16, zero), coeffRG, coeffB0, bias);
+        return _mm_packs_epi32(lo, hi);
+    }
+
+    __attribute__((target("sse4.1")))
+    void rgbRowSse41(const unsigned char* rgb, unsigned char* y, unsigned char* cb,
+                     unsigned char* cr, int count) {
+        int x = 0;
+        for (; x + 16 <= count; x += 16) {
+            __m128i r, g, b;
+            deinterleave16(rgb + x * 3, r, g, b);
+
+            const __m128i rLo = _mm_cvtepu8_epi16(r), rHi = _mm_cvtepu8_epi16(_mm_srli_si128(r, 8));
+            const __m128i gLo = _mm_cvtepu8_epi16(g), gHi = _mm_cvtepu8_epi16(_mm_srli_si128(g, 8));
+            const __m128i bLo = _mm_cvtepu8_epi16(b), bHi = _mm_cvtepu8_epi16(_mm_srli_si128(b, 8));
+
+            __m128i yv = _mm_packus_epi16(channel8(rLo, gLo, bLo, kYR, kYG, kYB, kYBias),
+                                          channel8(rHi, gHi, bHi, kYR, kYG, kYB, kYBias));
+            __m128i cbv = _mm_packus_epi16(channel8(rLo, gLo, bLo, kCbR, kCbG, kCbB, kChromaBias),
+                                           channel8(rHi, gHi, bHi, kCbR, kCbG, kCbB, kChromaBias));
+            __m128i crv = _mm_packus_epi16(channel8(rLo, gLo, bLo, kCrR, kCrG, kCrB, kChromaBias),
+                                           channel8(rHi, gHi, bHi, kCrR, kCrG, kCrB, kChromaBias));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(y + x), yv);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(cb + x), cbv);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(cr + x), crv);
+        }
+        rgbRowReference(rgb + x * 3, y + x, cb + x, cr + x, count - x);
+    }
+
+    // ---------- AVX2 ----------
+
+    // Один канал для 16 пикселей. unpack/packs работают внутри 128-битных половин,
+    // поэтому перестановки взаимно компенсируются и порядок пикселей сохраняется.
+    __attribute__((target("avx2")))
+    inline __m256i channel16(__m256i r16, __m256i g16, __m256i b16,
+                             int16_t cR, int16_t cG, int16_t cB, int32_t biasValue) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i coeffRG = _mm256_set1_epi32((static_cast<uint16_t>(cG) << 16) | static_cast<uint16_t>(cR));
+        const __m256i coeffB0 = _mm256_set1_epi32(static_cast<uint16_t>(cB));
+        const __m256i bias = _mm256_set1_epi32(biasValue);
+
+        __m256i lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(r16, g16), coeffRG),
+                                      _mm256_madd_epi16(_mm256_unpacklo_epi16(b16, zero), coeffB0));
+        __m256i hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(r16, g16), coeffRG),
+                                      _mm256_madd_epi16(_mm256_unpackhi_epi16(b16, zero), coeffB0));
+        lo = _mm256_srai_epi32(_mm256_add_epi32(lo, bias), kShift);
+        hi = _mm256_srai_epi32(_mm256_add_epi32(hi, bias), kShift);
+        return _mm256_packs_epi32(lo, hi);
+    }
+
+    // Упаковывает два вектора по 16 int16 в 32 байта с сохранением порядка
+    __attribute__((target("avx2")))
+    inline __m256i pack32(__m256i first, __m256i second) {
+        return _mm256_permute4x64_epi64(_mm256_packus_epi16(first, second), 0xD8);
+    }
+
+    __attribute__((target("avx2")))
+    void rgbRowAvx2(const unsigned char* rgb, unsigned char* y, unsigned char* cb,
+                    unsigned char* cr, int count) {
+        int x = 0;
+        for (; x + 32 <= count; x += 32) {
+            __m128i r0, g0, b0, r1, g1, b1;
+            deinterleave16(rgb + x * 3, r0, g0, b0);
+            deinterleave16(rgb + x * 3 + 48, r1, g1, b1);
+
+            const __m256i rA = _mm256_cvtepu8_epi16(r0), rB = _mm256_cvtepu8_epi16(r1);
+            const __m256i gA = _mm256_cvtepu8_epi16(g0), gB = _mm256_cvtepu8_epi16(g1);
+            const __m256i bA = _mm256_cvtepu8_epi16(b0), bB = _mm256_cvtepu8_epi16(b1);
+
+            __m256i yv = pack32(channel16(rA, gA, bA, kYR, kYG, kYB, kYBias),
+                                channel16(rB, gB, bB, kYR, kYG, kYB, kYBias));
+            __m256i cbv = pack32(channel16(rA, gA, bA, kCbR, kCbG, kCbB, kChromaBias),
+                                 channel16(rB, gB, bB, kCbR, kCbG, kCbB, kChromaBias));
+            __m256i crv = pack32(channel16(rA, gA, bA, kCrR, kCrG, kCrB, kChromaBias),
+                                 channel16(rB, gB, bB, kCrR, kCrG, kCrB, kChromaBias));
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + x), yv);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(cb + x), cbv);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(cr + x), crv);
+        }
+        // Хвост (< 32 пикселей) добивает SSE4.1 + скалярный код
+        rgbRowSse41(rgb + x * 3, y + x, cb + x, cr + x, count - x);
+    }
+#endif
+
+#ifdef COLOR_MATH_X86
+    // ---------- Прореживание цветности ----------
+
+    // Суммы соседних пар байт в 16-битных словах: чётный байт + нечётный
+    __attribute__((target("sse4.1")))
+    inline __m128i pairSums(__m128i v) {
+        return _mm_add_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00FF)), _mm_srli_epi16(v, 8));
+    }
+
+    __attribute__((target("sse4.1")))
+    void downsampleRowSse41(const unsigned char* row0, const unsigned char* row1, unsigned char* out,
+                            int srcCount, int first) {
+        // first чётный, поэтому чередование смещения совпадает с номерами слов
+        const __m128i bias = _mm_setr_epi16(1, 2, 1, 2, 1, 2, 1, 2);
+        int pairs = srcCount / 2;
+        int i = first;
+        for (; i + 16 <= pairs; i += 16) {
+            const __m128i* a = reinterpret_cast<const __m128i*>(row0 + 2 * i);
+            const __m128i* b = reinterpret_cast<const __m128i*>(row1 + 2 * i);
+            __m128i lo = _mm_add_epi16(pairSums(_mm_loadu_si128(a)), pairSums(_mm_loadu_si128(b)));
+            __m128i hi = _mm_add_epi16(pairSums(_mm_loadu_si128(a + 1)), pairSums(_mm_loadu_si128(b + 1)));
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, bias), 2);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, bias), 2);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(lo, hi));
+        }
+        downsampleRowReference(row0, row1, out, srcCount, i);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i pairSums(__m256i v) {
+        return _mm256_add_epi16(_mm256_and_si256(v, _mm256_set1_epi16(0x00FF)), _mm256_srli_epi16(v, 8));
+    }
+
+    __attribute__((target("avx2")))
+    void downsampleRowAvx2(const unsigned char* row0, const unsigned char* row1, unsigned char* out,
+                           int srcCount) {
+        const __m256i bias = _mm256_setr_epi16(1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2);
+        int pairs = srcCount / 2;
+        int i = 0;
+        for (; i + 32 <= pairs; i += 32) {
+            const __m256i* a = reinterpret_cast<const __m256i*>(row0 + 2 * i);
+            const __m256i* b = reinterpret_cast<const __m256i*>(row1 + 2 * i);
+            __m256i lo = _mm256_add_epi16(pairSums(_mm256_loadu_si256(a)), pairSums(_mm256_loadu_si256(b)));
+            __m256i hi = _mm256_add_epi16(pairSums(_mm256_loadu_si256(a + 1)), pairSums(_mm256_loadu_si256(b + 1)));
+            lo = _mm256_srli_epi16(_mm256_add_epi16(lo, bias), 2);
+            hi = _mm256_srli_epi16(_mm256_add_epi16(hi, bias), 2);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), pack32(lo, hi));
+        }
+        // Хвост (< 32 выходов) добивает SSE4.1 + скалярный код
+        downsampleRowSse41(row0, row1, out, srcCount, i);
+    }
+#endif
+
+    ColorMath::RowKernel detectRowKernel() {
+#ifdef COLOR_MATH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return ColorMath::RowKernel::Avx2;
+        }
+        if (__builtin_cpu_supports("sse4.1")) {
+            return ColorMath::RowKernel::Sse41;
+        }
+#endif
+        return ColorMath::RowKernel::Reference;
+    }
+}
+
+namespace ColorMath {
+
+    RowKernel activeRowKernel() {
+        static const RowKernel kernel = detectRowKernel();
+        return kernel;
+    }
+
+    bool isRowKernelSupported(RowKernel kernel) {
+        return static_cast<int>(kernel) <= static_cast<int>(activeRowKernel());
+    }
+
+    const char* rowKernelName(RowKernel kernel) {
+        switch (kernel) {
+            case RowKernel::Avx2: return "AVX2";
+            case RowKernel::Sse41: return "SSE4.1";
+            default: return "scalar";
+        }
+    }
+
+    void rgbRowToYCbCr(RowKernel kernel, const unsigned char* rgb, unsigned char* y,
+                       unsigned char* cb, unsigned char* cr, int count) {
+        switch (kernel) {
+#ifdef COLOR_MATH_X86
+            case RowKernel::Avx2: rgbRowAvx2(rgb, y, cb, cr, count); break;
+            case RowKernel::Sse41: rgbRowSse41(rgb, y, cb, cr, count); break;
+#endif
+            default: rgbRowReference(rgb, y, cb, cr, count); break;
+        }
+    }
+
+    void rgbRowToYCbCr(const unsigned char* rgb, unsigned char* y, unsigned char* cb,
+                       unsigned char* cr, int count) {
+        rgbRowToYCbCr(activeRowKernel(), rgb, y, cb, cr, count);
+    }
+
+    void downsampleRow(RowKernel kernel, const unsigned char* row0, const unsigned char* row1,
+                       unsigned char* out, int srcCount) {
+        switch (kernel) {
+#ifdef COLOR_MATH_X86
+            case RowKernel::Avx2: downsampleRowAvx2(row0, row1, out, srcCount); break;
+            case RowKernel::Sse41: downsampleRowSse41(row0, row1, out, srcCount, 0); break;
+#endif
+            default: downsampleRowReference(row0, row1, out, srcCount, 0); break;
+        }
+    }
+
+    void downsampleRow(const unsigned char* row0, const unsigned char* row1, unsigned char* out, int srcCount) {
+        downsampleRow(activeRowKernel(), row0, row1, out, srcCount);
+    }
+}
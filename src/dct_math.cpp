@@ -1,6 +1,7 @@
 #include "dct_math.h"
 #include <cmath>
 #include <vector>
+#include <cstddef>
 #include <omp.h>
 
 using namespace std;
@@ -23,17 +24,188 @@ namespace DctMath {
         return u == 0 ? 1.0 / sqrt(2) : 1.0;
     }
     
-    double computeDctCoefficient(const vector<vector<double>>& block, int u, int v) {
+    double computeDctCoefficient(const float block[64], int u, int v) {
         double sum = 0.0;
         
         // SIMD векторизация внутренних циклов
         #pragma omp simd reduction(+:sum) collapse(2)
         for (int x = 0; x < 8; x++) {
             for (int y = 0; y < 8; y++) {
-                sum += block[x][y] * cosineCache[x][u] * cosineCache[y][v];
+                sum += block[x * 8 + y] * cosineCache[x][u] * cosineCache[y][v];
             }
         }
         
         return 0.25 * alpha(u) * alpha(v) * sum;
     }
+    
+    // Масштабные множители AAN: s[0] = 1, s[k] = cos(k*pi/16) * sqrt(2)
+    static const double aanScaleFactors[8] = {
+        1.0, 1.387039845, 1.306562965, 1.175875602,
+        1.0, 0.785694958, 0.541196100, 0.275899379
+    };
+    
+    void aanOutputScale(float scale[64]) {
+        for (int u = 0; u < 8; u++) {
+            for (int v = 0; v < 8; v++) {
+                double divisor = 8.0 * aanScaleFactors[u] * aanScaleFactors[v];
+                scale[u * 8 + v] = static_cast<float>(1.0 / divisor);
+            }
+        }
+    }
+    
+    // Одномерный AAN по 8 точкам с шагом stride (на месте)
+    static inline void aan8(float* d, int stride) {
+        float tmp0 = d[0 * stride] + d[7 * stride];
+        float tmp7 = d[0 * stride] - d[7 * stride];
+        float tmp1 = d[1 * stride] + d[6 * stride];
+        float tmp6 = d[1 * stride] - d[6 * stride];
+        float tmp2 = d[2 * stride] + d[5 * stride];
+        float tmp5 = d[2 * stride] - d[5 * stride];
+        float tmp3 = d[3 * stride] + d[4 * stride];
+        float tmp4 = d[3 * stride] - d[4 * stride];
+        
+        // Чётная часть
+        float tmp10 = tmp0 + tmp3;
+        float tmp13 = tmp0 - tmp3;
+        float tmp11 = tmp1 + tmp2;
+        float tmp12 = tmp1 - tmp2;
+        
+        d[0 * stride] = tmp10 + tmp11;
+        d[4 * stride] = tmp10 - tmp11;
+        
+        float z1 = (tmp12 + tmp13) * 0.707106781f;
+        d[2 * stride] = tmp13 + z1;
+        d[6 * stride] = tmp13 - z1;
+        
+        // Нечётная часть
+        tmp10 = tmp4 + tmp5;
+        tmp11 = tmp5 + tmp6;
+        tmp12 = tmp6 + tmp7;
+        
+        float z5 = (tmp10 - tmp12) * 0.382683433f;
+        float z2 = 0.541196100f * tmp10 + z5;
+        float z4 = 1.306562965f * tmp12 + z5;
+        float z3 = tmp11 * 0.707106781f;
+        
+        float z11 = tmp7 + z3;
+        float z13 = tmp7 - z3;
+        
+        d[5 * stride] = z13 + z2;
+        d[3 * stride] = z13 - z2;
+        d[1 * stride] = z11 + z4;
+        d[7 * stride] = z11 - z4;
+    }
+    
+    void fastForwardDct(const float in[64], float out[64]) {
+        for (int i = 0; i < 64; i++) {
+            out[i] = in[i];
+        }
+        
+        // Проход по строкам, затем по столбцам
+        for (int row = 0; row < 8; row++) {
+            aan8(out + row * 8, 1);
+        }
+        for (int col = 0; col < 8; col++) {
+            aan8(out + col, 8);
+        }
+    }
+    
+    void aanInverseScale(float scale[64], const vector<vector<int>>* quantTable) {
+        for (int u = 0; u < 8; u++) {
+            for (int v = 0; v < 8; v++) {
+                double multiplier = aanScaleFactors[u] * aanScaleFactors[v] / 8.0;
+                if (quantTable != nullptr) {
+                    multiplier *= (*quantTable)[u][v];
+                }
+                scale[u * 8 + v] = static_cast<float>(multiplier);
+            }
+        }
+    }
+    
+    // Одномерное обратное AAN по 8 точкам с шагом stride (на месте)
+    static inline void inverseAan8(float* d, int stride) {
+        // Чётная часть
+        float tmp0 = d[0 * stride];
+        float tmp1 = d[2 * stride];
+        float tmp2 = d[4 * stride];
+        float tmp3 = d[6 * stride];
+        
+        float tmp10 = tmp0 + tmp2;
+        float tmp11 = tmp0 - tmp2;
+        float tmp13 = tmp1 + tmp3;
+        float tmp12 = (tmp1 - tmp3) * 1.414213562f - tmp13;
+        
+        tmp0 = tmp10 + tmp13;
+        tmp3 = tmp10 - tmp13;
+        tmp1 = tmp11 + tmp12;
+        tmp2 = tmp11 - tmp12;
+        
+        // Нечётная часть
+        float tmp4 = d[1 * stride];
+        float tmp5 = d[3 * stride];
+        float tmp6 = d[5 * stride];
+        float tmp7 = d[7 * stride];
+        
+        float z13 = tmp6 + tmp5;
+        float z10 = tmp6 - tmp5;
+        float z11 = tmp4 + tmp7;
+        float z12 = tmp4 - tmp7;
+        
+        tmp7 = z11 + z13;
+        tmp11 = (z11 - z13) * 1.414213562f;
+        
+        float z5 = (z10 + z12) * 1.847759065f;
+        tmp10 = 1.082392200f * z12 - z5;
+        tmp12 = -2.613125930f * z10 + z5;
+        
+        tmp6 = tmp12 - tmp7;
+        tmp5 = tmp11 - tmp6;
+        tmp4 = tmp10 + tmp5;
+        
+        d[0 * stride] = tmp0 + tmp7;
+        d[7 * stride] = tmp0 - tmp7;
+        d[1 * stride] = tmp1 + tmp6;
+        d[6 * stride] = tmp1 - tmp6;
+        d[2 * stride] = tmp2 + tmp5;
+        d[5 * stride] = tmp2 - tmp5;
+        d[4 * stride] = tmp3 + tmp4;
+        d[3 * stride] = tmp3 - tmp4;
+    }
+    
+    void fastInverseDct(const int16_t in[64], const float inputScale[64], unsigned char* out, int outStride) {
+        float work[64];
+        
+        #pragma omp simd
+        for (int i = 0; i < 64; i++) {
+            work[i] = in[i] * inputScale[i];
+        }
+        
+        // Столбцы: после квантования большинство столбцов содержит только первый коэффициент
+        for (int col = 0; col < 8; col++) {
+            float* column = work + col;
+            bool acZero = true;
+            for (int row = 1; row < 8; row++) {
+                acZero = acZero && in[row * 8 + col] == 0;
+            }
+            if (acZero) {
+                for (int row = 1; row < 8; row++) {
+                    column[row * 8] = column[0];
+                }
+            } else {
+                inverseAan8(column, 8);
+            }
+        }
+        
+        for (int row = 0; row < 8; row++) {
+            float* line = work + row * 8;
+            inverseAan8(line, 1);
+            
+            unsigned char* dst = out + static_cast<ptrdiff_t>(row) * outStride;
+            for (int col = 0; col < 8; col++) {
+                float value = line[col] + 128.5f;
+                value = value < 0.0f ? 0.0f : (value > 255.0f ? 255.0f : value);
+                dst[col] = static_cast<unsigned char>(value);
+            }
+        }
+    }
 }
@@ -0,0 +1,139 @@
+#include "encoder_session.h"
+#include "fast_dct_transform.h"
+#include "jfif_writer.h"
+
+using namespace std;
+
+EncoderSession::EncoderSession(const EncoderSessionOptions& sessionOptions, ThreadPool& pool)
+    : options(sessionOptions),
+      pool(pool),
+      maxTasks(sessionOptions.numThreads > 0 ? sessionOptions.numThreads : pool.getThreadCount() + 1),
+      quantizer(sessionOptions.quality) {
+    // Проверка интервала перезапуска - в конструкторе SequentialHuffmanEncoder
+    intraWorker = createWorker(maxTasks);
+    for (int i = 0; i < maxTasks; i++) {
+        idleWorkers.push_back(createWorker(1));
+    }
+}
+
+unique_ptr<EncoderSession::Worker> EncoderSession::createWorker(int numThreads) const {
+    // Копии квантователя разделяют одни таблицы из кэша QuantTable
+    auto worker = make_unique<Worker>();
+    worker->processor = make_unique<FusedMcuProcessor>(make_unique<FastDctTransform>(),
+                                                       make_unique<SequentialQuantizer>(quantizer),
+                                                       numThreads, pool);
+    worker->huffman = make_unique<SequentialHuffmanEncoder>(options.restartInterval, &worker->arena,
+                                                            options.huffmanTables);
+    worker->parallelRows = numThreads > 1;
+    return worker;
+}
+
+unique_ptr<EncoderSession::Worker> EncoderSession::acquireWorker() {
+    lock_guard<mutex> lock(idleMutex);
+    if (idleWorkers.empty()) {
+        // Сессию вызывают из нескольких потоков сразу: лишний контекст потом останется в списке
+        return createWorker(1);
+    }
+    auto worker = move(idleWorkers.back());
+    idleWorkers.pop_back();
+    return worker;
+}
+
+void EncoderSession::releaseWorker(unique_ptr<Worker> worker) {
+    lock_guard<mutex> lock(idleMutex);
+    idleWorkers.push_back(move(worker));
+}
+
+void EncoderSession::encodeWith(Worker& worker, const RgbImage& image, IOutputSink& sink) {
+    if (options.huffmanTables == JpegFormat::HuffmanTables::Standard && !worker.parallelRows) {
+        encodeStandardWith(worker, image, sink);
+        return;
+    }
+    worker.arena.reset();
+    // Гистограммы символов собираются вместе с квантованием, кодер Хаффмана проходит скан один раз
+    worker.processor->processImage(image, options.subsampling, worker.blocks, options.restartInterval,
+                                   worker.histogram);
+    worker.huffman->encode(worker.blocks, image.getWidth(), image.getHeight(),
+                           quantizer.getQuantTable(), options.subsampling, worker.histogram, worker.encoded);
+    JfifWriter::write(worker.encoded, sink);
+}
+
+void EncoderSession::encodeStandardWith(Worker& worker, const RgbImage& image, IOutputSink& sink) {
+    // Заголовки известны до первого MCU: таблицы стандартные, квантование задано сессией
+    JpegEncodedData& header = worker.encoded;
+    header.width = image.getWidth();
+    header.height = image.getHeight();
+    header.quantTables = quantizer.getQuantTable();
+    header.restartInterval = options.restartInterval;
+    header.subsampling = options.subsampling;
+    JpegFormat::setStandardTables(header);
+
+    JfifWriter jfif(sink);
+    jfif.writeHeaders(header);
+    worker.writer.clearFlushed();
+    worker.processor->encodeStandard(image, options.subsampling, options.restartInterval, worker.writer, &sink);
+    worker.writer.padToByte();
+    jfif.writeScanData(worker.writer.data(), worker.writer.size());
+    worker.writer.clearFlushed();
+    jfif.writeEnd();
+}
+
+void EncoderSession::encode(const RgbImage& image, IOutputSink& sink) {
+    size_t pixels = static_cast<size_t>(image.getWidth()) * image.getHeight();
+    if (pixels >= options.intraImagePixels && maxTasks > 1) {
+        // Контекст внутреннего параллелизма один: одновременные крупные вызовы идут по очереди
+        lock_guard<mutex> lock(intraMutex);
+        encodeWith(*intraWorker, image, sink);
+        return;
+    }
+
+    auto worker = acquireWorker();
+    encodeWith(*worker, image, sink);
+    releaseWorker(move(worker));
+}
+
+void EncoderSession::encodeBatch(const vector<const RgbImage*>& images,
+                                 const function<IOutputSink&(size_t)>& sinkFor) {
+    vector<size_t> small;
+    vector<size_t> large;
+    for (size_t i = 0; i < images.size(); i++) {
+        size_t pixels = static_cast<size_t>(images[i]->getWidth()) * images[i]->getHeight();
+        (pixels >= options.intraImagePixels ? large : small).push_back(i);
+    }
+
+    // Мелкие: изображение на задачу, по одному за раз - размеры в пакете бывают разными
+    pool.parallelFor(0, small.size(), 1, [&](size_t first, size_t last) {
+        auto worker = acquireWorker();
+        try {
+            for (size_t i = first; i < last; i++) {
+                size_t index = small[i];
+                encodeWith(*worker, *images[index], sinkFor(index));
+            }
+        } catch (...) {
+            releaseWorker(move(worker));
+            throw;
+        }
+        releaseWorker(move(worker));
+    }, maxTasks);
+
+    // Крупные: каждое само занимает все задачи
+    for (size_t index : large) {
+        encode(*images[index], sinkFor(index));
+    }
+}
+
+vector<vector<unsigned char>> EncoderSession::encodeBatch(const vector<const RgbImage*>& images) {
+    vector<MemorySink> sinks(images.size());
+    encodeBatch(images, [&](size_t index) -> IOutputSink& { return sinks[index]; });
+
+    vector<vector<unsigned char>> files;
+    files.reserve(sinks.size());
+    for (auto& sink : sinks) {
+        files.push_back(sink.takeData());
+    }
+    return files;
+}
+
+vector<vector<unsigned char>> EncoderSession::encodeBatch(const vector<RgbImage>& images) {
+    return encodeBatch(images.begin(), images.end());
+}
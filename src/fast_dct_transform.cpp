@@ -0,0 +1,8 @@
+#include "fast_dct_transform.h"
+#include "dct_math.h"
+
+using namespace std;
+
+void FastDctTransform::forwardDct(const FloatBlock& block, FloatBlock& out) {
+    DctMath::fastForwardDct(block.data, out.data);
+}
@@ -0,0 +1,282 @@
+#include "fused_mcu_processor.h"
+#include "color_math.h"
+#include "entropy_coder.h"
+#include "jfif_writer.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+using namespace std;
+
+FusedMcuProcessor::FusedMcuProcessor(unique_ptr<IDctTransform> dctTransform,
+                                     unique_ptr<IQuantizer> quantizer,
+                                     int numThreads,
+                                     ThreadPool& pool)
+    : dct(move(dctTransform)), quantizer(move(quantizer)), numThreads(max(1, numThreads)), pool(pool) {
+    this->quantizer->setInputScaling(dct->outputScaling());
+}
+
+vector<QuantizedBlock> FusedMcuProcessor::processImage(const RgbImage& image, ChromaSubsampling subsampling) {
+    vector<QuantizedBlock> result;
+    processImage(image, subsampling, result);
+    return result;
+}
+
+// Место каждого блока известно заранее: задачи пишут в свои ячейки без синхронизации
+static void prepareResult(int width, int height, const JpegFormat::McuLayout& layout,
+                          vector<QuantizedBlock>& result) {
+    size_t yBlocks = static_cast<size_t>((width + 7) / 8) * ((height + 7) / 8);
+    result.assign(yBlocks + 2 * static_cast<size_t>(layout.mcusX) * layout.mcusY, QuantizedBlock(CoeffBlock{}));
+}
+
+void FusedMcuProcessor::processImage(const RgbImage& image, ChromaSubsampling subsampling,
+                                     vector<QuantizedBlock>& result) {
+    auto layout = JpegFormat::mcuLayout(image.getWidth(), image.getHeight(), subsampling);
+    prepareResult(image.getWidth(), image.getHeight(), layout, result);
+
+    // Одна задача - прямо в вызывающем потоке: без обёртки std::function и без обращений к куче
+    if (numThreads == 1) {
+        processRows(image, layout, 0, layout.mcusY, result, 0, nullptr);
+    } else {
+        pool.parallelFor(0, layout.mcusY, 1, [&](size_t first, size_t last) {
+            processRows(image, layout, first, last, result, 0, nullptr);
+        }, numThreads);
+    }
+}
+
+void FusedMcuProcessor::processImage(const RgbImage& image, ChromaSubsampling subsampling,
+                                     vector<QuantizedBlock>& result, int restartInterval,
+                                     JpegFormat::SymbolHistogram& histogram) {
+    int width = image.getWidth();
+    int height = image.getHeight();
+    auto layout = JpegFormat::mcuLayout(width, height, subsampling);
+    prepareResult(width, height, layout, result);
+
+    histogram.clear();
+    if (numThreads == 1) {
+        processRows(image, layout, 0, layout.mcusY, result, restartInterval, &histogram);
+    } else {
+        // Задача берёт строки MCU из общего счётчика и копит символы в своей гистограмме
+        mutex mergeMutex;
+        atomic<int> nextRow{0};
+        pool.parallelFor(0, numThreads, 1, [&](size_t, size_t) {
+            JpegFormat::SymbolHistogram local;
+            for (int row = nextRow++; row < layout.mcusY; row = nextRow++) {
+                processRows(image, layout, row, row + 1, result, restartInterval, &local);
+            }
+            lock_guard<mutex> guard(mergeMutex);
+            histogram.add(local);
+        }, numThreads);
+    }
+
+    // DC первых блоков строк: предсказание - последние блоки компонент предыдущей строки MCU
+    // (в начале интервала перезапуска - ноль, такие блоки уже посчитаны)
+    int yBlocksX = (width + 7) / 8;
+    size_t chromaBase = static_cast<size_t>(yBlocksX) * ((height + 7) / 8);
+    size_t chromaCount = static_cast<size_t>(layout.mcusX) * layout.mcusY;
+    auto countDc = [&](int table, size_t current) {
+        int diff = result[current].getCoefficients()[0] - result[current - 1].getCoefficients()[0];
+        histogram.dc[table][JpegFormat::magnitudeCategory(diff)]++;
+    };
+    for (int row = 1; row < layout.mcusY; row++) {
+        if (restartInterval > 0 && static_cast<size_t>(row) * layout.mcusX % restartInterval == 0) {
+            continue;
+        }
+        countDc(0, static_cast<size_t>(row) * layout.lumaV * yBlocksX);
+        for (int component = 1; component <= 2; component++) {
+            countDc(1, chromaBase + (component - 1) * chromaCount + static_cast<size_t>(row) * layout.mcusX);
+        }
+    }
+}
+
+void FusedMcuProcessor::processRows(const RgbImage& image, const JpegFormat::McuLayout& layout,
+                                    size_t firstRow, size_t lastRow, vector<QuantizedBlock>& result,
+                                    int restartInterval, JpegFormat::SymbolHistogram* histogram) const {
+    int lastDc[3] = {0, 0, 0};
+    for (size_t my = firstRow; my < lastRow; my++) {
+        if (my > 0) {
+            fill(begin(lastDc), end(lastDc), kUnknownDc);
+        }
+        for (int mx = 0; mx < layout.mcusX; mx++) {
+            size_t mcuIndex = my * layout.mcusX + mx;
+            if (restartInterval > 0 && mcuIndex % restartInterval == 0) {
+                fill(begin(lastDc), end(lastDc), 0);
+            }
+            processMcu(image, layout, mx, static_cast<int>(my), result, histogram, lastDc);
+        }
+    }
+}
+
+void FusedMcuProcessor::quantizeMcu(const RgbImage& image, const JpegFormat::McuLayout& layout, int mcuX, int mcuY,
+                                    CoeffBlock (&blocks)[kMaxBlocksPerMcu],
+                                    int (&lastNonZero)[kMaxBlocksPerMcu]) const {
+    int width = image.getWidth();
+    int height = image.getHeight();
+    int yBlocksX = (width + 7) / 8;
+    int yBlocksY = (height + 7) / 8;
+    int mcuWidth = layout.mcuWidth();
+    int mcuHeight = layout.mcuHeight();
+
+    int x0 = mcuX * mcuWidth;
+    int y0 = mcuY * mcuHeight;
+    int validWidth = min(mcuWidth, width - x0);
+    int validHeight = min(mcuHeight, height - y0);
+
+    // Плитка YCbCr; за краем изображения повторяются последний столбец и последняя строка,
+    // как в extractBlock остальных процессоров
+    alignas(64) unsigned char tile[3][16][16];
+    for (int row = 0; row < validHeight; row++) {
+        ColorMath::rgbRowToYCbCr(image.row(y0 + row) + x0 * 3, tile[0][row], tile[1][row], tile[2][row],
+                                 validWidth);
+        for (int c = 0; c < 3; c++) {
+            memset(tile[c][row] + validWidth, tile[c][row][validWidth - 1], mcuWidth - validWidth);
+        }
+    }
+    for (int row = validHeight; row < mcuHeight; row++) {
+        for (int c = 0; c < 3; c++) {
+            memcpy(tile[c][row], tile[c][validHeight - 1], mcuWidth);
+        }
+    }
+
+    FloatBlock samples;
+    FloatBlock coeffs;
+
+    auto transform = [&](const unsigned char (*plane)[16], int top, int left, int component, int index) {
+        for (int i = 0; i < 8; i++) {
+            for (int j = 0; j < 8; j++) {
+                samples.at(i, j) = plane[top + i][left + j] - 128;
+            }
+        }
+        dct->forwardDct(samples, coeffs);
+        lastNonZero[index] = quantizer->quantize(coeffs, component, blocks[index]);
+    };
+
+    // Y построчно внутри MCU. Вместо блока за краем изображения в скан идёт ближайший существующий
+    // (как в JpegFormat::interleaveBlocks) - он в этом же MCU и уже посчитан
+    for (int v = 0; v < layout.lumaV; v++) {
+        for (int h = 0; h < layout.lumaH; h++) {
+            int bx = mcuX * layout.lumaH + h;
+            int by = mcuY * layout.lumaV + v;
+            if (bx < yBlocksX && by < yBlocksY) {
+                transform(tile[0], v * 8, h * 8, 0, v * layout.lumaH + h);
+            } else {
+                int nearestH = min(bx, yBlocksX - 1) - mcuX * layout.lumaH;
+                int nearestV = min(by, yBlocksY - 1) - mcuY * layout.lumaV;
+                blocks[v * layout.lumaH + h] = blocks[nearestV * layout.lumaH + nearestH];
+                lastNonZero[v * layout.lumaH + h] = lastNonZero[nearestV * layout.lumaH + nearestH];
+            }
+        }
+    }
+
+    // Cb, Cr: по одному блоку прореженной цветности на MCU. Плитка уже дополнена повтором пикселей,
+    // поэтому внутри изображения прореживание совпадает с downsampleChroma; за его краем, как и при
+    // извлечении блока из плоскости цветности, повторяется последний прореженный сэмпл
+    int lumaBlocks = layout.lumaH * layout.lumaV;
+    int chromaValidWidth = (validWidth + layout.lumaH - 1) / layout.lumaH;
+    int chromaValidHeight = (validHeight + layout.lumaV - 1) / layout.lumaV;
+
+    alignas(64) unsigned char chroma[8][16];
+    for (int component = 1; component <= 2; component++) {
+        int index = lumaBlocks + component - 1;
+        if (layout.lumaH == 1) {
+            transform(tile[component], 0, 0, component, index);
+            continue;
+        }
+        for (int row = 0; row < chromaValidHeight; row++) {
+            const unsigned char* row0 = tile[component][row * layout.lumaV];
+            const unsigned char* row1 = tile[component][row * layout.lumaV + layout.lumaV - 1];
+            ColorMath::downsampleRow(row0, row1, chroma[row], 16);
+            memset(chroma[row] + chromaValidWidth, chroma[row][chromaValidWidth - 1], 8 - chromaValidWidth);
+        }
+        for (int row = chromaValidHeight; row < 8; row++) {
+            memcpy(chroma[row], chroma[chromaValidHeight - 1], 8);
+        }
+        transform(chroma, 0, 0, component, index);
+    }
+}
+
+void FusedMcuProcessor::processMcu(const RgbImage& image, const JpegFormat::McuLayout& layout, int mcuX, int mcuY,
+                                   vector<QuantizedBlock>& result,
+                                   JpegFormat::SymbolHistogram* histogram, int* lastDc) const {
+    CoeffBlock blocks[kMaxBlocksPerMcu];
+    int lastNonZero[kMaxBlocksPerMcu];
+    quantizeMcu(image, layout, mcuX, mcuY, blocks, lastNonZero);
+
+    // Символы блока в порядке скана, пока его коэффициенты ещё в кэше
+    auto count = [&](const CoeffBlock& coefficients, int component, int last) {
+        if (!histogram) {
+            return;
+        }
+        int table = component == 0 ? 0 : 1;
+        if (lastDc[component] != kUnknownDc) {
+            histogram->dc[table][JpegFormat::magnitudeCategory(coefficients[0] - lastDc[component])]++;
+        }
+        lastDc[component] = coefficients[0];
+        JpegFormat::countAcSymbols(coefficients, histogram->ac[table], last);
+    };
+
+    // Y: в результат только блоки внутри изображения, заполнение MCU на краях делает JpegFormat::interleaveBlocks
+    int yBlocksX = (image.getWidth() + 7) / 8;
+    int yBlocksY = (image.getHeight() + 7) / 8;
+    for (int v = 0; v < layout.lumaV; v++) {
+        for (int h = 0; h < layout.lumaH; h++) {
+            const CoeffBlock& block = blocks[v * layout.lumaH + h];
+            int bx = mcuX * layout.lumaH + h;
+            int by = mcuY * layout.lumaV + v;
+            if (bx < yBlocksX && by < yBlocksY) {
+                result[static_cast<size_t>(by) * yBlocksX + bx] =
+                    QuantizedBlock(block, bx, by, 0, lastNonZero[v * layout.lumaH + h]);
+            }
+            count(block, 0, lastNonZero[v * layout.lumaH + h]);
+        }
+    }
+
+    size_t chromaBase = static_cast<size_t>(yBlocksX) * yBlocksY;
+    size_t chromaCount = static_cast<size_t>(layout.mcusX) * layout.mcusY;
+    size_t mcuIndex = static_cast<size_t>(mcuY) * layout.mcusX + mcuX;
+    int lumaBlocks = layout.lumaH * layout.lumaV;
+    for (int component = 1; component <= 2; component++) {
+        const CoeffBlock& block = blocks[lumaBlocks + component - 1];
+        result[chromaBase + (component - 1) * chromaCount + mcuIndex] =
+            QuantizedBlock(block, mcuX, mcuY, component, lastNonZero[lumaBlocks + component - 1]);
+        count(block, component, lastNonZero[lumaBlocks + component - 1]);
+    }
+}
+
+void FusedMcuProcessor::encodeStandard(const RgbImage& image, ChromaSubsampling subsampling, int restartInterval,
+                                       BitWriter& writer, IOutputSink* sink) const {
+    auto layout = JpegFormat::mcuLayout(image.getWidth(), image.getHeight(), subsampling);
+    int lumaBlocks = layout.lumaH * layout.lumaV;
+    CoeffBlock blocks[kMaxBlocksPerMcu];
+    int lastNonZero[kMaxBlocksPerMcu];
+    int lastDc[3] = {0, 0, 0};
+    size_t mcuIndex = 0;
+
+    for (int my = 0; my < layout.mcusY; my++) {
+        for (int mx = 0; mx < layout.mcusX; mx++, mcuIndex++) {
+            if (restartInterval > 0 && mcuIndex > 0 && mcuIndex % restartInterval == 0) {
+                writer.writeRestartMarker(static_cast<int>(mcuIndex / restartInterval - 1));
+                fill(begin(lastDc), end(lastDc), 0);
+            }
+
+            quantizeMcu(image, layout, mx, my, blocks, lastNonZero);
+            for (int i = 0; i < lumaBlocks; i++) {
+                EntropyCoder::encodeBlock(writer, blocks[i], lastDc[0], JpegFormat::kStandardDcLuminanceCodes,
+                                          JpegFormat::kStandardAcLuminanceCodes, lastNonZero[i]);
+            }
+            for (int component = 1; component <= 2; component++) {
+                int index = lumaBlocks + component - 1;
+                EntropyCoder::encodeBlock(writer, blocks[index], lastDc[component],
+                                          JpegFormat::kStandardDcChrominanceCodes,
+                                          JpegFormat::kStandardAcChrominanceCodes, lastNonZero[index]);
+            }
+        }
+
+        // Готовые байты строки MCU сразу уходят в sink, в регистре остаются только неполные биты
+        if (sink) {
+            JfifWriter(*sink).writeScanData(writer.data(), writer.size());
+            writer.clearFlushed();
+        }
+    }
+}
@@ -1,83 +1,137 @@
 #include "huffman_math.h"
-#include <queue>
-#include <vector>
+#include <algorithm>
 #include <stdexcept>
-#include <functional>
 
 using namespace std;
 
-HuffmanNode::HuffmanNode() : symbol(-1), frequency(0), left(nullptr), right(nullptr) {}
-
-HuffmanNode::HuffmanNode(int sym, int freq) : symbol(sym), frequency(freq), left(nullptr), right(nullptr) {}
-
-HuffmanNode::~HuffmanNode() {
-    delete left;
-    delete right;
-}
-
 namespace HuffmanMath {
     
-    struct CompareNodes {
-        bool operator()(const HuffmanNode* a, const HuffmanNode* b) {
-            return a->frequency > b->frequency;
-        }
-    };
+    HuffmanSpec buildSpec(const HuffmanFrequencies& frequencies) {
+        HuffmanSpec spec;
+        buildSpec(frequencies, spec);
+        return spec;
+    }
     
-    HuffmanNode* buildTree(const unordered_map<int, int>& frequencies) {
-        if (frequencies.empty()) {
+    void buildSpec(const HuffmanFrequencies& frequencies, HuffmanSpec& spec) {
+        // Символ 256 с частотой 1 резервирует код из одних единиц (K.2)
+        constexpr int kSymbols = 257;
+        uint64_t freq[kSymbols];
+        int codeSize[kSymbols] = {};
+        int others[kSymbols];
+        
+        bool hasSymbols = false;
+        for (int i = 0; i < 256; i++) {
+            freq[i] = frequencies[i];
+            hasSymbols = hasSymbols || freq[i] > 0;
+        }
+        if (!hasSymbols) {
             throw invalid_argument("No frequencies provided");
         }
+        freq[256] = 1;
+        fill(begin(others), end(others), -1);
         
-        priority_queue<HuffmanNode*, vector<HuffmanNode*>, CompareNodes> priorityQueue;
+        // Figure K.1: на каждом шаге сливаем два наименее частых дерева.
+        // Символов не больше 257, поэтому линейный поиск дешевле кучи
+        while (true) {
+            int v1 = -1;
+            int v2 = -1;
+            for (int i = 0; i < kSymbols; i++) {
+                if (freq[i] == 0) continue;
+                if (v1 < 0 || freq[i] <= freq[v1]) {
+                    v2 = v1;
+                    v1 = i;
+                } else if (v2 < 0 || freq[i] <= freq[v2]) {
+                    v2 = i;
+                }
+            }
+            if (v2 < 0) {
+                break;
+            }
+            
+            freq[v1] += freq[v2];
+            freq[v2] = 0;
+            
+            codeSize[v1]++;
+            while (others[v1] >= 0) {
+                v1 = others[v1];
+                codeSize[v1]++;
+            }
+            others[v1] = v2;
+            
+            codeSize[v2]++;
+            while (others[v2] >= 0) {
+                v2 = others[v2];
+                codeSize[v2]++;
+            }
+        }
         
-        for (const auto& kvp : frequencies) {
-            auto node = new HuffmanNode(kvp.first, kvp.second);
-            priorityQueue.push(node);
+        // Figure K.2: число кодов каждой длины (глубина дерева не превосходит числа символов)
+        int bits[kSymbols + 1] = {};
+        int maxLength = 0;
+        for (int i = 0; i < kSymbols; i++) {
+            if (codeSize[i] > 0) {
+                bits[codeSize[i]]++;
+                maxLength = max(maxLength, codeSize[i]);
+            }
         }
         
-        // Если только один символ - создаем фиктивный корень
-        if (priorityQueue.size() == 1) {
-            auto single = priorityQueue.top();
-            priorityQueue.pop();
-            auto root = new HuffmanNode(-1, single->frequency);
-            root->left = single;
-            return root;
+        // Figure K.3: укорачиваем коды длиннее 16 бит, сохраняя полноту префиксного кода
+        for (int i = maxLength; i > kMaxCodeLength; i--) {
+            while (bits[i] > 0) {
+                int j = i - 2;
+                while (bits[j] == 0) {
+                    j--;
+                }
+                bits[i] -= 2;
+                bits[i - 1]++;
+                bits[j + 1] += 2;
+                bits[j]--;
+            }
         }
         
-        while (priorityQueue.size() > 1) {
-            auto left = priorityQueue.top();
-            priorityQueue.pop();
-            auto right = priorityQueue.top();
-            priorityQueue.pop();
-            
-            auto parent = new HuffmanNode(-1, left->frequency + right->frequency);
-            parent->left = left;
-            parent->right = right;
-            
-            priorityQueue.push(parent);
+        // Убираем зарезервированный код: он самый длинный
+        int longest = kMaxCodeLength;
+        while (bits[longest] == 0) {
+            longest--;
         }
+        bits[longest]--;
         
-        auto root = priorityQueue.top();
-        priorityQueue.pop();
-        return root;
-    }
-    
-    unordered_map<int, pair<int, int>> buildCodeTable(HuffmanNode* root) {
-        unordered_map<int, pair<int, int>> table;
-        buildCodeTableRecursive(root, 0, 0, table);
-        return table;
+        for (int i = 1; i <= kMaxCodeLength; i++) {
+            spec.counts[i - 1] = static_cast<uint8_t>(bits[i]);
+        }
+        
+        // Figure K.4: символы по возрастанию длины кода, внутри длины - по значению
+        spec.symbols.clear();
+        for (int length = 1; length <= maxLength; length++) {
+            for (int symbol = 0; symbol < 256; symbol++) {
+                if (codeSize[symbol] == length) {
+                    spec.symbols.push_back(static_cast<uint8_t>(symbol));
+                }
+            }
+        }
     }
     
-    void buildCodeTableRecursive(HuffmanNode* node, int code, int depth,
-                                unordered_map<int, pair<int, int>>& table) {
-        if (node == nullptr) return;
+    HuffmanCodeTable buildCodeTable(const HuffmanSpec& spec) {
+        HuffmanCodeTable table;
         
-        if (node->isLeaf()) {
-            table[node->symbol] = make_pair(code, depth);
-            return;
+        // Annex C.2: коды одной длины идут подряд, при переходе к следующей длине - сдвиг влево
+        int code = 0;
+        size_t index = 0;
+        for (int length = 1; length <= kMaxCodeLength; length++) {
+            for (int i = 0; i < spec.counts[length - 1]; i++) {
+                if (index >= spec.symbols.size()) {
+                    throw invalid_argument("Huffman spec has fewer symbols than counts");
+                }
+                uint8_t symbol = spec.symbols[index++];
+                table.code[symbol] = static_cast<uint16_t>(code++);
+                table.length[symbol] = static_cast<uint8_t>(length);
+            }
+            if (code > (1 << length)) {
+                throw invalid_argument("Huffman spec is not a valid prefix code");
+            }
+            code <<= 1;
         }
         
-        buildCodeTableRecursive(node->left, code << 1, depth + 1, table);
-        buildCodeTableRecursive(node->right, (code << 1) | 1, depth + 1, table);
+        return table;
     }
 }
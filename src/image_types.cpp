@@ -1,66 +1,153 @@
 #include "image_types.h"
+#include "color_math.h"
+#include "pnm_io.h"
 #include <stdexcept>
 #include <algorithm>
+#include <cstring>
 
 using namespace std;
 
+// ImagePlane
+ImagePlane::ImagePlane(int width, int height, unsigned char fill)
+    : width(width), height(height), stride(alignedStride(width)) {
+    if (width <= 0 || height <= 0) {
+        throw invalid_argument("Dimensions must be positive");
+    }
+    data.assign(static_cast<size_t>(stride) * height, fill);
+}
+
+void ImagePlane::fill(unsigned char value) {
+    std::fill(data.begin(), data.end(), value);
+}
+
 // Ð ÐµÐ°Ð»Ð¸Ð·Ð°Ñ†Ð¸Ñ RgbImage
-RgbImage::RgbImage(int width, int height) : width(width), height(height) {
+RgbImage::RgbImage(int width, int height)
+    : width(width), height(height), stride(alignedStride(width * 3)) {
     if (width <= 0 || height <= 0) {
         throw invalid_argument("Dimensions must be positive");
     }
-    data.resize(width * height * 3, 0);
+    data.assign(static_cast<size_t>(stride) * height, 0);
+    pixels = data.data();
+}
+
+RgbImage::RgbImage(const RgbImage& other)
+    : data(other.data), storage(other.storage), width(other.width), height(other.height), stride(other.stride) {
+    pixels = other.isView() ? other.pixels : data.data();
+}
+
+RgbImage& RgbImage::operator=(const RgbImage& other) {
+    if (this != &other) {
+        data = other.data;
+        storage = other.storage;
+        width = other.width;
+        height = other.height;
+        stride = other.stride;
+        pixels = other.isView() ? other.pixels : data.data();
+    }
+    return *this;
+}
+
+RgbImage::RgbImage(unsigned char* pixels, int width, int height, int stride, shared_ptr<void> storage)
+    : pixels(pixels), storage(move(storage)), width(width), height(height), stride(stride) {}
+
+RgbImage RgbImage::view(unsigned char* pixels, int width, int height, int stride, shared_ptr<void> storage) {
+    if (width <= 0 || height <= 0) {
+        throw invalid_argument("Dimensions must be positive");
+    }
+    if (pixels == nullptr || stride < width * 3) {
+        throw invalid_argument("View stride is smaller than a row");
+    }
+    return RgbImage(pixels, width, height, stride, move(storage));
+}
+
+RgbImage RgbImage::loadFromFile(const string& path) {
+    return PnmIo::load(path);
 }
 
 RgbImage::RgbImage(int width, int height, const vector<unsigned char>& rgbData) 
-    : width(width), height(height), data(rgbData) {
-    if (rgbData.size() != width * height * 3) {
+    : RgbImage(width, height) {
+    if (rgbData.size() != static_cast<size_t>(width) * height * 3) {
         throw invalid_argument("Data size mismatch");
     }
+    for (int y = 0; y < height; y++) {
+        memcpy(row(y), rgbData.data() + static_cast<size_t>(y) * width * 3, static_cast<size_t>(width) * 3);
+    }
 }
 
 tuple<unsigned char, unsigned char, unsigned char> RgbImage::getPixel(int x, int y) const {
-    int index = (y * width + x) * 3;
-    return make_tuple(data[index], data[index + 1], data[index + 2]);
+    const unsigned char* p = row(y) + x * 3;
+    return make_tuple(p[0], p[1], p[2]);
 }
 
 void RgbImage::setPixel(int x, int y, unsigned char r, unsigned char g, unsigned char b) {
-    int index = (y * width + x) * 3;
-    data[index] = r;
-    data[index + 1] = g;
-    data[index + 2] = b;
+    unsigned char* p = row(y) + x * 3;
+    p[0] = r;
+    p[1] = g;
+    p[2] = b;
 }
 
 RgbImage RgbImage::createTestImage(int width, int height) {
     RgbImage image(width, height);
     for (int y = 0; y < height; y++) {
+        unsigned char* dst = image.row(y);
         for (int x = 0; x < width; x++) {
             // Ð“Ñ€Ð°Ð´Ð¸ÐµÐ½Ñ‚ Ð¸Ð»Ð¸ ÑˆÐ°Ñ…Ð¼Ð°Ñ‚Ð½Ð°Ñ Ð´Ð¾ÑÐºÐ°
-            unsigned char r = static_cast<unsigned char>(x * 255 / width);
-            unsigned char g = static_cast<unsigned char>(y * 255 / height);
-            unsigned char b = static_cast<unsigned char>((x + y) % 255);
-            image.setPixel(x, y, r, g, b);
+            dst[x * 3]     = static_cast<unsigned char>(x * 255 / width);
+            dst[x * 3 + 1] = static_cast<unsigned char>(y * 255 / height);
+            dst[x * 3 + 2] = static_cast<unsigned char>((x + y) % 255);
         }
     }
     return image;
 }
 
 // Ð ÐµÐ°Ð»Ð¸Ð·Ð°Ñ†Ð¸Ñ YCbCrImage
-YCbCrImage::YCbCrImage(int width, int height) : width(width), height(height) {
-    if (width <= 0 || height <= 0) {
-        throw invalid_argument("Dimensions must be positive");
-    }
-    Y.resize(height, vector<unsigned char>(width, 0));
-    Cb.resize(height, vector<unsigned char>(width, 0));
-    Cr.resize(height, vector<unsigned char>(width, 0));
-}
+YCbCrImage::YCbCrImage(int width, int height)
+    : Y(width, height), Cb(width, height), Cr(width, height), width(width), height(height) {}
 
 tuple<unsigned char, unsigned char, unsigned char> YCbCrImage::getPixel(int x, int y) const {
-    return make_tuple(Y[y][x], Cb[y][x], Cr[y][x]);
+    return make_tuple(Y.at(x, y), Cb.at(x, y), Cr.at(x, y));
 }
 
 void YCbCrImage::setPixel(int x, int y, unsigned char yVal, unsigned char cbVal, unsigned char crVal) {
-    Y[y][x] = yVal;
-    Cb[y][x] = cbVal;
-    Cr[y][x] = crVal;
+    Y.at(x, y) = yVal;
+    Cb.at(x, y) = cbVal;
+    Cr.at(x, y) = crVal;
+}
+
+const ImagePlane& YCbCrImage::plane(int component) const {
+    switch (component) {
+        case 0: return Y;
+        case 1: return Cb;
+        case 2: return Cr;
+        default: throw invalid_argument("Component must be 0-2");
+    }
+}
+
+ImagePlane& YCbCrImage::plane(int component) {
+    return const_cast<ImagePlane&>(static_cast<const YCbCrImage&>(*this).plane(component));
+}
+
+void YCbCrImage::downsampleChroma(ChromaSubsampling target) {
+    if (target == ChromaSubsampling::Yuv444) {
+        return;
+    }
+    if (subsampling != ChromaSubsampling::Yuv444) {
+        throw logic_error("Chroma is already downsampled");
+    }
+    
+    int factorY = subsamplingFactorY(target);
+    int chromaHeight = (height + factorY - 1) / factorY;
+    int chromaWidth = (width + 1) / 2;
+    
+    for (ImagePlane* source : {&Cb, &Cr}) {
+        ImagePlane downsampled(chromaWidth, chromaHeight);
+        for (int y = 0; y < chromaHeight; y++) {
+            // Для 4:2:2 обе строки одинаковы; нечётная последняя строка 4:2:0 повторяется
+            const unsigned char* row0 = source->row(y * factorY);
+            const unsigned char* row1 = source->row(min(y * factorY + factorY - 1, height - 1));
+            ColorMath::downsampleRow(row0, row1, downsampled.row(y), width);
+        }
+        *source = move(downsampled);
+    }
+    subsampling = target;
 }
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include "jfif_reader.h"
+#include "jpeg_format.h"
+#include "quant_table.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+namespace JfifReader {
+    
+    static int readWord(const unsigned char* p) {
+        return (p[0] << 8) | p[1];
+    }
+    
+    static HuffmanSpec readHuffmanSpec(const unsigned char*& p, const unsigned char* end) {
+        if (end - p < 16) {
+            throw runtime_error("Truncated DHT segment");
+        }
+        HuffmanSpec spec;
+        size_t total = 0;
+        for (int i = 0; i < 16; i++) {
+            spec.counts[i] = p[i];
+            total += p[i];
+        }
+        p += 16;
+        if (total == 0 || total > 256 || static_cast<size_t>(end - p) < total) {
+            throw runtime_error("Invalid DHT segment");
+        }
+        spec.symbols.assign(p, p + total);
+        p += total;
+        return spec;
+    }
+    
+    JpegEncodedData read(const unsigned char* data, size_t size) {
+        if (size < 4 || data[0] != 0xFF || data[1] != JpegFormat::SOI) {
+            throw runtime_error("Not a JPEG stream (missing SOI)");
+        }
+        
+        JpegEncodedData result;
+        result.width = 0;
+        result.height = 0;
+        
+        // Таблицы по номеру: класс 0 - DC, 1 - AC; id 0 - яркость, 1 - цветность
+        HuffmanSpec tables[2][2];
+        bool haveTable[2][2] = {};
+        bool haveFrame = false;
+        
+        // Таблицы квантования по Tq (zigzag, как в DQT) и Tq яркости/цветности из SOF0
+        uint8_t quantTables[4][64];
+        bool haveQuantTable[4] = {};
+        int lumaTq = 0;
+        int chromaTq = 0;
+        
+        size_t pos = 2;
+        while (pos + 4 <= size) {
+            if (data[pos] != 0xFF) {
+                throw runtime_error("Marker expected at offset " + to_string(pos));
+            }
+            int marker = data[pos + 1];
+            if (marker == 0xFF) {  // заполняющие байты между сегментами
+                pos++;
+                continue;
+            }
+            
+            int length = readWord(data + pos + 2);
+            if (length < 2 || pos + 2 + length > size) {
+                throw runtime_error("Truncated marker segment");
+            }
+            const unsigned char* segment = data + pos + 4;
+            const unsigned char* segmentEnd = data + pos + 2 + length;
+            
+            switch (marker) {
+                case JpegFormat::DQT: {
+                    const unsigned char* p = segment;
+                    while (p < segmentEnd) {
+                        int precision = *p >> 4;
+                        int id = *p & 0x0F;
+                        p++;
+                        if (precision != 0 || segmentEnd - p < 64) {
+                            throw runtime_error("Only 8-bit quantization tables are supported");
+                        }
+                        if (id > 3) {
+                            throw runtime_error("Invalid quantization table id");
+                        }
+                        copy(p, p + 64, quantTables[id]);
+                        haveQuantTable[id] = true;
+                        p += 64;
+                    }
+                    break;
+                }
+                case JpegFormat::SOF0: {
+                    if (length != 8 + 3 * 3 || segment[0] != 8 || segment[5] != 3) {
+                        throw runtime_error("Only 8-bit 3-component baseline frames are supported");
+                    }
+                    result.height = readWord(segment + 1);
+                    result.width = readWord(segment + 3);
+                    // Высота 0 - её задаёт сегмент DNL после скана, он не поддерживается
+                    if (result.width == 0 || result.height == 0) {
+                        throw runtime_error("Frame size must be positive (DNL is not supported)");
+                    }
+                    switch (segment[7]) {
+                        case 0x11: result.subsampling = ChromaSubsampling::Yuv444; break;
+                        case 0x21: result.subsampling = ChromaSubsampling::Yuv422; break;
+                        case 0x22: result.subsampling = ChromaSubsampling::Yuv420; break;
+                        default: throw runtime_error("Only 4:4:4, 4:2:2 and 4:2:0 sampling are supported");
+                    }
+                    for (int c = 1; c < 3; c++) {
+                        if (segment[7 + 3 * c] != 0x11) {
+                            throw runtime_error("Chroma must be 1x1");
+                        }
+                    }
+                    // Cb и Cr декодируются одной таблицей цветности (QuantTable::Chroma)
+                    lumaTq = segment[8];
+                    chromaTq = segment[11];
+                    if (lumaTq > 3 || chromaTq > 3) {
+                        throw runtime_error("Invalid quantization table id");
+                    }
+                    if (segment[14] != chromaTq) {
+                        throw runtime_error("Cb and Cr must share a quantization table");
+                    }
+                    haveFrame = true;
+                    break;
+                }
+                case JpegFormat::DHT: {
+                    const unsigned char* p = segment;
+                    while (p < segmentEnd) {
+                        int tableClass = *p >> 4;
+                        int id = *p & 0x0F;
+                        p++;
+                        if (tableClass > 1 || id > 1) {
+                            throw runtime_error("Unsupported Huffman table slot");
+                        }
+                        tables[tableClass][id] = readHuffmanSpec(p, segmentEnd);
+                        haveTable[tableClass][id] = true;
+                    }
+                    break;
+                }
+                case JpegFormat::DRI: {
+                    if (length != 4) {
+                        throw runtime_error("Invalid DRI segment");
+                    }
+                    result.restartInterval = readWord(segment);
+                    break;
+                }
+                case JpegFormat::SOS: {
+                    if (!haveFrame || !haveQuantTable[lumaTq] || !haveQuantTable[chromaTq]) {
+                        throw runtime_error("SOS before SOF0/DQT");
+                    }
+                    const unsigned char expected[] = {3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0};
+                    if (length != 2 + static_cast<int>(sizeof(expected)) ||
+                        !equal(begin(expected), end(expected), segment)) {
+                        throw runtime_error("Unsupported scan header");
+                    }
+                    for (int tableClass = 0; tableClass < 2; tableClass++) {
+                        for (int id = 0; id < 2; id++) {
+                            if (!haveTable[tableClass][id]) {
+                                throw runtime_error("Scan references a missing Huffman table");
+                            }
+                        }
+                    }
+                    result.dcLuminanceTable = tables[0][0];
+                    result.acLuminanceTable = tables[1][0];
+                    result.dcChrominanceTable = tables[0][1];
+                    result.acChrominanceTable = tables[1][1];
+                    try {
+                        result.quantTables = make_shared<const QuantTable>(quantTables[lumaTq], quantTables[chromaTq]);
+                    } catch (const invalid_argument&) {
+                        throw runtime_error("Quantization step out of baseline range");
+                    }
+                    
+                    // Энтропийные данные - до первого маркера, кроме 0xFF00 и RSTn
+                    size_t scanStart = pos + 2 + length;
+                    size_t scanEnd = scanStart;
+                    while (scanEnd + 1 < size) {
+                        if (data[scanEnd] == 0xFF) {
+                            int next = data[scanEnd + 1];
+                            if (next != 0x00 && (next & 0xF8) != JpegFormat::RST0) {
+                                break;
+                            }
+                            scanEnd += 2;
+                        } else {
+                            scanEnd++;
+                        }
+                    }
+                    if (scanEnd + 1 >= size || data[scanEnd + 1] != JpegFormat::EOI) {
+                        throw runtime_error("Scan is not followed by EOI");
+                    }
+                    result.compressedData.assign(data + scanStart, data + scanEnd);
+                    return result;
+                }
+                case 0xC1: case 0xC2: case 0xC3:
+                case 0xC5: case 0xC6: case 0xC7:
+                case 0xC9: case 0xCA: case 0xCB:
+                case 0xCD: case 0xCE: case 0xCF:
+                    // SOF1..SOF15 (0xC4 - DHT, 0xC8 - JPG, 0xCC - DAC): progressive, lossless и прочие кадры
+                    throw runtime_error("Only baseline SOF0 frames are supported");
+                default:
+                    // APP0, COM и прочие сегменты не влияют на декодирование
+                    break;
+            }
+            
+            pos += 2 + length;
+        }
+        
+        throw runtime_error("No scan found");
+    }
+    
+    JpegEncodedData read(const vector<unsigned char>& data) {
+        return read(data.data(), data.size());
+    }
+}
@@ -0,0 +1,138 @@
+#include "jfif_writer.h"
+#include "jpeg_format.h"
+#include "quant_table.h"
+#include <stdexcept>
+
+using namespace std;
+
+JfifWriter::JfifWriter(IOutputSink& output) : sink(output) {}
+
+void JfifWriter::writeMarker(uint8_t marker) {
+    sink.writeByte(0xFF);
+    sink.writeByte(marker);
+}
+
+void JfifWriter::writeWord(int value) {
+    sink.writeByte(static_cast<unsigned char>((value >> 8) & 0xFF));
+    sink.writeByte(static_cast<unsigned char>(value & 0xFF));
+}
+
+void JfifWriter::writeHuffmanTable(int tableClass, int tableId, const HuffmanSpec& spec) {
+    size_t total = 0;
+    for (int i = 0; i < 16; i++) {
+        total += spec.counts[i];
+    }
+    if (total != spec.symbols.size() || total == 0 || total > 256) {
+        throw invalid_argument("Invalid Huffman table specification");
+    }
+    
+    sink.writeByte(static_cast<unsigned char>((tableClass << 4) | tableId));
+    sink.write(spec.counts, 16);
+    sink.write(spec.symbols.data(), spec.symbols.size());
+}
+
+void JfifWriter::writeHeaders(const JpegEncodedData& data) {
+    if (data.width <= 0 || data.height <= 0 || data.width > 65535 || data.height > 65535) {
+        throw invalid_argument("Image dimensions out of JPEG range");
+    }
+    if (!data.quantTables) {
+        throw invalid_argument("Quantization tables are missing");
+    }
+    
+    writeMarker(JpegFormat::SOI);
+    
+    // APP0: JFIF 1.01, без миниатюры, плотность 1:1
+    writeMarker(JpegFormat::APP0);
+    writeWord(16);
+    const unsigned char jfif[] = {'J', 'F', 'I', 'F', 0, 1, 1, 0};
+    sink.write(jfif, sizeof(jfif));
+    writeWord(1);
+    writeWord(1);
+    sink.writeByte(0);
+    sink.writeByte(0);
+    
+    // DQT: 8-битные таблицы 0 (яркость) и 1 (цветность) в одном сегменте, уже в порядке zigzag
+    // (шаги 1..255 проверены при построении QuantTable)
+    writeMarker(JpegFormat::DQT);
+    writeWord(2 + 2 * (1 + 64));
+    for (int channel = QuantTable::Luma; channel <= QuantTable::Chroma; channel++) {
+        sink.writeByte(static_cast<unsigned char>(channel));
+        sink.write(data.quantTables->getZigzag(channel), 64);
+    }
+    
+    // SOF0: 3 компонента, факторы Y по прореживанию (2x2 - 4:2:0, 2x1 - 4:2:2, 1x1 - 4:4:4),
+    // Cb и Cr 1x1; Y квантован таблицей 0, Cb и Cr - таблицей 1
+    writeMarker(JpegFormat::SOF0);
+    writeWord(8 + 3 * 3);
+    sink.writeByte(8);
+    writeWord(data.height);
+    writeWord(data.width);
+    sink.writeByte(3);
+    const unsigned char lumaFactors = static_cast<unsigned char>(
+        (subsamplingFactorX(data.subsampling) << 4) | subsamplingFactorY(data.subsampling));
+    const unsigned char components[3][3] = {
+        {1, lumaFactors, 0},
+        {2, 0x11, 1},
+        {3, 0x11, 1}
+    };
+    for (const auto& component : components) {
+        sink.write(component, 3);
+    }
+    
+    // DHT: все четыре таблицы в одном сегменте
+    int dhtLength = 2;
+    for (const HuffmanSpec* spec : {&data.dcLuminanceTable, &data.acLuminanceTable,
+                                    &data.dcChrominanceTable, &data.acChrominanceTable}) {
+        dhtLength += 1 + 16 + static_cast<int>(spec->symbols.size());
+    }
+    writeMarker(JpegFormat::DHT);
+    writeWord(dhtLength);
+    writeHuffmanTable(0, 0, data.dcLuminanceTable);
+    writeHuffmanTable(1, 0, data.acLuminanceTable);
+    writeHuffmanTable(0, 1, data.dcChrominanceTable);
+    writeHuffmanTable(1, 1, data.acChrominanceTable);
+    
+    // DRI: маркеры RSTn в скане через restartInterval MCU
+    if (data.restartInterval > 0) {
+        if (data.restartInterval > 65535) {
+            throw invalid_argument("Restart interval out of range");
+        }
+        writeMarker(JpegFormat::DRI);
+        writeWord(4);
+        writeWord(data.restartInterval);
+    }
+    
+    // SOS: Y - таблицы 0/0, Cb и Cr - таблицы 1/1, полный спектр 0..63
+    writeMarker(JpegFormat::SOS);
+    writeWord(6 + 2 * 3);
+    sink.writeByte(3);
+    const unsigned char selectors[3][2] = {
+        {1, 0x00},
+        {2, 0x11},
+        {3, 0x11}
+    };
+    for (const auto& selector : selectors) {
+        sink.write(selector, 2);
+    }
+    sink.writeByte(0);
+    sink.writeByte(63);
+    sink.writeByte(0);
+}
+
+void JfifWriter::writeScanData(const unsigned char* data, size_t size) {
+    if (size > 0) {
+        sink.write(data, size);
+    }
+}
+
+void JfifWriter::writeEnd() {
+    writeMarker(JpegFormat::EOI);
+    sink.flush();
+}
+
+void JfifWriter::write(const JpegEncodedData& data, IOutputSink& output) {
+    JfifWriter writer(output);
+    writer.writeHeaders(data);
+    writer.writeScanData(data.compressedData.data(), data.compressedData.size());
+    writer.writeEnd();
+}
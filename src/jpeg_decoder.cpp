@@ -3,43 +3,50 @@
 #include "bit_reader.h"
 #include "dct_math.h"
 #include "color_math.h"
+#include "jpeg_format.h"
 #include <cmath>
 #include <algorithm>
 #include <iostream>
 
 using namespace std;
 
-// Zigzag индексы для обратного преобразования
-static const int zigzagOrder[64] = {
-    0,  1,  8, 16,  9,  2,  3, 10,
-    17, 24, 32, 25, 18, 11,  4,  5,
-    12, 19, 26, 33, 40, 48, 41, 34,
-    27, 20, 13,  6,  7, 14, 21, 28,
-    35, 42, 49, 56, 57, 50, 43, 36,
-    29, 22, 15, 23, 30, 37, 44, 51,
-    58, 59, 52, 45, 38, 31, 39, 46,
-    53, 60, 61, 54, 47, 55, 62, 63
-};
-
 // ========== SequentialDctInverseTransform ==========
 
-vector<vector<double>> SequentialDctInverseTransform::inverseDct(
-    const vector<vector<int>>& quantizedBlock) {
-    
-    vector<vector<double>> result(8, vector<double>(8));
-    
-    // Кеш косинусов
-    static vector<vector<double>> cosineCache;
-    static bool cacheInitialized = false;
-    
-    if (!cacheInitialized) {
-        cosineCache.resize(8, vector<double>(8));
-        for (int i = 0; i < 8; i++) {
-            for (int j = 0; j < 8; j++) {
-                cosineCache[i][j] = cos((2 * i + 1) * j * M_PI / 16.0);
+// Таблица косинусов строится при статической инициализации: без ленивого кеша и гонок
+static const vector<vector<double>> inverseCosines = [] {
+    vector<vector<double>> cache(8, vector<double>(8));
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 8; j++) {
+            cache[i][j] = cos((2 * i + 1) * j * M_PI / 16.0);
+        }
+    }
+    return cache;
+}();
+
+SequentialDctInverseTransform::SequentialDctInverseTransform() {
+    fill(&multipliers[0][0], &multipliers[0][0] + 2 * 64, 1.0);
+}
+
+void SequentialDctInverseTransform::setQuantTable(const QuantTable& tables) {
+    for (int channel = 0; channel < 2; channel++) {
+        const auto& table = tables.getTable(channel);
+        for (int u = 0; u < 8; u++) {
+            for (int v = 0; v < 8; v++) {
+                multipliers[channel][u * 8 + v] = table[u][v];
             }
         }
-        cacheInitialized = true;
+    }
+}
+
+void SequentialDctInverseTransform::inverseDct(const CoeffBlock& coefficients, int channel,
+                                               unsigned char* out, int stride) const {
+    // Деквантизация и множители alpha(u) * alpha(v) / 4
+    double scaled[64];
+    for (int u = 0; u < 8; u++) {
+        for (int v = 0; v < 8; v++) {
+            scaled[u * 8 + v] = coefficients.at(u, v) * multipliers[channel][u * 8 + v] *
+                                DctMath::alpha(u) * DctMath::alpha(v) / 4.0;
+        }
     }
     
     // Формула обратного DCT
@@ -49,44 +56,54 @@ vector<vector<double>> SequentialDctInverseTransform::inverseDct(
             
             for (int u = 0; u < 8; u++) {
                 for (int v = 0; v < 8; v++) {
-                    double alpha_u = (u == 0) ? 1.0 / sqrt(2.0) : 1.0;
-                    double alpha_v = (v == 0) ? 1.0 / sqrt(2.0) : 1.0;
-                    
-                    sum += alpha_u * alpha_v * quantizedBlock[u][v] * 
-                           cosineCache[x][u] * cosineCache[y][v];
+                    sum += scaled[u * 8 + v] * inverseCosines[x][u] * inverseCosines[y][v];
                 }
             }
             
-            result[x][y] = sum / 4.0;
+            double val = max(0.0, min(255.0, sum + 128.0));
+            out[x * stride + y] = static_cast<unsigned char>(round(val));
         }
     }
-    
-    return result;
+}
+
+// ========== FastDctInverseTransform ==========
+
+FastDctInverseTransform::FastDctInverseTransform() {
+    DctMath::aanInverseScale(inputScale[QuantTable::Luma]);
+    DctMath::aanInverseScale(inputScale[QuantTable::Chroma]);
+}
+
+void FastDctInverseTransform::setQuantTable(const QuantTable& tables) {
+    DctMath::aanInverseScale(inputScale[QuantTable::Luma], &tables.getTable(QuantTable::Luma));
+    DctMath::aanInverseScale(inputScale[QuantTable::Chroma], &tables.getTable(QuantTable::Chroma));
+}
+
+void FastDctInverseTransform::inverseDct(const CoeffBlock& coefficients, int channel,
+                                         unsigned char* out, int stride) const {
+    DctMath::fastInverseDct(coefficients.data, inputScale[channel], out, stride);
 }
 
 // ========== JpegDecoder ==========
 
-JpegDecoder::JpegDecoder(vector<vector<int>> quantTable)
-    : idct(make_unique<SequentialDctInverseTransform>()),
-      quantizationTable(move(quantTable)) {}
+JpegDecoder::JpegDecoder(shared_ptr<const QuantTable> quantTables, unique_ptr<IDctInverseTransform> inverseTransform,
+                         ThreadPool& pool)
+    : idct(inverseTransform ? move(inverseTransform) : make_unique<FastDctInverseTransform>()),
+      quantTables(move(quantTables)),
+      pool(pool),
+      threadCount(0) {}
 
-vector<vector<int>> JpegDecoder::dequantize(const vector<vector<int>>& quantized) {
-    vector<vector<int>> result(8, vector<int>(8));
-    
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            result[i][j] = quantized[i][j] * quantizationTable[i][j];
-        }
+void JpegDecoder::setThreadCount(int threads) {
+    if (threads < 1) {
+        throw invalid_argument("Thread count must be positive");
     }
-    
-    return result;
+    threadCount = threads;
 }
 
 vector<vector<int>> JpegDecoder::inverseZigzag(const vector<int>& zigzagData) {
     vector<vector<int>> block(8, vector<int>(8, 0));
     
     for (int i = 0; i < 64 && i < static_cast<int>(zigzagData.size()); i++) {
-        int index = zigzagOrder[i];
+        int index = JpegFormat::zigzagOrder[i];
         int row = index / 8;
         int col = index % 8;
         block[row][col] = zigzagData[i];
@@ -96,18 +113,26 @@ vector<vector<int>> JpegDecoder::inverseZigzag(const vector<int>& zigzagData) {
 }
 
 RgbImage JpegDecoder::ycbcrToRgb(const YCbCrImage& ycbcr) {
-    int width = ycbcr.getWidth();
-    int height = ycbcr.getHeight();
-    RgbImage rgb(width, height);
+    RgbImage rgb(ycbcr.getWidth(), ycbcr.getHeight());
+    ycbcrToRgb(ycbcr, rgb, 0, 0, ycbcr.getWidth(), ycbcr.getHeight());
+    return rgb;
+}
+
+void JpegDecoder::ycbcrToRgb(const YCbCrImage& ycbcr, RgbImage& rgb, int x0, int y0, int x1, int y1) {
+    x1 = min(x1, ycbcr.getWidth());
+    y1 = min(y1, ycbcr.getHeight());
     
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            auto [yVal, cbVal, crVal] = ycbcr.getPixel(x, y);
-            
+    for (int y = y0; y < y1; y++) {
+        const unsigned char* yRow = ycbcr.getY().row(y);
+        const unsigned char* cbRow = ycbcr.getCb().row(y);
+        const unsigned char* crRow = ycbcr.getCr().row(y);
+        unsigned char* dst = rgb.row(y);
+        
+        for (int x = x0; x < x1; x++) {
             // YCbCr to RGB conversion (ITU-R BT.601)
-            double yD = yVal;
-            double cbD = cbVal - 128.0;
-            double crD = crVal - 128.0;
+            double yD = yRow[x];
+            double cbD = cbRow[x] - 128.0;
+            double crD = crRow[x] - 128.0;
             
             double r = yD + 1.402 * crD;
             double g = yD - 0.344136 * cbD - 0.714136 * crD;
@@ -118,106 +143,332 @@ RgbImage JpegDecoder::ycbcrToRgb(const YCbCrImage& ycbcr) {
             g = max(0.0, min(255.0, g));
             b = max(0.0, min(255.0, b));
             
-            rgb.setPixel(x, y, 
-                        static_cast<unsigned char>(round(r)),
-                        static_cast<unsigned char>(round(g)),
-                        static_cast<unsigned char>(round(b)));
+            dst[x * 3]     = static_cast<unsigned char>(round(r));
+            dst[x * 3 + 1] = static_cast<unsigned char>(round(g));
+            dst[x * 3 + 2] = static_cast<unsigned char>(round(b));
         }
     }
-    
-    return rgb;
 }
 
-void JpegDecoder::placeBlock(YCbCrImage& image, const vector<vector<double>>& block,
-                            int blockX, int blockY, int component) {
+void JpegDecoder::placeBlock(YCbCrImage& image, const CoeffBlock& coefficients,
+                            int blockX, int blockY, int component, const JpegFormat::McuLayout& layout) const {
     int width = image.getWidth();
     int height = image.getHeight();
+    ImagePlane& plane = image.plane(component);
     
-    // Определяем шаг в зависимости от компонента (Y = 8, Cb/Cr = 16 из-за субсэмплинга)
-    int step = (component == 0) ? 8 : 16;
-    int pixelX = blockX * step;
-    int pixelY = blockY * step;
+    // Каждый сэмпл Cb/Cr покрывает lumaH x lumaV пикселей изображения (1x1 для 4:4:4)
+    int scaleX = (component == 0) ? 1 : layout.lumaH;
+    int scaleY = (component == 0) ? 1 : layout.lumaV;
+    int pixelX = blockX * 8 * scaleX;
+    int pixelY = blockY * 8 * scaleY;
+    
+    // Блок без растяжения целиком внутри изображения - пишем прямо в плоскость
+    if (scaleX == 1 && scaleY == 1 && pixelX + 8 <= width && pixelY + 8 <= height) {
+        idct->inverseDct(coefficients, QuantTable::channelOf(component), plane.row(pixelY) + pixelX,
+                         plane.getStride());
+        return;
+    }
+    
+    unsigned char samples[64];
+    idct->inverseDct(coefficients, QuantTable::channelOf(component), samples, 8);
     
     for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            // Восстанавливаем значение (добавляем 128)
-            double val = block[i][j] + 128.0;
-            val = max(0.0, min(255.0, val));
-            unsigned char byteVal = static_cast<unsigned char>(round(val));
-            
-            if (component == 0) {
-                // Y компонент - полное разрешение
-                int px = pixelX + j;
-                int py = pixelY + i;
-                if (px < width && py < height) {
-                    auto [oldY, oldCb, oldCr] = image.getPixel(px, py);
-                    image.setPixel(px, py, byteVal, oldCb, oldCr);
-                }
-            } else {
-                // Cb/Cr компоненты - субсэмплинг 2x2
-                // Каждый пиксель блока соответствует 2x2 пикселям изображения
-                for (int dy = 0; dy < 2; dy++) {
-                    for (int dx = 0; dx < 2; dx++) {
-                        int px = pixelX + j * 2 + dx;
-                        int py = pixelY + i * 2 + dy;
-                        if (px < width && py < height) {
-                            auto [oldY, oldCb, oldCr] = image.getPixel(px, py);
-                            if (component == 1) {
-                                image.setPixel(px, py, oldY, byteVal, oldCr);
-                            } else {
-                                image.setPixel(px, py, oldY, oldCb, byteVal);
-                            }
-                        }
-                    }
-                }
+        const unsigned char* rowVals = samples + i * 8;
+        
+        for (int dy = 0; dy < scaleY; dy++) {
+            int py = pixelY + i * scaleY + dy;
+            if (py >= height) {
+                break;
+            }
+            unsigned char* dst = plane.row(py);
+            int xEnd = min(width, pixelX + 8 * scaleX);
+            for (int px = pixelX; px < xEnd; px++) {
+                dst[px] = rowVals[(px - pixelX) / scaleX];
+            }
+        }
+    }
+}
+
+void JpegDecoder::decodeBlock(BitReader& reader, const HuffmanDecoder& dcDecoder, const HuffmanDecoder& acDecoder,
+                             int& lastDc, CoeffBlock& out) {
+    out = CoeffBlock{};
+    
+    // DC: категория и разность с предыдущим блоком того же компонента
+    int category = dcDecoder.decodeSymbol(reader);
+    if (category > 11) {
+        throw runtime_error("Invalid DC category");
+    }
+    int diff = 0;
+    if (category > 0) {
+        diff = reader.readBits(category);
+        // EXTEND (F.2.2.1): старший бит 0 - отрицательное значение
+        if (diff < (1 << (category - 1))) {
+            diff -= (1 << category) - 1;
+        }
+    }
+    lastDc += diff;
+    out[0] = static_cast<int16_t>(lastDc);
+    
+    // AC: пары run/size до EOB или конца блока
+    for (int k = 1; k < 64; ) {
+        int symbol = acDecoder.decodeSymbol(reader);
+        int run = symbol >> 4;
+        int size = symbol & 0x0F;
+        
+        if (size == 0) {
+            if (run == 15) {  // ZRL
+                k += 16;
+                continue;
+            }
+            break;  // EOB
+        }
+        
+        k += run;
+        if (k > 63) {
+            throw runtime_error("AC coefficient index out of range");
+        }
+        
+        int value = reader.readBits(size);
+        if (value < (1 << (size - 1))) {
+            value -= (1 << size) - 1;
+        }
+        out[JpegFormat::zigzagOrder[k]] = static_cast<int16_t>(value);
+        k++;
+    }
+}
+
+vector<JpegDecoder::ScanSegment> JpegDecoder::splitScan(const JpegEncodedData& encodedData, int totalMcus) {
+    const unsigned char* data = encodedData.compressedData.data();
+    size_t size = encodedData.compressedData.size();
+    int interval = encodedData.restartInterval;
+    
+    vector<ScanSegment> segments;
+    if (interval <= 0) {
+        segments.push_back({data, size, 0, totalMcus});
+    } else {
+        segments.reserve((totalMcus + interval - 1) / interval);
+    }
+    
+    size_t start = 0;
+    for (size_t i = 0; i + 1 < size; i++) {
+        if (data[i] != 0xFF || (data[i + 1] & 0xF8) != JpegFormat::RST0) {
+            continue;
+        }
+        if (interval <= 0) {
+            throw runtime_error("Restart marker without DRI");
+        }
+        int index = static_cast<int>(segments.size());
+        if ((data[i + 1] & 7) != (index & 7)) {
+            throw runtime_error("Restart marker out of sequence");
+        }
+        segments.push_back({data + start, i - start, index * interval, interval});
+        start = i + 2;
+        i++;
+    }
+    
+    if (interval > 0) {
+        // Последний интервал должен дойти до конца изображения: при обрезанном скане или пропущенных
+        // RSTn часть MCU иначе молча осталась бы недекодированной
+        int firstMcu = static_cast<int>(segments.size()) * interval;
+        if (firstMcu >= totalMcus || static_cast<long long>(firstMcu) + interval < totalMcus) {
+            throw runtime_error("Restart marker count does not match image size");
+        }
+        segments.push_back({data + start, size - start, firstMcu, min(interval, totalMcus - firstMcu)});
+    }
+    return segments;
+}
+
+template <typename BlockSink>
+void JpegDecoder::decodeSegment(const ScanSegment& segment, const HuffmanDecoder* dcDecoders,
+                                const HuffmanDecoder* acDecoders, const JpegFormat::McuLayout& layout,
+                                BlockSink&& sink) {
+    BitReader reader(segment.data, segment.size);
+    // Предсказание DC сбрасывается в начале каждого интервала перезапуска
+    int lastDc[3] = {0, 0, 0};
+    CoeffBlock coefficients;
+    
+    // Порядок блоков в MCU совпадает с JpegFormat::interleaveBlocks: блоки Y построчно, Cb, Cr
+    for (int mcu = segment.firstMcu; mcu < segment.firstMcu + segment.mcuCount; mcu++) {
+        int mx = mcu % layout.mcusX;
+        int my = mcu / layout.mcusX;
+        for (int v = 0; v < layout.lumaV; v++) {
+            for (int h = 0; h < layout.lumaH; h++) {
+                decodeBlock(reader, dcDecoders[0], acDecoders[0], lastDc[0], coefficients);
+                sink(coefficients, mx * layout.lumaH + h, my * layout.lumaV + v, 0);
             }
         }
+        for (int component = 1; component <= 2; component++) {
+            decodeBlock(reader, dcDecoders[1], acDecoders[1], lastDc[component], coefficients);
+            sink(coefficients, mx, my, component);
+        }
     }
 }
 
+vector<QuantizedBlock> JpegDecoder::decodeScan(const JpegEncodedData& encodedData) {
+    int width = encodedData.width;
+    int height = encodedData.height;
+    if (width <= 0 || height <= 0) {
+        throw invalid_argument("Invalid image dimensions");
+    }
+    
+    HuffmanDecoder dcDecoders[2] = {
+        HuffmanDecoder(encodedData.dcLuminanceTable),
+        HuffmanDecoder(encodedData.dcChrominanceTable)
+    };
+    HuffmanDecoder acDecoders[2] = {
+        HuffmanDecoder(encodedData.acLuminanceTable),
+        HuffmanDecoder(encodedData.acChrominanceTable)
+    };
+    
+    auto layout = JpegFormat::mcuLayout(width, height, encodedData.subsampling);
+    int yBlocksX = (width + 7) / 8;
+    int yBlocksY = (height + 7) / 8;
+    
+    vector<QuantizedBlock> blocks;
+    blocks.reserve(static_cast<size_t>(yBlocksX) * yBlocksY + 2 * static_cast<size_t>(layout.mcusX) * layout.mcusY);
+    
+    for (const auto& segment : splitScan(encodedData, layout.mcusX * layout.mcusY)) {
+        decodeSegment(segment, dcDecoders, acDecoders, layout,
+                      [&](const CoeffBlock& coefficients, int bx, int by, int component) {
+            if (component != 0 || (bx < yBlocksX && by < yBlocksY)) {
+                blocks.emplace_back(coefficients, bx, by, component);
+            }
+        });
+    }
+    
+    return blocks;
+}
+
 RgbImage JpegDecoder::decode(const JpegEncodedData& encodedData) {
-    // Полное декодирование из Huffman потока - сложная задача
-    // Для тестирования используем decodeFromBlocks
-    // Эта функция оставлена как placeholder для полной реализации
+    int width = encodedData.width;
+    int height = encodedData.height;
+    if (width <= 0 || height <= 0) {
+        throw invalid_argument("Invalid image dimensions");
+    }
+    
+    HuffmanDecoder dcDecoders[2] = {
+        HuffmanDecoder(encodedData.dcLuminanceTable),
+        HuffmanDecoder(encodedData.dcChrominanceTable)
+    };
+    HuffmanDecoder acDecoders[2] = {
+        HuffmanDecoder(encodedData.acLuminanceTable),
+        HuffmanDecoder(encodedData.acChrominanceTable)
+    };
     
-    cerr << "Warning: Full Huffman decoding not implemented. "
-         << "Use decodeFromBlocks() for testing." << endl;
+    auto layout = JpegFormat::mcuLayout(width, height, encodedData.subsampling);
+    auto segments = splitScan(encodedData, layout.mcusX * layout.mcusY);
+    
+    YCbCrImage ycbcr(width, height);
+    RgbImage rgb(width, height);
+    if (!encodedData.quantTables) {
+        throw invalid_argument("Encoded data has no quantization tables");
+    }
+    idct->setQuantTable(*encodedData.quantTables);
     
-    // Возвращаем пустое изображение
-    return RgbImage(encodedData.width, encodedData.height);
+    // MCU покрывают непересекающиеся прямоугольники, поэтому сегменты пишут в разные пиксели
+    // и каждый сразу переводит свои MCU в RGB
+    pool.parallelFor(0, segments.size(), 1, [&](size_t first, size_t last) {
+        for (size_t s = first; s < last; s++) {
+            const ScanSegment& segment = segments[s];
+            decodeSegment(segment, dcDecoders, acDecoders, layout,
+                          [&](const CoeffBlock& coefficients, int bx, int by, int component) {
+                placeBlock(ycbcr, coefficients, bx, by, component, layout);
+            });
+            
+            // Конвертация цвета по строкам MCU, затронутым сегментом
+            int lastMcu = segment.firstMcu + segment.mcuCount - 1;
+            for (int my = segment.firstMcu / layout.mcusX; my <= lastMcu / layout.mcusX; my++) {
+                int mxStart = my == segment.firstMcu / layout.mcusX ? segment.firstMcu % layout.mcusX : 0;
+                int mxEnd = my == lastMcu / layout.mcusX ? lastMcu % layout.mcusX + 1 : layout.mcusX;
+                ycbcrToRgb(ycbcr, rgb, mxStart * layout.mcuWidth(), my * layout.mcuHeight(),
+                           mxEnd * layout.mcuWidth(), (my + 1) * layout.mcuHeight());
+            }
+        }
+    }, threadCount);
+    
+    return rgb;
 }
 
 RgbImage JpegDecoder::decodeFromBlocks(const vector<QuantizedBlock>& blocks, 
-                                       int width, int height) {
+                                       int width, int height, ChromaSubsampling subsampling) {
+    if (!quantTables) {
+        throw logic_error("Decoder has no quantization tables");
+    }
+    return reconstruct(blocks, width, height, *quantTables, subsampling);
+}
+
+RgbImage JpegDecoder::reconstruct(const vector<QuantizedBlock>& blocks, int width, int height,
+                                  const QuantTable& tables, ChromaSubsampling subsampling) {
+    auto layout = JpegFormat::mcuLayout(width, height, subsampling);
+    
     // Создаем YCbCr изображение
     YCbCrImage ycbcr(width, height);
     
     // Инициализируем значениями по умолчанию (серый)
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            ycbcr.setPixel(x, y, 128, 128, 128);
-        }
+    for (int c = 0; c < 3; c++) {
+        ycbcr.plane(c).fill(128);
     }
     
-    // Обрабатываем каждый блок
+    // Деквантизация складывается в множители обратного DCT
+    idct->setQuantTable(tables);
+    
     for (const auto& block : blocks) {
-        // Получаем коэффициенты в формате 8x8
-        auto quantized = block.toArray();
-        
-        // Деквантизация
-        auto dequantized = dequantize(quantized);
-        
-        // Обратное DCT
-        auto spatial = idct->inverseDct(dequantized);
-        
-        // Помещаем блок в изображение
-        placeBlock(ycbcr, spatial, block.getBlockX(), block.getBlockY(), block.getComponent());
+        placeBlock(ycbcr, block.getCoefficients(), block.getBlockX(), block.getBlockY(), block.getComponent(),
+                   layout);
     }
     
     // Конвертируем YCbCr в RGB
     return ycbcrToRgb(ycbcr);
 }
 
+// ========== HuffmanDecoder ==========
+
+HuffmanDecoder::HuffmanDecoder(const HuffmanSpec& spec) : symbols(spec.symbols) {
+    fill(begin(lookup), end(lookup), 0);
+    
+    // Канонические коды (Annex C.2) и границы для медленного пути (F.2.2.3)
+    int code = 0;
+    int index = 0;
+    for (int length = 1; length <= 16; length++) {
+        int count = spec.counts[length - 1];
+        if (index + count > static_cast<int>(symbols.size())) {
+            throw invalid_argument("Huffman spec has fewer symbols than counts");
+        }
+        
+        // Проверка до заполнения lookup: лишние коды длины length вышли бы за пределы таблицы
+        if (code + count > (1 << length)) {
+            throw invalid_argument("Huffman spec is not a valid prefix code");
+        }
+        
+        valueOffset[length] = index - code;
+        maxCode[length] = count > 0 ? code + count - 1 : -1;
+        
+        for (int i = 0; i < count; i++, code++, index++) {
+            if (length <= kLookupBits) {
+                // Все kLookupBits-битные префиксы, начинающиеся с этого кода
+                int shift = kLookupBits - length;
+                uint16_t entry = static_cast<uint16_t>((length << 8) | symbols[index]);
+                for (int fillIndex = 0; fillIndex < (1 << shift); fillIndex++) {
+                    lookup[(code << shift) | fillIndex] = entry;
+                }
+            }
+        }
+        code <<= 1;
+    }
+}
+
+int HuffmanDecoder::decodeSlow(BitReader& reader) const {
+    uint32_t bits = reader.peekBits(16);
+    for (int length = kLookupBits + 1; length <= 16; length++) {
+        int code = static_cast<int>(bits >> (16 - length));
+        if (code <= maxCode[length]) {
+            reader.skipBits(length);
+            return symbols[valueOffset[length] + code];
+        }
+    }
+    throw runtime_error("Invalid Huffman code");
+}
+
 // ========== Фабричные функции ==========
 
 unique_ptr<JpegEncoder> createJpegEncoder(int quality) {
@@ -232,6 +483,6 @@ unique_ptr<JpegEncoder> createJpegEncoder(int quality) {
         move(colorConverter), move(blockProcessor), move(huffmanEncoder));
 }
 
-unique_ptr<JpegDecoder> createJpegDecoder(const vector<vector<int>>& quantTable) {
-    return make_unique<JpegDecoder>(quantTable);
+unique_ptr<JpegDecoder> createJpegDecoder(shared_ptr<const QuantTable> quantTables) {
+    return make_unique<JpegDecoder>(move(quantTables));
 }
@@ -0,0 +1,157 @@
+#include "jpeg_format.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+namespace JpegFormat {
+    
+    const int zigzagOrder[64] = {
+        0,  1,  8, 16,  9,  2,  3, 10,
+        17, 24, 32, 25, 18, 11,  4,  5,
+        12, 19, 26, 33, 40, 48, 41, 34,
+        27, 20, 13,  6,  7, 14, 21, 28,
+        35, 42, 49, 56, 57, 50, 43, 36,
+        29, 22, 15, 23, 30, 37, 44, 51,
+        58, 59, 52, 45, 38, 31, 39, 46,
+        53, 60, 61, 54, 47, 55, 62, 63
+    };
+    
+    template <size_t N>
+    static HuffmanSpec makeSpec(const uint8_t (&counts)[16], const uint8_t (&symbols)[N]) {
+        HuffmanSpec spec;
+        copy(begin(counts), end(counts), spec.counts);
+        spec.symbols.assign(begin(symbols), end(symbols));
+        return spec;
+    }
+    
+    const HuffmanSpec& standardDcLuminance() {
+        static const HuffmanSpec spec = makeSpec(kStandardDcLuminanceCounts, kStandardDcLuminanceSymbols);
+        return spec;
+    }
+    
+    const HuffmanSpec& standardDcChrominance() {
+        static const HuffmanSpec spec = makeSpec(kStandardDcChrominanceCounts, kStandardDcChrominanceSymbols);
+        return spec;
+    }
+    
+    const HuffmanSpec& standardAcLuminance() {
+        static const HuffmanSpec spec = makeSpec(kStandardAcLuminanceCounts, kStandardAcLuminanceSymbols);
+        return spec;
+    }
+    
+    const HuffmanSpec& standardAcChrominance() {
+        static const HuffmanSpec spec = makeSpec(kStandardAcChrominanceCounts, kStandardAcChrominanceSymbols);
+        return spec;
+    }
+    
+    void setStandardTables(JpegEncodedData& result) {
+        result.dcLuminanceTable = standardDcLuminance();
+        result.acLuminanceTable = standardAcLuminance();
+        result.dcChrominanceTable = standardDcChrominance();
+        result.acChrominanceTable = standardAcChrominance();
+    }
+    
+    void countBlockSymbols(const CoeffBlock& coefficients, int& lastDc,
+                           HuffmanFrequencies& dcFrequencies, HuffmanFrequencies& acFrequencies,
+                           int lastNonZero) {
+        int dc = coefficients[0];
+        dcFrequencies[magnitudeCategory(dc - lastDc)]++;
+        lastDc = dc;
+        countAcSymbols(coefficients, acFrequencies, lastNonZero);
+    }
+    
+    void countAcSymbols(const CoeffBlock& coefficients, HuffmanFrequencies& acFrequencies, int lastNonZero) {
+        int zeroRun = 0;
+        for (int i = 1; i <= lastNonZero; i++) {
+            int ac = coefficients[zigzagOrder[i]];
+            if (ac == 0) {
+                zeroRun++;
+                continue;
+            }
+            while (zeroRun > 15) {
+                acFrequencies[0xF0]++;
+                zeroRun -= 16;
+            }
+            acFrequencies[(zeroRun << 4) | magnitudeCategory(ac)]++;
+            zeroRun = 0;
+        }
+        if (zeroRun > 0 || lastNonZero < 63) {
+            acFrequencies[0x00]++;
+        }
+    }
+    
+    void SymbolHistogram::clear() {
+        for (int table = 0; table < 2; table++) {
+            dc[table].fill(0);
+            ac[table].fill(0);
+        }
+    }
+    
+    void SymbolHistogram::add(const SymbolHistogram& other) {
+        for (int table = 0; table < 2; table++) {
+            for (size_t symbol = 0; symbol < dc[table].size(); symbol++) {
+                dc[table][symbol] += other.dc[table][symbol];
+                ac[table][symbol] += other.ac[table][symbol];
+            }
+        }
+    }
+    
+    McuLayout mcuLayout(int width, int height, ChromaSubsampling subsampling) {
+        int lumaH = subsamplingFactorX(subsampling);
+        int lumaV = subsamplingFactorY(subsampling);
+        return McuLayout{(width + 8 * lumaH - 1) / (8 * lumaH), (height + 8 * lumaV - 1) / (8 * lumaV), lumaH, lumaV};
+    }
+    
+    BlockOrder interleaveBlocks(const vector<QuantizedBlock>& blocks, int width, int height,
+                                ChromaSubsampling subsampling, ScratchArena* arena) {
+        McuLayout layout = mcuLayout(width, height, subsampling);
+        int yBlocksX = (width + 7) / 8;
+        int yBlocksY = (height + 7) / 8;
+        
+        // Сетки блоков по координатам (бэкенды могут выдавать блоки в любом порядке)
+        ArenaAllocator<const QuantizedBlock*> allocator(arena);
+        BlockOrder yGrid(static_cast<size_t>(yBlocksX) * yBlocksY, nullptr, allocator);
+        BlockOrder cbGrid(static_cast<size_t>(layout.mcusX) * layout.mcusY, nullptr, allocator);
+        BlockOrder crGrid(cbGrid.size(), nullptr, allocator);
+        
+        for (const auto& block : blocks) {
+            int bx = block.getBlockX();
+            int by = block.getBlockY();
+            switch (block.getComponent()) {
+                case 0:
+                    if (bx < yBlocksX && by < yBlocksY) yGrid[by * yBlocksX + bx] = &block;
+                    break;
+                case 1:
+                    if (bx < layout.mcusX && by < layout.mcusY) cbGrid[by * layout.mcusX + bx] = &block;
+                    break;
+                case 2:
+                    if (bx < layout.mcusX && by < layout.mcusY) crGrid[by * layout.mcusX + bx] = &block;
+                    break;
+            }
+        }
+        
+        BlockOrder order(allocator);
+        order.reserve(static_cast<size_t>(layout.mcusX) * layout.mcusY * layout.blocksPerMcu());
+        
+        for (int my = 0; my < layout.mcusY; my++) {
+            for (int mx = 0; mx < layout.mcusX; mx++) {
+                for (int v = 0; v < layout.lumaV; v++) {
+                    for (int h = 0; h < layout.lumaH; h++) {
+                        int bx = min(mx * layout.lumaH + h, yBlocksX - 1);
+                        int by = min(my * layout.lumaV + v, yBlocksY - 1);
+                        order.push_back(yGrid[by * yBlocksX + bx]);
+                    }
+                }
+                order.push_back(cbGrid[my * layout.mcusX + mx]);
+                order.push_back(crGrid[my * layout.mcusX + mx]);
+            }
+        }
+        
+        if (find(order.begin(), order.end(), nullptr) != order.end()) {
+            throw invalid_argument("Block set does not cover the image");
+        }
+        
+        return order;
+    }
+}
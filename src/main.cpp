@@ -3,6 +3,10 @@
 #include <iomanip>
 #include <vector>
 #include <functional>
+#include <random>
+#include <cstring>
+#include <algorithm>
+#include <tuple>
 #include <omp.h>
 #include "sequential_processors.h"
 #include "OpenMPBlockProcessor.h"
@@ -10,8 +14,26 @@
 #include "OpenMPQuantizer.h"
 #include "pipeline_processor.h"
 #include "multy_thread.h"
+#include "fast_dct_transform.h"
+#include "dct_math.h"
+#include "color_math.h"
+#include "quant_math.h"
+#include "entropy_coder.h"
 #include "jpeg_decoder.h"
 #include "image_metrics.h"
+#include "jpeg_format.h"
+#include "jfif_reader.h"
+#include "thread_pool.h"
+#include "streaming_encoder.h"
+#include "fused_mcu_processor.h"
+#include "encoder_session.h"
+#include "scratch_arena.h"
+#include "pnm_io.h"
+#include "cli.h"
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+#include "jfif_writer.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -60,6 +82,105 @@ void printResults(const vector<BenchmarkResult>& results) {
 
 using EncoderFactory = function<EncodingResult(const RgbImage&)>;
 
+// --fast-dct: все бэкенды используют FastDctTransform вместо эталонного DCT
+static bool useFastDct = false;
+
+// --restart-interval N: энкодеры бенчмарка ставят RSTn через каждые N MCU (0 - без маркеров)
+static int restartInterval = 0;
+
+// --subsampling 444|422|420: прореживание цветности энкодеров бенчмарка
+static ChromaSubsampling subsampling = ChromaSubsampling::Yuv420;
+
+// Файл PPM/PGM/PAM для бенчмарка (пусто - синтетические изображения)
+static string inputPath;
+
+const char* subsamplingName(ChromaSubsampling mode) {
+    switch (mode) {
+        case ChromaSubsampling::Yuv444: return "4:4:4";
+        case ChromaSubsampling::Yuv422: return "4:2:2";
+        default: return "4:2:0";
+    }
+}
+
+// YCbCr с цветностью, прореженной как в JpegEncoder
+YCbCrImage convertForEncoding(const RgbImage& image, ChromaSubsampling mode) {
+    auto ycbcr = SequentialColorConverter().convert(image);
+    ycbcr.downsampleChroma(mode);
+    return ycbcr;
+}
+
+unique_ptr<IDctTransform> makeDctTransform(unique_ptr<IDctTransform> reference) {
+    if (useFastDct) {
+        return make_unique<FastDctTransform>();
+    }
+    return reference;
+}
+
+// Сверка FastDctTransform с эталонным DctMath::computeDctCoefficient: до квантования (выход AAN, приведённый
+// через DctMath::aanOutputScale) и после него - квантователь с таблицей DctScaling::Aan против обычной таблицы
+bool checkFastDctAccuracy() {
+    mt19937 rng(12345);
+    uniform_int_distribution<int> sample(-128, 127);
+    
+    SequentialDctTransform reference;
+    FastDctTransform fast;
+    float aanScale[64];
+    DctMath::aanOutputScale(aanScale);
+    
+    SequentialQuantizer referenceQuantizers[2] = {SequentialQuantizer(50), SequentialQuantizer(90)};
+    SequentialQuantizer fastQuantizers[2] = {SequentialQuantizer(50), SequentialQuantizer(90)};
+    for (auto& quantizer : fastQuantizers) {
+        quantizer.setInputScaling(fast.outputScaling());
+    }
+    
+    double maxError = 0.0;
+    size_t quantized = 0;
+    size_t offByOne = 0;
+    size_t wrong = 0;
+    
+    for (int test = 0; test < 1000; test++) {
+        FloatBlock block;
+        for (int i = 0; i < 8; i++) {
+            for (int j = 0; j < 8; j++) {
+                switch (test) {
+                    case 0: block.at(i, j) = 127; break;                            // плоский максимум
+                    case 1: block.at(i, j) = -128; break;                           // плоский минимум
+                    case 2: block.at(i, j) = ((i + j) % 2) ? 127 : -128; break;     // шахматка
+                    default: block.at(i, j) = sample(rng);
+                }
+            }
+        }
+        
+        FloatBlock expected, actual;
+        reference.forwardDct(block, expected);
+        fast.forwardDct(block, actual);
+        
+        for (int i = 0; i < 64; i++) {
+            maxError = max(maxError, static_cast<double>(abs(expected[i] - actual[i] * aanScale[i])));
+        }
+        
+        for (int q = 0; q < 2; q++) {
+            for (int component = 0; component < 2; component++) {
+                CoeffBlock expectedLevels, actualLevels;
+                referenceQuantizers[q].quantize(expected, component, expectedLevels);
+                fastQuantizers[q].quantize(actual, component, actualLevels);
+                for (int i = 0; i < 64; i++) {
+                    int diff = abs(expectedLevels[i] - actualLevels[i]);
+                    offByOne += diff == 1;
+                    wrong += diff > 1;
+                    quantized++;
+                }
+            }
+        }
+    }
+    
+    bool passed = maxError < 1e-2 && wrong == 0;
+    cout << "FastDCT accuracy (1000 blocks): max abs error " << scientific << setprecision(2) << maxError
+         << defaultfloat << "; quantized at quality 50/90: " << offByOne << " of " << quantized
+         << " coefficients off by 1" << (passed ? " [OK]" : " [FAILED]") << endl;
+    return passed;
+}
+
 // Вспомогательный класс для захвата блоков
 class BlockCapturingProcessor : public IBlockProcessor {
 private:
@@ -75,12 +196,32 @@ public:
         *capturedBlocks = blocks;
         return blocks;
     }
+    
+    const shared_ptr<const QuantTable>& getQuantTable() const override { return inner->getQuantTable(); }
+};
+
+// То же для слитого пути
+class McuCapturingProcessor : public IMcuProcessor {
+private:
+    unique_ptr<IMcuProcessor> inner;
+    vector<QuantizedBlock>* capturedBlocks;
+
+public:
+    McuCapturingProcessor(unique_ptr<IMcuProcessor> processor, vector<QuantizedBlock>* blocks)
+        : inner(move(processor)), capturedBlocks(blocks) {}
+    
+    vector<QuantizedBlock> processImage(const RgbImage& image, ChromaSubsampling subsampling) override {
+        auto blocks = inner->processImage(image, subsampling);
+        *capturedBlocks = blocks;
+        return blocks;
+    }
+    
+    const shared_ptr<const QuantTable>& getQuantTable() const override { return inner->getQuantTable(); }
 };
 
 BenchmarkResult runBenchmark(const string& name, 
                              const vector<RgbImage>& images,
                              EncoderFactory factory,
-                             const vector<vector<int>>& quantTable,
                              int iterations = 10) {
     cout << "Running " << name << "..." << flush;
     
@@ -135,15 +276,15 @@ BenchmarkResult runBenchmark(const string& name,
     vector<double> psnrs;
     vector<double> ssims;
     
-    auto decoder = createJpegDecoder(quantTable);
+    // Таблицы квантования каждый результат несёт свои, decode берёт их из потока
+    auto decoder = createJpegDecoder(encodingResults.front().encoded.quantTables);
     
     for (int iter = 0; iter < iterations; iter++) {
         const auto& image = images[iter % images.size()];
         const auto& result = encodingResults[iter];
         
-        auto reconstructed = decoder->decodeFromBlocks(result.blocks, 
-                                                       image.getWidth(), 
-                                                       image.getHeight());
+        // Декодируем настоящий поток: проверяется и энтропийное кодирование
+        auto reconstructed = decoder->decode(result.encoded);
         
         psnrs.push_back(ImageMetrics::peakSignalToNoiseRatio(image, reconstructed));
         ssims.push_back(ImageMetrics::structuralSimilarityIndex(image, reconstructed));
@@ -162,7 +303,1133 @@ BenchmarkResult runBenchmark(const string& name,
     return BenchmarkResult{name, totalTime, avgTime, avgSize, avgRatio, avgPsnr, avgSsim};
 }
 
-int main() {
+// Сверка FastDctInverseTransform с эталонным обратным DCT: после округления допускается расхождение в 1 уровень
+bool checkFastIdctAccuracy(const QuantTable& quantTables) {
+    mt19937 rng(777);
+    
+    SequentialDctInverseTransform reference;
+    FastDctInverseTransform fast;
+    reference.setQuantTable(quantTables);
+    fast.setQuantTable(quantTables);
+    
+    // Настоящие квантованные блоки: прямое DCT случайных сэмплов с плавным градиентом
+    uniform_int_distribution<int> noise(-40, 40);
+    FastDctTransform forward;
+    SequentialQuantizer quantizer;
+    quantizer.setInputScaling(forward.outputScaling());
+    
+    int maxDiff = 0;
+    for (int test = 0; test < 1000; test++) {
+        FloatBlock block, dctBlock;
+        int base = test % 256 - 128;
+        for (int i = 0; i < 8; i++) {
+            for (int j = 0; j < 8; j++) {
+                block.at(i, j) = static_cast<float>(max(-128, min(127, base + 4 * (i + j) + noise(rng))));
+            }
+        }
+        forward.forwardDct(block, dctBlock);
+        // Компоненты по очереди: проверяются таблицы и яркости, и цветности
+        int component = test % 3;
+        CoeffBlock coefficients;
+        quantizer.quantize(dctBlock, component, coefficients);
+        
+        unsigned char expected[64], actual[64];
+        reference.inverseDct(coefficients, QuantTable::channelOf(component), expected, 8);
+        fast.inverseDct(coefficients, QuantTable::channelOf(component), actual, 8);
+        for (int i = 0; i < 64; i++) {
+            maxDiff = max(maxDiff, abs(expected[i] - actual[i]));
+        }
+    }
+    
+    bool passed = maxDiff <= 1;
+    cout << "FastIDCT accuracy (1000 blocks): max sample difference " << maxDiff
+         << (passed ? " [OK]" : " [FAILED]") << endl;
+    return passed;
+}
+
+// Сверка SIMD-ядер RGB -> YCbCr с эталонной целочисленной формулой (должны совпадать бит в бит)
+bool checkColorKernels() {
+    mt19937 rng(54321);
+    uniform_int_distribution<int> byteDist(0, 255);
+    
+    const int maxCount = 259; // не кратно 16/32: проверяем и хвосты
+    vector<unsigned char> rgb(maxCount * 3);
+    vector<unsigned char> expected(maxCount * 3), actual(maxCount * 3);
+    
+    bool passed = true;
+    for (auto kernel : {ColorMath::RowKernel::Sse41, ColorMath::RowKernel::Avx2}) {
+        if (!ColorMath::isRowKernelSupported(kernel)) {
+            continue;
+        }
+        
+        size_t mismatches = 0;
+        for (int test = 0; test < 200; test++) {
+            int count = 1 + test % maxCount;
+            for (auto& v : rgb) {
+                // Первые тесты - только крайние значения, где легче всего переполниться
+                v = static_cast<unsigned char>(test < 20 ? (byteDist(rng) & 1) * 255 : byteDist(rng));
+            }
+            
+            ColorMath::rgbRowToYCbCr(ColorMath::RowKernel::Reference, rgb.data(),
+                                     &expected[0], &expected[maxCount], &expected[2 * maxCount], count);
+            ColorMath::rgbRowToYCbCr(kernel, rgb.data(),
+                                     &actual[0], &actual[maxCount], &actual[2 * maxCount], count);
+            
+            for (int c = 0; c < 3; c++) {
+                for (int i = 0; i < count; i++) {
+                    mismatches += expected[c * maxCount + i] != actual[c * maxCount + i];
+                }
+            }
+        }
+        
+        cout << "Color kernel " << ColorMath::rowKernelName(kernel) << " vs scalar: "
+             << mismatches << " mismatches" << (mismatches == 0 ? " [OK]" : " [FAILED]") << endl;
+        passed = passed && mismatches == 0;
+    }
+    
+    return passed;
+}
+
+// Проверка структуры JFIF: обход сегментов от SOI до SOS, затем скан и EOI;
+// JfifReader отклоняет тот же поток с заголовком кадра, отличным от baseline, и с нулевым размером кадра
+bool checkJfifStream() {
+    auto image = RgbImage::createTestImage(37, 29);
+    JpegEncoder encoder(make_unique<SequentialColorConverter>(),
+                        make_unique<SequentialBlockProcessor>(make_unique<SequentialDctTransform>(),
+                                                              make_unique<SequentialQuantizer>()),
+                        make_unique<SequentialHuffmanEncoder>());
+    MemorySink sink;
+    encoder.encode(image, sink);
+    const auto& bytes = sink.getData();
+    
+    vector<int> markers;
+    bool valid = bytes.size() > 4 && bytes[0] == 0xFF && bytes[1] == JpegFormat::SOI &&
+                 bytes[bytes.size() - 2] == 0xFF && bytes.back() == JpegFormat::EOI;
+    size_t pos = 2;
+    while (valid && pos + 4 <= bytes.size()) {
+        if (bytes[pos] != 0xFF) {
+            valid = false;
+            break;
+        }
+        int marker = bytes[pos + 1];
+        size_t length = (bytes[pos + 2] << 8) | bytes[pos + 3];
+        markers.push_back(marker);
+        pos += 2 + length;
+        if (marker == JpegFormat::SOS) {
+            break;
+        }
+    }
+    
+    vector<int> expected = {JpegFormat::APP0, JpegFormat::DQT, JpegFormat::SOF0, JpegFormat::DHT, JpegFormat::SOS};
+    
+    // В скане 0xFF допустим только как 0xFF00 (byte stuffing)
+    for (size_t i = pos; valid && i + 2 < bytes.size(); i++) {
+        if (bytes[i] == 0xFF && bytes[i + 1] != 0x00) {
+            valid = false;
+        }
+    }
+    valid = valid && markers == expected;
+    
+    // Кадры кроме baseline SOF0 отклоняются на своём маркере, а не на SOS
+    auto rejected = [](const vector<unsigned char>& stream, const string& message) {
+        try {
+            JfifReader::read(stream);
+        } catch (const runtime_error& e) {
+            return message == e.what();
+        }
+        return false;
+    };
+    size_t sof = 2;
+    while (sof + 4 <= bytes.size() && bytes[sof + 1] != JpegFormat::SOF0) {
+        sof += 2 + ((bytes[sof + 2] << 8) | bytes[sof + 3]);
+    }
+    valid = valid && sof + 4 <= bytes.size();
+    for (int marker : {0xC1, 0xC2, 0xC3, 0xC9, 0xCF}) {
+        if (valid) {
+            vector<unsigned char> frame = bytes;
+            frame[sof + 1] = static_cast<unsigned char>(marker);
+            valid = rejected(frame, "Only baseline SOF0 frames are supported");
+        }
+    }
+    // Нулевые высота (форма с DNL) и ширина в SOF0
+    for (size_t field : {sof + 5, sof + 7}) {
+        if (valid) {
+            vector<unsigned char> frame = bytes;
+            frame[field] = 0;
+            frame[field + 1] = 0;
+            valid = rejected(frame, "Frame size must be positive (DNL is not supported)");
+        }
+    }
+    
+    cout << "JFIF stream (" << bytes.size() << " bytes): "
+         << (valid ? "SOI APP0 DQT SOF0 DHT SOS ... EOI [OK]" : "invalid marker layout [FAILED]") << endl;
+    return valid;
+}
+
+// Круговая проверка энтропийного кодирования: JFIF -> JfifReader -> decodeScan должен вернуть
+// те же коэффициенты, а decode() - то же изображение, что и decodeFromBlocks()
+bool checkHuffmanRoundTrip() {
+    auto image = RgbImage::createTestImage(75, 53);
+    vector<QuantizedBlock> blocks;
+    auto innerProc = make_unique<SequentialBlockProcessor>(make_unique<SequentialDctTransform>(),
+                                                           make_unique<SequentialQuantizer>());
+    JpegEncoder encoder(make_unique<SequentialColorConverter>(),
+                        make_unique<BlockCapturingProcessor>(move(innerProc), &blocks),
+                        make_unique<SequentialHuffmanEncoder>());
+    MemorySink sink;
+    encoder.encode(image, sink);
+    
+    auto parsed = JfifReader::read(sink.getData());
+    auto decoder = createJpegDecoder(parsed.quantTables);
+    auto decodedBlocks = decoder->decodeScan(parsed);
+    
+    auto key = [](const QuantizedBlock& b) {
+        return make_tuple(b.getComponent(), b.getBlockY(), b.getBlockX());
+    };
+    auto byPosition = [&](const QuantizedBlock& a, const QuantizedBlock& b) { return key(a) < key(b); };
+    sort(blocks.begin(), blocks.end(), byPosition);
+    sort(decodedBlocks.begin(), decodedBlocks.end(), byPosition);
+    
+    size_t mismatches = blocks.size() == decodedBlocks.size() ? 0 : max(blocks.size(), decodedBlocks.size());
+    for (size_t i = 0; mismatches == 0 && i < blocks.size(); i++) {
+        if (key(blocks[i]) != key(decodedBlocks[i]) ||
+            memcmp(blocks[i].getCoefficients().data, decodedBlocks[i].getCoefficients().data,
+                   sizeof(CoeffBlock::data)) != 0) {
+            mismatches++;
+        }
+    }
+    
+    auto fromStream = decoder->decode(parsed);
+    auto fromBlocks = decoder->decodeFromBlocks(blocks, image.getWidth(), image.getHeight());
+    for (int y = 0; y < image.getHeight(); y++) {
+        if (memcmp(fromStream.row(y), fromBlocks.row(y), image.getWidth() * 3) != 0) {
+            mismatches++;
+        }
+    }
+    
+    // DHT с избытком кодов одной длины (три кода длины 1; код длины 1 и три длины 2) отвергается
+    // до построения таблицы быстрого поиска
+    for (int longer : {0, 1}) {
+        HuffmanSpec oversubscribed;
+        oversubscribed.counts[0] = longer ? 1 : 3;
+        oversubscribed.counts[1] = longer ? 3 : 0;
+        oversubscribed.symbols = {0, 1, 2, 3};
+        oversubscribed.symbols.resize(longer ? 4 : 3);
+        JpegEncodedData malformed = parsed;
+        malformed.dcLuminanceTable = oversubscribed;
+        try {
+            decoder->decode(malformed);
+            mismatches++;
+        } catch (const invalid_argument&) {
+        }
+    }
+    
+    cout << "Huffman round trip (" << blocks.size() << " blocks): " << mismatches << " mismatches"
+         << (mismatches == 0 ? " [OK]" : " [FAILED]") << endl;
+    return mismatches == 0;
+}
+
+// Пул потоков: parallelFor покрывает диапазон ровно один раз, вложенный parallelFor
+// не блокируется, а исключение из задачи доходит до вызывающего
+bool checkThreadPool() {
+    ThreadPool& pool = ThreadPool::shared();
+    vector<int> hits(10000, 0);
+    pool.parallelFor(0, 100, 7, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++) {
+            pool.parallelFor(row * 100, row * 100 + 100, 16, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; i++) {
+                    hits[i]++;
+                }
+            });
+        }
+    });
+    bool passed = count(hits.begin(), hits.end(), 1) == static_cast<long>(hits.size());
+    
+    bool rethrown = false;
+    try {
+        pool.parallelFor(0, 64, 1, [](size_t begin, size_t) {
+            if (begin == 42) {
+                throw runtime_error("task failure");
+            }
+        });
+    } catch (const runtime_error&) {
+        rethrown = true;
+    }
+    passed = passed && rethrown;
+    
+    cout << "Thread pool (" << pool.getThreadCount() << " workers): nested parallelFor and exception propagation"
+         << (passed ? " [OK]" : " [FAILED]") << endl;
+    return passed;
+}
+
+// Интервалы перезапуска: оба энкодера дают одинаковый поток с RSTn, а параллельное декодирование
+// сегментов совпадает с декодированием того же изображения без маркеров
+bool checkRestartIntervals() {
+    auto image = RgbImage::createTestImage(75, 53);
+    auto makeEncoder = [](unique_ptr<IHuffmanEncoder> huffman) {
+        return JpegEncoder(make_unique<SequentialColorConverter>(),
+                           make_unique<SequentialBlockProcessor>(make_unique<SequentialDctTransform>(),
+                                                                 make_unique<SequentialQuantizer>()),
+                           move(huffman));
+    };
+    
+    MemorySink plainSink, sequentialSink, pipelineSink;
+    makeEncoder(make_unique<SequentialHuffmanEncoder>()).encode(image, plainSink);
+    makeEncoder(make_unique<SequentialHuffmanEncoder>(3)).encode(image, sequentialSink);
+    makeEncoder(make_unique<PipelineHuffmanEncoder>(3)).encode(image, pipelineSink);
+    
+    auto plain = JfifReader::read(plainSink.getData());
+    auto segmented = JfifReader::read(sequentialSink.getData());
+    auto decoder = createJpegDecoder(plain.quantTables);
+    auto expected = decoder->decode(plain);
+    decoder->setThreadCount(4);
+    auto actual = decoder->decode(segmented);
+    
+    size_t mismatches = 0;
+    for (int y = 0; y < image.getHeight(); y++) {
+        if (memcmp(expected.row(y), actual.row(y), image.getWidth() * 3) != 0) {
+            mismatches++;
+        }
+    }
+    if (sequentialSink.getData() != pipelineSink.getData() || segmented.restartInterval != 3 ||
+        decoder->decodeScan(segmented).size() != decoder->decodeScan(plain).size()) {
+        mismatches++;
+    }
+    
+    // Скан, обрезанный после второго RSTn: оставшиеся MCU не покрыты интервалами, декодер обязан отказать
+    JpegEncodedData truncated = segmented;
+    int markers = 0;
+    for (size_t i = 0; i + 1 < truncated.compressedData.size(); i++) {
+        if (truncated.compressedData[i] == 0xFF && (truncated.compressedData[i + 1] & 0xF8) == JpegFormat::RST0 &&
+            ++markers == 2) {
+            truncated.compressedData.resize(i + 2);
+            break;
+        }
+    }
+    try {
+        decoder->decode(truncated);
+        mismatches++;
+    } catch (const runtime_error&) {
+    }
+    
+    cout << "Restart intervals (3 MCU, " << sequentialSink.getData().size() << " bytes): " << mismatches
+         << " mismatches" << (mismatches == 0 ? " [OK]" : " [FAILED]") << endl;
+    return mismatches == 0;
+}
+
+// Параллельное энтропийное кодирование: поток не зависит от числа потоков и совпадает
+// с последовательным энкодером при том же интервале перезапуска
+bool checkParallelEntropyCoding() {
+    auto image = RgbImage::createTestImage(150, 77);
+    SequentialBlockProcessor processor(make_unique<SequentialDctTransform>(), make_unique<SequentialQuantizer>());
+    auto blocks = processor.processBlocks(convertForEncoding(image, ChromaSubsampling::Yuv420));
+    const auto& table = processor.getQuantTable();
+    
+    int mcusX = JpegFormat::mcuLayout(image.getWidth(), image.getHeight(), ChromaSubsampling::Yuv420).mcusX;
+    auto reference = SequentialHuffmanEncoder(mcusX).encode(blocks, image.getWidth(), image.getHeight(), table);
+    
+    size_t mismatches = 0;
+    for (int threads : {1, 2, 3, 7}) {
+        auto encoded = MultiThreadHuffmanEncoder(threads).encode(blocks, image.getWidth(), image.getHeight(), table);
+        if (encoded.compressedData != reference.compressedData || encoded.restartInterval != mcusX) {
+            mismatches++;
+        }
+    }
+    
+    cout << "Parallel entropy coding (" << reference.compressedData.size() << " bytes, 1-7 threads): "
+         << mismatches << " mismatches" << (mismatches == 0 ? " [OK]" : " [FAILED]") << endl;
+    return mismatches == 0;
+}
+
+// Потоковый кодер: строки подаются неровными порциями, коэффициенты скана совпадают
+// с пакетным SequentialBlockProcessor при любом прореживании, а DQT содержит таблицы, которыми квантовали
+bool checkStreamingEncoder() {
+    auto image = RgbImage::createTestImage(75, 53);
+    int quality = 75;
+    
+    auto key = [](const QuantizedBlock& b) {
+        return make_tuple(b.getComponent(), b.getBlockY(), b.getBlockX());
+    };
+    auto byPosition = [&](const QuantizedBlock& a, const QuantizedBlock& b) { return key(a) < key(b); };
+    
+    size_t mismatches = 0;
+    size_t totalBytes = 0;
+    for (auto mode : {ChromaSubsampling::Yuv444, ChromaSubsampling::Yuv422, ChromaSubsampling::Yuv420}) {
+        SequentialBlockProcessor processor(make_unique<SequentialDctTransform>(), make_unique<SequentialQuantizer>(quality));
+        auto blocks = processor.processBlocks(convertForEncoding(image, mode));
+        
+        MemorySink sink;
+        StreamingJpegEncoder encoder(sink, make_unique<SequentialDctTransform>());
+        encoder.begin(image.getWidth(), image.getHeight(), quality, 2, mode);
+        for (int y = 0; y < image.getHeight(); ) {
+            int rows = min(7, image.getHeight() - y);
+            encoder.writeScanlines(image.row(y), rows, image.getStride());
+            y += rows;
+        }
+        encoder.finish();
+        totalBytes += sink.getData().size();
+        
+        auto parsed = JfifReader::read(sink.getData());
+        auto decoded = createJpegDecoder(parsed.quantTables)->decodeScan(parsed);
+        sort(blocks.begin(), blocks.end(), byPosition);
+        sort(decoded.begin(), decoded.end(), byPosition);
+        
+        if (blocks.size() != decoded.size()) {
+            mismatches += max(blocks.size(), decoded.size());
+            continue;
+        }
+        for (size_t i = 0; i < blocks.size(); i++) {
+            if (key(blocks[i]) != key(decoded[i]) ||
+                memcmp(blocks[i].getCoefficients().data, decoded[i].getCoefficients().data,
+                       sizeof(CoeffBlock::data)) != 0) {
+                mismatches++;
+            }
+        }
+        if (*parsed.quantTables != *encoder.getQuantTable() || parsed.subsampling != mode) {
+            mismatches++;
+        }
+    }
+    
+    cout << "Streaming encoder (" << totalBytes << " bytes, 7-row chunks, 4:4:4/4:2:2/4:2:0): " << mismatches
+         << " mismatches" << (mismatches == 0 ? " [OK]" : " [FAILED]") << endl;
+    return mismatches == 0;
+}
+
+// Слитый обработчик MCU обязан выдавать те же блоки в том же порядке, что и раздельные стадии
+bool checkFusedMcuProcessor() {
+    size_t mismatches = 0;
+    size_t checked = 0;
+    for (auto [width, height] : {make_pair(75, 53), make_pair(32, 32), make_pair(5, 3), make_pair(17, 40)}) {
+        auto image = RgbImage::createTestImage(width, height);
+        for (auto mode : {ChromaSubsampling::Yuv444, ChromaSubsampling::Yuv422, ChromaSubsampling::Yuv420}) {
+            SequentialBlockProcessor processor(make_unique<SequentialDctTransform>(), make_unique<SequentialQuantizer>(75));
+            auto expected = processor.processBlocks(convertForEncoding(image, mode));
+            
+            for (int threads : {1, 3}) {
+                FusedMcuProcessor fused(make_unique<SequentialDctTransform>(), make_unique<SequentialQuantizer>(75), threads);
+                auto actual = fused.processImage(image, mode);
+                checked += actual.size();
+                
+                if (actual.size() != expected.size()) {
+                    mismatches += max(actual.size(), expected.size());
+                    continue;
+                }
+                for (size_t i = 0; i < actual.size(); i++) {
+                    const auto& a = actual[i];
+                    const auto& e = expected[i];
+                    if (a.getComponent() != e.getComponent() || a.getBlockX() != e.getBlockX() ||
+                        a.getBlockY() != e.getBlockY() ||
+                        memcmp(a.getCoefficients().data, e.getCoefficients().data, sizeof(CoeffBlock::data)) != 0) {
+                        mismatches++;
+                    }
+                }
+            }
+        }
+    }
+    
+    cout << "Fused MCU processor (" << checked << " blocks, 1 and 3 threads): " << mismatches
+         << " mismatches" << (mismatches == 0 ? " [OK]" : " [FAILED]") << endl;
+    return mismatches == 0;
+}
+
+// Прореживание цветности: SIMD-ядра совпадают со скалярным, плоский цвет переживает усреднение без
+// изменений, а каждый режим проходит JFIF -> декодер с теми же факторами и не хуже по качеству следующего
+bool checkChromaSubsampling() {
+    mt19937 rng(2024);
+    uniform_int_distribution<int> byteDist(0, 255);
+    
+    size_t mismatches = 0;
+    const int maxCount = 131;
+    vector<unsigned char> row0(maxCount), row1(maxCount), expected(maxCount), actual(maxCount);
+    for (auto kernel : {ColorMath::RowKernel::Sse41, ColorMath::RowKernel::Avx2}) {
+        if (!ColorMath::isRowKernelSupported(kernel)) {
+            continue;
+        }
+        for (int test = 0; test < 200; test++) {
+            int count = 1 + test % maxCount;
+            for (int i = 0; i < maxCount; i++) {
+                row0[i] = static_cast<unsigned char>(test < 20 ? (byteDist(rng) & 1) * 255 : byteDist(rng));
+                row1[i] = static_cast<unsigned char>(byteDist(rng));
+            }
+            ColorMath::downsampleRow(ColorMath::RowKernel::Reference, row0.data(), row1.data(), expected.data(), count);
+            ColorMath::downsampleRow(kernel, row0.data(), row1.data(), actual.data(), count);
+            mismatches += !equal(expected.begin(), expected.begin() + (count + 1) / 2, actual.begin());
+        }
+    }
+    
+    // Плоский цвет: среднее одинаковых сэмплов обязано его сохранить при любом смещении округления
+    YCbCrImage flat(37, 21);
+    for (int c = 0; c < 3; c++) {
+        flat.plane(c).fill(static_cast<unsigned char>(90 + 40 * c));
+    }
+    flat.downsampleChroma(ChromaSubsampling::Yuv420);
+    for (int c = 1; c <= 2; c++) {
+        const ImagePlane& plane = flat.plane(c);
+        mismatches += plane.getWidth() != 19 || plane.getHeight() != 11;
+        for (int y = 0; y < plane.getHeight(); y++) {
+            for (int x = 0; x < plane.getWidth(); x++) {
+                mismatches += plane.at(x, y) != 90 + 40 * c;
+            }
+        }
+    }
+    
+    // Круговой путь по всем режимам: факторы в SOF0, поток против decodeFromBlocks, PSNR не растёт с прореживанием
+    auto image = RgbImage::createTestImage(75, 53);
+    vector<double> psnrs;
+    for (auto mode : {ChromaSubsampling::Yuv444, ChromaSubsampling::Yuv422, ChromaSubsampling::Yuv420}) {
+        vector<QuantizedBlock> blocks;
+        auto innerProc = make_unique<SequentialBlockProcessor>(make_unique<SequentialDctTransform>(),
+                                                               make_unique<SequentialQuantizer>());
+        JpegEncoder encoder(make_unique<SequentialColorConverter>(),
+                            make_unique<BlockCapturingProcessor>(move(innerProc), &blocks),
+                            make_unique<SequentialHuffmanEncoder>(2), mode);
+        MemorySink sink;
+        encoder.encode(image, sink);
+        
+        auto parsed = JfifReader::read(sink.getData());
+        auto decoder = createJpegDecoder(parsed.quantTables);
+        auto fromStream = decoder->decode(parsed);
+        auto fromBlocks = decoder->decodeFromBlocks(blocks, image.getWidth(), image.getHeight(), mode);
+        mismatches += parsed.subsampling != mode;
+        for (int y = 0; y < image.getHeight(); y++) {
+            mismatches += memcmp(fromStream.row(y), fromBlocks.row(y), image.getWidth() * 3) != 0;
+        }
+        psnrs.push_back(ImageMetrics::peakSignalToNoiseRatio(image, fromStream));
+    }
+    mismatches += psnrs[0] + 1e-9 < psnrs[1] || psnrs[1] + 1e-9 < psnrs[2];
+    
+    cout << "Chroma subsampling (PSNR 4:4:4 " << fixed << setprecision(1) << psnrs[0] << ", 4:2:2 " << psnrs[1]
+         << ", 4:2:0 " << psnrs[2] << " dB): " << mismatches << " mismatches"
+         << (mismatches == 0 ? " [OK]" : " [FAILED]") << endl;
+    cout << defaultfloat;
+    return mismatches == 0;
+}
+
+// Сессия выдаёт те же файлы, что и граф из FusedMcuProcessor и SequentialHuffmanEncoder, собранный
+// под каждое изображение, - и в пакете (мелкие параллельно, крупные по одному), и поштучно.
+// Заодно замер: пакет мелких изображений через сессию против нового графа на каждое изображение
+bool checkEncoderSession() {
+    EncoderSessionOptions options;
+    options.quality = 75;
+    options.subsampling = ChromaSubsampling::Yuv420;
+    options.restartInterval = 2;
+    options.numThreads = 3;
+    options.intraImagePixels = 64 * 64;
+    EncoderSession session(options);
+    
+    auto encodePerCall = [&](const RgbImage& image) {
+        auto quant = make_unique<SequentialQuantizer>(options.quality);
+        auto table = quant->getQuantTable();
+        FusedMcuProcessor processor(make_unique<FastDctTransform>(), move(quant));
+        SequentialHuffmanEncoder huffman(options.restartInterval);
+        auto blocks = processor.processImage(image, options.subsampling);
+        MemorySink sink;
+        JfifWriter::write(huffman.encode(blocks, image.getWidth(), image.getHeight(), table, options.subsampling), sink);
+        return sink.takeData();
+    };
+    
+    vector<RgbImage> images;
+    for (auto [width, height] : {make_pair(75, 53), make_pair(5, 3), make_pair(100, 90), make_pair(17, 40),
+                                 make_pair(64, 64), make_pair(33, 9)}) {
+        images.push_back(RgbImage::createTestImage(width, height));
+    }
+    
+    size_t mismatches = 0;
+    auto batch = session.encodeBatch(images);
+    for (size_t i = 0; i < images.size(); i++) {
+        auto expected = encodePerCall(images[i]);
+        MemorySink single;
+        session.encode(images[i], single);
+        mismatches += batch[i] != expected;
+        mismatches += single.getData() != expected;
+        mismatches += *JfifReader::read(batch[i]).quantTables != *session.getQuantTable();
+    }
+    
+    // Замер: одинаковые мелкие изображения, как в потоке загрузки
+    vector<RgbImage> thumbnails(400, RgbImage::createTestImage(48, 32));
+    auto start = high_resolution_clock::now();
+    size_t perCallBytes = 0;
+    for (const auto& image : thumbnails) {
+        perCallBytes += encodePerCall(image).size();
+    }
+    auto middle = high_resolution_clock::now();
+    size_t sessionBytes = 0;
+    for (const auto& file : session.encodeBatch(thumbnails)) {
+        sessionBytes += file.size();
+    }
+    auto end = high_resolution_clock::now();
+    mismatches += perCallBytes != sessionBytes;
+    
+    cout << "Encoder session (" << images.size() << " images; " << thumbnails.size() << " thumbnails: "
+         << fixed << setprecision(1) << duration_cast<microseconds>(middle - start).count() / 1000.0 << " ms per-call graphs, "
+         << duration_cast<microseconds>(end - middle).count() / 1000.0 << " ms session): " << mismatches
+         << " mismatches" << (mismatches == 0 ? " [OK]" : " [FAILED]") << endl;
+    cout << defaultfloat;
+    return mismatches == 0;
+}
+
+// Арена: выравнивание, рост кусками и слияние при reset(); кодер Хаффмана с ареной и повторно
+// используемым результатом выдаёт те же байты, что и без них, а после прогрева арена не растёт
+bool checkScratchArena() {
+    size_t mismatches = 0;
+    
+    ScratchArena arena(256);
+    for (int round = 0; round < 3; round++) {
+        arena.reset();
+        for (size_t size : {1, 3, 64, 200, 1000, 7}) {
+            for (size_t alignment : {1, 8, 64}) {
+                auto* p = static_cast<unsigned char*>(arena.allocate(size, alignment));
+                mismatches += reinterpret_cast<uintptr_t>(p) % alignment != 0;
+                memset(p, 0xAB, size);
+            }
+        }
+    }
+    // Первый раунд вырастил арену, при первом reset() куски слились в один, дальше новых нет
+    size_t warmedUp = arena.getChunkAllocations();
+    arena.reset();
+    mismatches += arena.capacity() < 3 * (1 + 3 + 64 + 200 + 1000 + 7);
+    mismatches += arena.getChunkAllocations() != warmedUp;
+    
+    ScratchArena huffmanArena;
+    SequentialHuffmanEncoder plain(2);
+    SequentialHuffmanEncoder reusing(2, &huffmanArena);
+    JpegEncodedData reused;
+    size_t arenaChunks = 0;
+    for (int round = 0; round < 2; round++) {
+        for (auto [width, height] : {make_pair(75, 53), make_pair(5, 3), make_pair(100, 90), make_pair(33, 9)}) {
+            auto image = RgbImage::createTestImage(width, height);
+            for (auto mode : {ChromaSubsampling::Yuv444, ChromaSubsampling::Yuv420}) {
+                SequentialBlockProcessor processor(make_unique<SequentialDctTransform>(), make_unique<SequentialQuantizer>(75));
+                auto blocks = processor.processBlocks(convertForEncoding(image, mode));
+                auto table = QuantTable::forQuality(75);
+                
+                huffmanArena.reset();
+                auto expected = plain.encode(blocks, width, height, table, mode);
+                reusing.encode(blocks, width, height, table, mode, reused);
+                
+                MemorySink expectedSink, reusedSink;
+                JfifWriter::write(expected, expectedSink);
+                JfifWriter::write(reused, reusedSink);
+                mismatches += expectedSink.getData() != reusedSink.getData();
+            }
+        }
+        if (round == 0) {
+            arenaChunks = huffmanArena.getChunkAllocations();
+        }
+    }
+    mismatches += huffmanArena.getChunkAllocations() != arenaChunks;
+    
+    cout << "Scratch arena (" << huffmanArena.capacity() / 1024 << " KiB after warm-up, "
+         << huffmanArena.getChunkAllocations() << " chunk allocations): " << mismatches << " mismatches"
+         << (mismatches == 0 ? " [OK]" : " [FAILED]") << endl;
+    return mismatches == 0;
+}
+
+// PNM/PAM: 8-битный RGB читается как представление отображённого файла и кодируется так же, как
+// исходное изображение; серый, альфа и 16 бит приводятся к RGB; выход декодера переживает запись в PPM
+bool checkPnmIo() {
+    namespace fs = std::filesystem;
+    fs::path dir = fs::temp_directory_path() / ("jpegcpp-pnm-" + to_string(::getpid()));
+    fs::create_directories(dir);
+    auto writeRaw = [&](const string& name, const string& header, const vector<unsigned char>& raster) {
+        ofstream file(dir / name, ios::binary);
+        file << header;
+        file.write(reinterpret_cast<const char*>(raster.data()), raster.size());
+        return (dir / name).string();
+    };
+    
+    size_t mismatches = 0;
+    auto image = RgbImage::createTestImage(37, 21);
+    auto samePixels = [](const RgbImage& a, const RgbImage& b) {
+        if (a.getWidth() != b.getWidth() || a.getHeight() != b.getHeight()) {
+            return false;
+        }
+        for (int y = 0; y < a.getHeight(); y++) {
+            if (memcmp(a.row(y), b.row(y), a.getWidth() * 3) != 0) {
+                return false;
+            }
+        }
+        return true;
+    };
+    
+    // P6 -> представление без копирования, кодируется в те же байты
+    string ppm = (dir / "image.ppm").string();
+    PnmIo::save(image, ppm);
+    auto loaded = RgbImage::loadFromFile(ppm);
+    mismatches += !loaded.isView() || loaded.getStride() != 37 * 3 || !samePixels(image, loaded);
+    {
+        EncoderSession session;
+        MemorySink fromMemory, fromFile;
+        session.encode(image, fromMemory);
+        auto copy = loaded;
+        session.encode(copy, fromFile);
+        mismatches += fromMemory.getData() != fromFile.getData() || copy.row(0) != loaded.row(0);
+    }
+    
+    // PAM RGB -> тоже представление; PAM RGB_ALPHA, PGM с комментарием и 16-битный PPM -> преобразование
+    vector<unsigned char> rgb, rgba, gray, wide;
+    for (int y = 0; y < 21; y++) {
+        for (int x = 0; x < 37; x++) {
+            auto [r, g, b] = image.getPixel(x, y);
+            rgb.insert(rgb.end(), {r, g, b});
+            rgba.insert(rgba.end(), {r, g, b, 0x7F});
+            gray.push_back(r);
+            for (unsigned char v : {r, g, b}) {
+                wide.insert(wide.end(), {v, v}); // v * 257 в 16 битах = v при MAXVAL 65535
+            }
+        }
+    }
+    auto pam = PnmIo::load(writeRaw("rgb.pam", "P7\nWIDTH 37\nHEIGHT 21\nDEPTH 3\nMAXVAL 255\nTUPLTYPE RGB\nENDHDR\n", rgb));
+    auto alpha = PnmIo::load(writeRaw("rgba.pam", "P7\nWIDTH 37\nHEIGHT 21\nDEPTH 4\nMAXVAL 255\n"
+                                                  "TUPLTYPE RGB_ALPHA\nENDHDR\n", rgba));
+    auto grayImage = PnmIo::load(writeRaw("gray.pgm", "P5\n# comment\n37 21\n255\n", gray));
+    auto wideImage = PnmIo::load(writeRaw("wide.ppm", "P6 37 21 65535\n", wide));
+    mismatches += !pam.isView() || !samePixels(image, pam);
+    mismatches += alpha.isView() || !samePixels(image, alpha);
+    mismatches += !samePixels(image, wideImage);
+    for (int y = 0; y < 21; y++) {
+        for (int x = 0; x < 37; x++) {
+            auto [r, g, b] = grayImage.getPixel(x, y);
+            mismatches += r != get<0>(image.getPixel(x, y)) || g != r || b != r;
+        }
+    }
+    
+    // Обрезанный растр - ошибка, а не чтение за концом файла
+    bool truncatedRejected = false;
+    try {
+        PnmIo::load(writeRaw("short.ppm", "P6\n37 21\n255\n", vector<unsigned char>(rgb.begin(), rgb.end() - 1)));
+    } catch (const runtime_error&) {
+        truncatedRejected = true;
+    }
+    mismatches += !truncatedRejected;
+    
+    // Выход декодера в PPM и обратно
+    MemorySink jpeg;
+    JpegEncoder encoder(make_unique<SequentialColorConverter>(),
+                        make_unique<SequentialBlockProcessor>(make_unique<SequentialDctTransform>(),
+                                                              make_unique<SequentialQuantizer>()),
+                        make_unique<SequentialHuffmanEncoder>());
+    encoder.encode(loaded, jpeg);
+    auto parsed = JfifReader::read(jpeg.getData());
+    auto decoded = createJpegDecoder(parsed.quantTables)->decode(parsed);
+    string decodedPath = (dir / "decoded.ppm").string();
+    PnmIo::save(decoded, decodedPath);
+    mismatches += !samePixels(decoded, PnmIo::load(decodedPath));
+    
+    fs::remove_all(dir);
+    cout << "PNM/PAM input (mapped P6/P7 views, P5/RGBA/16-bit conversion, decoder output): " << mismatches
+         << " mismatches" << (mismatches == 0 ? " [OK]" : " [FAILED]") << endl;
+    return mismatches == 0;
+}
+
+// Гистограммы символов, собранные слитой стадией блоков (по задачам, с досчётом DC на границах строк MCU),
+// совпадают с проходом подсчёта по готовому скану (полным, без границы lastNonZero), и поток байт не меняется
+bool checkBlockStageHistograms() {
+    size_t mismatches = 0;
+    size_t cases = 0;
+    ThreadPool pool(3);
+    
+    for (auto [width, height] : {make_pair(75, 53), make_pair(5, 3), make_pair(100, 90), make_pair(33, 9), make_pair(200, 130)}) {
+        auto image = RgbImage::createTestImage(width, height);
+        for (auto mode : {ChromaSubsampling::Yuv444, ChromaSubsampling::Yuv422, ChromaSubsampling::Yuv420}) {
+            for (int interval : {0, 1, 3, 7}) {
+                for (int threads : {1, 4}) {
+                    FusedMcuProcessor processor(make_unique<FastDctTransform>(), make_unique<SequentialQuantizer>(75),
+                                                threads, pool);
+                    vector<QuantizedBlock> blocks;
+                    JpegFormat::SymbolHistogram histogram;
+                    processor.processImage(image, mode, blocks, interval, histogram);
+                    
+                    // Граница AC от квантователя доходит до блоков, по ней считают кодеры
+                    for (const auto& block : blocks) {
+                        int last = 0;
+                        for (int k = 1; k < 64; k++) {
+                            if (block.getCoefficients()[JpegFormat::zigzagOrder[k]] != 0) {
+                                last = k;
+                            }
+                        }
+                        mismatches += block.getLastNonZero() != last;
+                    }
+                    
+                    JpegFormat::SymbolHistogram expected;
+                    auto order = JpegFormat::interleaveBlocks(blocks, width, height, mode);
+                    int blocksPerMcu = JpegFormat::mcuLayout(width, height, mode).blocksPerMcu();
+                    int lastDc[3] = {0, 0, 0};
+                    for (size_t i = 0; i < order.size(); i++) {
+                        if (JpegFormat::startsRestartInterval(i, interval, blocksPerMcu)) {
+                            fill(begin(lastDc), end(lastDc), 0);
+                        }
+                        int component = order[i]->getComponent();
+                        int table = component == 0 ? 0 : 1;
+                        JpegFormat::countBlockSymbols(order[i]->getCoefficients(), lastDc[component],
+                                                      expected.dc[table], expected.ac[table]);
+                    }
+                    for (int table = 0; table < 2; table++) {
+                        mismatches += histogram.dc[table] != expected.dc[table] || histogram.ac[table] != expected.ac[table];
+                    }
+                    
+                    auto table = QuantTable::forQuality(75);
+                    SequentialHuffmanEncoder encoder(interval);
+                    JpegEncodedData counted, precomputed;
+                    encoder.encode(blocks, width, height, table, mode, counted);
+                    encoder.encode(blocks, width, height, table, mode, histogram, precomputed);
+                    mismatches += counted.compressedData != precomputed.compressedData;
+                    cases++;
+                }
+            }
+        }
+    }
+    
+    cout << "Block-stage symbol histograms (" << cases << " images/modes/intervals/threads): " << mismatches
+         << " mismatches" << (mismatches == 0 ? " [OK]" : " [FAILED]") << endl;
+    return mismatches == 0;
+}
+
+// Стандартные таблицы Annex K: коды, посчитанные при компиляции, совпадают с построенными по DHT;
+// однопроходный путь FusedMcuProcessor::encodeStandard даёт тот же скан, что кодер по готовым блокам,
+// а сессия со стандартными таблицами - тот же файл, что потоковый кодер
+bool checkStandardHuffmanTables() {
+    static_assert(JpegFormat::kStandardDcLuminanceCodes.length[0] == 2 &&
+                  JpegFormat::kStandardAcLuminanceCodes.code[0x00] == 0xA &&
+                  JpegFormat::kStandardAcChrominanceCodes.length[0xF0] == 10,
+                  "Annex K code tables must be computed at compile time");
+    size_t mismatches = 0;
+    
+    auto sameCodes = [](const HuffmanCodeTable& a, const HuffmanCodeTable& b) {
+        return memcmp(a.code, b.code, sizeof(a.code)) == 0 && memcmp(a.length, b.length, sizeof(a.length)) == 0;
+    };
+    mismatches += !sameCodes(JpegFormat::kStandardDcLuminanceCodes, HuffmanMath::buildCodeTable(JpegFormat::standardDcLuminance()));
+    mismatches += !sameCodes(JpegFormat::kStandardAcLuminanceCodes, HuffmanMath::buildCodeTable(JpegFormat::standardAcLuminance()));
+    mismatches += !sameCodes(JpegFormat::kStandardDcChrominanceCodes, HuffmanMath::buildCodeTable(JpegFormat::standardDcChrominance()));
+    mismatches += !sameCodes(JpegFormat::kStandardAcChrominanceCodes, HuffmanMath::buildCodeTable(JpegFormat::standardAcChrominance()));
+    
+    auto table = QuantTable::forQuality(75);
+    for (auto [width, height] : {make_pair(75, 53), make_pair(5, 3), make_pair(100, 90), make_pair(33, 9)}) {
+        auto image = RgbImage::createTestImage(width, height);
+        for (auto mode : {ChromaSubsampling::Yuv444, ChromaSubsampling::Yuv422, ChromaSubsampling::Yuv420}) {
+            for (int interval : {0, 1, 5}) {
+                FusedMcuProcessor processor(make_unique<FastDctTransform>(), make_unique<SequentialQuantizer>(75));
+                auto blocks = processor.processImage(image, mode);
+                auto expected = SequentialHuffmanEncoder(interval, nullptr, JpegFormat::HuffmanTables::Standard)
+                                    .encode(blocks, width, height, table, mode);
+                
+                BitWriter writer;
+                processor.encodeStandard(image, mode, interval, writer);
+                writer.padToByte();
+                mismatches += vector<unsigned char>(writer.data(), writer.data() + writer.size()) != expected.compressedData;
+                
+                // По строкам MCU в sink: те же байты
+                MemorySink sink;
+                BitWriter rowWriter;
+                processor.encodeStandard(image, mode, interval, rowWriter, &sink);
+                rowWriter.padToByte();
+                sink.write(rowWriter.data(), rowWriter.size());
+                mismatches += sink.getData() != expected.compressedData;
+            }
+        }
+    }
+    
+    // Сессия: мелкие изображения - однопроходный путь, крупное - параллельные строки MCU и кодер по блокам
+    EncoderSessionOptions options;
+    options.huffmanTables = JpegFormat::HuffmanTables::Standard;
+    options.restartInterval = 3;
+    options.intraImagePixels = 200 * 150;
+    EncoderSession standardSession(options);
+    options.huffmanTables = JpegFormat::HuffmanTables::Optimized;
+    EncoderSession optimizedSession(options);
+    
+    size_t standardBytes = 0;
+    size_t optimizedBytes = 0;
+    for (auto [width, height] : {make_pair(75, 53), make_pair(64, 64), make_pair(257, 190)}) {
+        auto image = RgbImage::createTestImage(width, height);
+        MemorySink streamed;
+        StreamingJpegEncoder streaming(streamed);
+        streaming.begin(width, height, 75, options.restartInterval, options.subsampling);
+        streaming.writeScanlines(image.row(0), height, image.getStride());
+        streaming.finish();
+        
+        MemorySink standard, optimized;
+        standardSession.encode(image, standard);
+        optimizedSession.encode(image, optimized);
+        mismatches += standard.getData() != streamed.getData();
+        standardBytes += standard.getData().size();
+        optimizedBytes += optimized.getData().size();
+    }
+    
+    cout << "Standard Huffman tables (constexpr codes, single-pass fused scan; optimized tables "
+         << fixed << setprecision(1) << 100.0 * (1.0 - static_cast<double>(optimizedBytes) / standardBytes)
+         << defaultfloat << "% smaller): " << mismatches << " mismatches" << (mismatches == 0 ? " [OK]" : " [FAILED]") << endl;
+    return mismatches == 0;
+}
+
+// OpenMP по строкам MCU: при любом расписании, порции и размещении блоки те же и в том же порядке,
+// что у SequentialBlockProcessor
+bool checkOpenMPTileSchedule() {
+    int previousThreads = omp_get_max_threads();
+    omp_set_num_threads(3);
+    
+    using Kind = OpenMPTileSchedule::Kind;
+    using Placement = OpenMPTileSchedule::Placement;
+    vector<OpenMPTileSchedule> schedules = {
+        {Kind::Static, 0, Placement::Environment}, {Kind::Static, 2, Placement::Close},
+        {Kind::Dynamic, 1, Placement::Environment}, {Kind::Dynamic, 3, Placement::Spread},
+        {Kind::Guided, 1, Placement::Environment}, {Kind::TaskLoop, 1, Placement::Environment},
+        {Kind::TaskLoop, 4, Placement::Close}
+    };
+    
+    size_t mismatches = 0;
+    size_t checked = 0;
+    for (auto [width, height] : {make_pair(75, 53), make_pair(5, 3), make_pair(100, 90), make_pair(17, 40)}) {
+        auto image = RgbImage::createTestImage(width, height);
+        for (auto mode : {ChromaSubsampling::Yuv444, ChromaSubsampling::Yuv422, ChromaSubsampling::Yuv420}) {
+            auto ycbcr = convertForEncoding(image, mode);
+            SequentialBlockProcessor reference(make_unique<FastDctTransform>(), make_unique<SequentialQuantizer>(75));
+            auto expected = reference.processBlocks(ycbcr);
+            
+            for (const auto& schedule : schedules) {
+                OpenMPBlockProcessor processor(make_unique<FastDctTransform>(), make_unique<OpenMPQuantizer>(75), schedule);
+                auto actual = processor.processBlocks(ycbcr);
+                checked += actual.size();
+                
+                if (actual.size() != expected.size()) {
+                    mismatches += max(actual.size(), expected.size());
+                    continue;
+                }
+                for (size_t i = 0; i < actual.size(); i++) {
+                    const auto& a = actual[i];
+                    const auto& e = expected[i];
+                    if (a.getComponent() != e.getComponent() || a.getBlockX() != e.getBlockX() ||
+                        a.getBlockY() != e.getBlockY() ||
+                        memcmp(a.getCoefficients().data, e.getCoefficients().data, sizeof(CoeffBlock::data)) != 0) {
+                        mismatches++;
+                    }
+                }
+            }
+        }
+    }
+    omp_set_num_threads(previousThreads);
+    
+    cout << "OpenMP tile schedules (" << checked << " blocks; static/dynamic/guided/taskloop, 3 threads): "
+         << mismatches << " mismatches" << (mismatches == 0 ? " [OK]" : " [FAILED]") << endl;
+    return mismatches == 0;
+}
+
+// Квантование умножением на обратную величину: на коэффициентах, кратных 1/16, - точное деление
+// с округлением от нуля для всех шагов 1..255; на настоящих блоках DCT все ядра совпадают со скалярным,
+// от round(dct / q) отличаются не больше чем на 1, индекс последнего ненулевого верен,
+// а кодирование блока по этому индексу даёт те же биты, что и полный просмотр
+bool checkReciprocalQuantizer() {
+    vector<QuantMath::Kernel> kernels;
+    for (auto kernel : {QuantMath::Kernel::Reference, QuantMath::Kernel::Sse41, QuantMath::Kernel::Avx2}) {
+        if (QuantMath::isKernelSupported(kernel)) {
+            kernels.push_back(kernel);
+        }
+    }
+    
+    size_t mismatches = 0;
+    QuantMath::ReciprocalTable reciprocals;
+    FloatBlock dctBlock;
+    CoeffBlock quantized;
+    for (int step = 1; step <= 255; step++) {
+        QuantMath::buildReciprocalTable(vector<vector<int>>(8, vector<int>(8, step)), reciprocals);
+        int divisor = step << QuantMath::kFractionBits;
+        for (int first = -16384; first <= 16384; first += 64) {
+            for (int i = 0; i < 64; i++) {
+                dctBlock[i] = static_cast<float>(first + i) / (1 << QuantMath::kFractionBits);
+            }
+            for (auto kernel : kernels) {
+                QuantMath::quantizeBlock(kernel, reciprocals, dctBlock, quantized);
+                for (int i = 0; i < 64; i++) {
+                    int n = first + i;
+                    int expected = (abs(n) + divisor / 2) / divisor;
+                    mismatches += quantized[i] != (n < 0 ? -expected : expected);
+                }
+            }
+        }
+    }
+    
+    mt19937 rng(2323);
+    uniform_int_distribution<int> noise(-60, 60);
+    float aanScale[64];
+    DctMath::aanOutputScale(aanScale);
+    size_t coefficients = 0;
+    size_t roundingDifferences = 0;
+    for (int quality : {10, 50, 75, 95, 100}) {
+        // Вход - ненормированный выход быстрого DCT, нормировка AAN сложена в таблицу
+        const auto& table = QuantTable::forQuality(quality)->getTable(QuantTable::Luma);
+        QuantMath::buildReciprocalTable(table, reciprocals, QuantMath::DctScaling::Aan);
+        
+        for (int test = 0; test < 2000; test++) {
+            // Гладкие блоки с шумом разной силы: от пустых AC до заполненных до конца
+            FloatBlock samples;
+            int base = test % 256 - 128;
+            int amplitude = test % 7;
+            for (int i = 0; i < 8; i++) {
+                for (int j = 0; j < 8; j++) {
+                    int value = base + 3 * (i - j) + amplitude * noise(rng) / 6;
+                    samples.at(i, j) = static_cast<float>(max(-128, min(127, value)));
+                }
+            }
+            FastDctTransform().forwardDct(samples, dctBlock);
+            
+            CoeffBlock expected;
+            int expectedLast = QuantMath::quantizeBlock(QuantMath::Kernel::Reference, reciprocals, dctBlock, expected);
+            for (auto kernel : kernels) {
+                CoeffBlock actual;
+                int last = QuantMath::quantizeBlock(kernel, reciprocals, dctBlock, actual);
+                mismatches += last != expectedLast || memcmp(actual.data, expected.data, sizeof(actual.data)) != 0;
+            }
+            
+            int naiveLast = 0;
+            for (int k = 1; k < 64; k++) {
+                if (expected[JpegFormat::zigzagOrder[k]] != 0) {
+                    naiveLast = k;
+                }
+            }
+            mismatches += naiveLast != expectedLast;
+            
+            for (int i = 0; i < 8; i++) {
+                for (int j = 0; j < 8; j++) {
+                    int exact = static_cast<int>(round(dctBlock.at(i, j) * aanScale[i * 8 + j] / table[i][j]));
+                    mismatches += abs(exact - expected.at(i, j)) > 1;
+                    roundingDifferences += exact != expected.at(i, j);
+                    coefficients++;
+                }
+            }
+            
+            BitWriter full, hinted;
+            int fullDc = 0, hintedDc = 0;
+            EntropyCoder::encodeBlock(full, expected, fullDc, JpegFormat::kStandardDcLuminanceCodes,
+                                      JpegFormat::kStandardAcLuminanceCodes);
+            EntropyCoder::encodeBlock(hinted, expected, hintedDc, JpegFormat::kStandardDcLuminanceCodes,
+                                      JpegFormat::kStandardAcLuminanceCodes, expectedLast);
+            full.padToByte();
+            hinted.padToByte();
+            mismatches += full.size() != hinted.size() || memcmp(full.data(), hinted.data(), full.size()) != 0;
+        }
+    }
+    
+    cout << "Reciprocal quantizer (" << QuantMath::kernelName(QuantMath::activeKernel()) << ", steps 1-255; "
+         << roundingDifferences << " of " << coefficients << " coefficients off round() by 1): "
+         << mismatches << " mismatches" << (mismatches == 0 ? " [OK]" : " [FAILED]") << endl;
+    return mismatches == 0;
+}
+
+// Таблицы квантования по качеству: яркость и цветность по Annex K.1/K.2, кэш отдаёт один объект на качество
+// и при одновременных запросах из нескольких потоков. JpegEncoder и PipelineJpegEncoder пишут в DQT таблицы,
+// которыми действительно квантовали: поток декодируется так же, как блоки с таблицами кодера
+bool checkQuantTables() {
+    size_t mismatches = 0;
+    
+    auto base = QuantTable::forQuality(50);
+    for (int i = 0; i < 64; i++) {
+        mismatches += base->getTable(QuantTable::Luma)[i / 8][i % 8] != QuantTable::annexKLuminance[i];
+        mismatches += base->getTable(QuantTable::Chroma)[i / 8][i % 8] != QuantTable::annexKChrominance[i];
+    }
+    // Масштаб по IJG целочисленный: при q = 30 шаг 61 даёт (61 * 166 + 50) / 100 = 101, а не 102
+    mismatches += QuantTable::forQuality(30)->getTable(QuantTable::Luma)[0][7] != 101;
+    mismatches += QuantTable::forQuality(10)->getTable(QuantTable::Chroma)[0][0] != 85;
+    
+    vector<shared_ptr<const QuantTable>> concurrent(4 * 100);
+    vector<thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&concurrent, t]() {
+            for (int quality = 1; quality <= 100; quality++) {
+                concurrent[t * 100 + quality - 1] = QuantTable::forQuality(quality);
+            }
+        });
+    }
+    for (auto& worker : threads) {
+        worker.join();
+    }
+    for (size_t i = 0; i < concurrent.size(); i++) {
+        int quality = 1 + static_cast<int>(i % 100);
+        mismatches += concurrent[i] != QuantTable::forQuality(quality) || concurrent[i]->getQuality() != quality;
+    }
+    
+    auto image = RgbImage::createTestImage(75, 53);
+    vector<double> psnrs;
+    for (int quality : {30, 50, 90}) {
+        auto used = QuantTable::forQuality(quality);
+        vector<QuantizedBlock> blocks;
+        auto innerProc = make_unique<SequentialBlockProcessor>(make_unique<SequentialDctTransform>(),
+                                                               make_unique<SequentialQuantizer>(quality));
+        JpegEncoder encoder(make_unique<SequentialColorConverter>(),
+                            make_unique<BlockCapturingProcessor>(move(innerProc), &blocks),
+                            make_unique<SequentialHuffmanEncoder>());
+        PipelineJpegEncoder pipeline(make_unique<PipelineColorConverter>(), make_unique<PipelineDctTransform>(),
+                                     make_unique<PipelineQuantizer>(quality), make_unique<PipelineHuffmanEncoder>(), 2);
+        MemorySink sink, pipelineSink;
+        encoder.encode(image, sink);
+        pipeline.encode(image, pipelineSink);
+        
+        auto parsed = JfifReader::read(sink.getData());
+        mismatches += *parsed.quantTables != *used;
+        mismatches += *JfifReader::read(pipelineSink.getData()).quantTables != *used;
+        
+        auto fromStream = createJpegDecoder(parsed.quantTables)->decode(parsed);
+        auto fromBlocks = createJpegDecoder(used)->decodeFromBlocks(blocks, image.getWidth(), image.getHeight());
+        for (int y = 0; y < image.getHeight(); y++) {
+            mismatches += memcmp(fromStream.row(y), fromBlocks.row(y), image.getWidth() * 3) != 0;
+        }
+        psnrs.push_back(ImageMetrics::peakSignalToNoiseRatio(image, fromStream));
+        
+    }
+    mismatches += !(psnrs[0] < psnrs[1] && psnrs[1] < psnrs[2]);
+    
+    // Cb и Cr с разными таблицами декодер не поддерживает: такой SOF0 отвергается при чтении
+    MemorySink sink;
+    createJpegEncoder(75)->encode(image, sink);
+    auto stream = sink.getData();
+    bool rejected = false;
+    for (size_t pos = 2; pos + 1 < stream.size(); pos++) {
+        if (stream[pos] == 0xFF && stream[pos + 1] == JpegFormat::SOF0) {
+            stream[pos + 4 + 14] = 0;  // Tq компонента Cr
+            try {
+                JfifReader::read(stream);
+            } catch (const runtime_error&) {
+                rejected = true;
+            }
+            break;
+        }
+    }
+    mismatches += !rejected;
+    
+    cout << "Quantization tables (Annex K luma/chroma, shared cache from 4 threads; DQT at quality 30/50/90, PSNR "
+         << fixed << setprecision(1) << psnrs[0] << "/" << psnrs[1] << "/" << psnrs[2] << " dB): " << mismatches
+         << " mismatches" << (mismatches == 0 ? " [OK]" : " [FAILED]") << endl;
+    cout << defaultfloat;
+    return mismatches == 0;
+}
+
+int main(int argc, char* argv[]) {
+    // jpeg_compressor encode|decode ... - режим командной строки, без аргументов команды - бенчмарк
+    if (argc > 1 && Cli::isCommand(argv[1])) {
+        return Cli::run(argc - 1, argv + 1);
+    }
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fast-dct") == 0) {
+            useFastDct = true;
+        } else if (strcmp(argv[i], "--restart-interval") == 0 && i + 1 < argc) {
+            restartInterval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            inputPath = argv[++i];
+        } else if (strcmp(argv[i], "--subsampling") == 0 && i + 1 < argc) {
+            string mode = argv[++i];
+            if (mode == "444") {
+                subsampling = ChromaSubsampling::Yuv444;
+            } else if (mode == "422") {
+                subsampling = ChromaSubsampling::Yuv422;
+            } else if (mode == "420") {
+                subsampling = ChromaSubsampling::Yuv420;
+            } else {
+                cerr << "Unknown subsampling mode: " << mode << " (expected 444, 422 or 420)" << endl;
+                return 1;
+            }
+        }
+    }
+    
     int maxThreads = thread::hardware_concurrency();
     
     cout << "JPEG Compressor - Parallelization Benchmark (Encoding Only)" << endl;
@@ -170,22 +1437,48 @@ int main() {
     cout << "Iterations per test: 10" << endl;
     cout << "NOTE: Only encoding time is measured, decoding/metrics calculated separately" << endl;
     
+    cout << "DCT engine: " << (useFastDct ? "FastDctTransform (AAN)" : "reference (direct sum)") << endl;
+    
     int quality = 75;
-    auto quantTable = SequentialQuantizer::defaultQuantizationTable();
+    auto baseTables = QuantTable::forQuality(50);  // Annex K без масштабирования
+    
+    cout << "Color conversion kernel: " << ColorMath::rowKernelName(ColorMath::activeRowKernel()) << endl;
+    cout << "Chroma subsampling: " << subsamplingName(subsampling) << endl;
+    
+    if (!checkThreadPool() || !checkFastDctAccuracy() || !checkFastIdctAccuracy(*baseTables) || !checkColorKernels() || !checkJfifStream() || !checkHuffmanRoundTrip() ||
+        !checkRestartIntervals() || !checkParallelEntropyCoding() ||
+        !checkStreamingEncoder() || !checkFusedMcuProcessor() || !checkChromaSubsampling() ||
+        !checkEncoderSession() || !checkScratchArena() || !checkPnmIo() || !checkBlockStageHistograms() ||
+        !checkStandardHuffmanTables() || !checkReciprocalQuantizer() ||
+        !checkOpenMPTileSchedule() || !checkQuantTables()) {
+        return 1;
+    }
     
     vector<pair<int, int>> testSizes = {
         {1024, 1024},
         {2048, 2048}
     };
     
+    // --input: бенчмарк на реальном файле вместо синтетического градиента
+    unique_ptr<RgbImage> inputImage;
+    if (!inputPath.empty()) {
+        try {
+            inputImage = make_unique<RgbImage>(RgbImage::loadFromFile(inputPath));
+        } catch (const exception& e) {
+            cerr << "Cannot load " << inputPath << ": " << e.what() << endl;
+            return 1;
+        }
+        testSizes = {{inputImage->getWidth(), inputImage->getHeight()}};
+    }
+    
     for (const auto& [width, height] : testSizes) {
         cout << "\n" << string(124, '=') << endl;
-        cout << "Testing " << width << "x" << height << " image" << endl;
+        cout << "Testing " << width << "x" << height << " image" << (inputImage ? " (" + inputPath + ")" : "") << endl;
         cout << string(124, '=') << endl;
         
         vector<RgbImage> images;
         for (int i = 0; i < 3; i++) {
-            images.push_back(RgbImage::createTestImage(width, height));
+            images.push_back(inputImage ? *inputImage : RgbImage::createTestImage(width, height));
         }
         
         vector<BenchmarkResult> results;
@@ -198,16 +1491,15 @@ int main() {
                 [quality](const RgbImage& img) -> EncodingResult {
                     vector<QuantizedBlock> blocks;
                     auto colorConv = make_unique<SequentialColorConverter>();
-                    auto dct = make_unique<SequentialDctTransform>();
+                    auto dct = makeDctTransform(make_unique<SequentialDctTransform>());
                     auto quant = make_unique<SequentialQuantizer>(quality);
                     auto innerProc = make_unique<SequentialBlockProcessor>(move(dct), move(quant));
                     auto blockProc = make_unique<BlockCapturingProcessor>(move(innerProc), &blocks);
-                    auto huffman = make_unique<SequentialHuffmanEncoder>();
-                    JpegEncoder encoder(move(colorConv), move(blockProc), move(huffman));
+                    auto huffman = make_unique<SequentialHuffmanEncoder>(restartInterval);
+                    JpegEncoder encoder(move(colorConv), move(blockProc), move(huffman), subsampling);
                     auto encoded = encoder.encode(img);
                     return {encoded, blocks};
-                },
-                quantTable
+                }
             ));
             
             // 2. OpenMP с разным числом потоков
@@ -219,16 +1511,15 @@ int main() {
                         omp_set_num_threads(numThreads);
                         vector<QuantizedBlock> blocks;
                         auto colorConv = make_unique<SequentialColorConverter>();
-                        auto dct = make_unique<OpenMPDctTransform>();
+                        auto dct = makeDctTransform(make_unique<OpenMPDctTransform>());
                         auto quant = make_unique<OpenMPQuantizer>(quality);
                         auto innerProc = make_unique<OpenMPBlockProcessor>(move(dct), move(quant));
                         auto blockProc = make_unique<BlockCapturingProcessor>(move(innerProc), &blocks);
-                        auto huffman = make_unique<SequentialHuffmanEncoder>();
-                        JpegEncoder encoder(move(colorConv), move(blockProc), move(huffman));
+                        auto huffman = make_unique<SequentialHuffmanEncoder>(restartInterval);
+                        JpegEncoder encoder(move(colorConv), move(blockProc), move(huffman), subsampling);
                         auto encoded = encoder.encode(img);
                         return {encoded, blocks};
-                    },
-                    quantTable
+                    }
                 ));
             }
             
@@ -240,16 +1531,15 @@ int main() {
                     [quality, numThreads](const RgbImage& img) -> EncodingResult {
                         vector<QuantizedBlock> blocks;
                         auto colorConv = make_unique<MultiThreadColorConverter>(numThreads);
-                        auto dct = make_unique<SequentialDctTransform>();
+                        auto dct = makeDctTransform(make_unique<SequentialDctTransform>());
                         auto quant = make_unique<SequentialQuantizer>(quality);
                         auto innerProc = make_unique<MultiThreadBlockProcessor>(move(dct), move(quant), numThreads);
                         auto blockProc = make_unique<BlockCapturingProcessor>(move(innerProc), &blocks);
-                        auto huffman = make_unique<SequentialHuffmanEncoder>();
-                        JpegEncoder encoder(move(colorConv), move(blockProc), move(huffman));
+                        auto huffman = make_unique<SequentialHuffmanEncoder>(restartInterval);
+                        JpegEncoder encoder(move(colorConv), move(blockProc), move(huffman), subsampling);
                         auto encoded = encoder.encode(img);
                         return {encoded, blocks};
-                    },
-                    quantTable
+                    }
                 ));
             }
             
@@ -261,16 +1551,15 @@ int main() {
                     [quality, numThreads](const RgbImage& img) -> EncodingResult {
                         vector<QuantizedBlock> blocks;
                         auto colorConv = make_unique<SequentialColorConverter>();
-                        auto dct = make_unique<SequentialDctTransform>();
+                        auto dct = makeDctTransform(make_unique<SequentialDctTransform>());
                         auto quant = make_unique<SequentialQuantizer>(quality);
                         auto innerProc = make_unique<PipelineBlockProcessor>(move(dct), move(quant), numThreads);
                         auto blockProc = make_unique<BlockCapturingProcessor>(move(innerProc), &blocks);
-                        auto huffman = make_unique<SequentialHuffmanEncoder>();
-                        JpegEncoder encoder(move(colorConv), move(blockProc), move(huffman));
+                        auto huffman = make_unique<SequentialHuffmanEncoder>(restartInterval);
+                        JpegEncoder encoder(move(colorConv), move(blockProc), move(huffman), subsampling);
                         auto encoded = encoder.encode(img);
                         return {encoded, blocks};
-                    },
-                    quantTable
+                    }
                 ));
             }
             
@@ -282,16 +1571,15 @@ int main() {
                     omp_set_num_threads(4);
                     vector<QuantizedBlock> blocks;
                     auto colorConv = make_unique<MultiThreadColorConverter>(2);
-                    auto dct = make_unique<OpenMPDctTransform>();
+                    auto dct = makeDctTransform(make_unique<OpenMPDctTransform>());
                     auto quant = make_unique<OpenMPQuantizer>(quality);
                     auto innerProc = make_unique<OpenMPBlockProcessor>(move(dct), move(quant));
                     auto blockProc = make_unique<BlockCapturingProcessor>(move(innerProc), &blocks);
-                    auto huffman = make_unique<SequentialHuffmanEncoder>();
-                    JpegEncoder encoder(move(colorConv), move(blockProc), move(huffman));
+                    auto huffman = make_unique<SequentialHuffmanEncoder>(restartInterval);
+                    JpegEncoder encoder(move(colorConv), move(blockProc), move(huffman), subsampling);
                     auto encoded = encoder.encode(img);
                     return {encoded, blocks};
-                },
-                quantTable
+                }
             ));
             
             // 6. Только MultiThread ColorConverter
@@ -301,16 +1589,15 @@ int main() {
                 [quality](const RgbImage& img) -> EncodingResult {
                     vector<QuantizedBlock> blocks;
                     auto colorConv = make_unique<MultiThreadColorConverter>(4);
-                    auto dct = make_unique<SequentialDctTransform>();
+                    auto dct = makeDctTransform(make_unique<SequentialDctTransform>());
                     auto quant = make_unique<SequentialQuantizer>(quality);
                     auto innerProc = make_unique<SequentialBlockProcessor>(move(dct), move(quant));
                     auto blockProc = make_unique<BlockCapturingProcessor>(move(innerProc), &blocks);
-                    auto huffman = make_unique<SequentialHuffmanEncoder>();
-                    JpegEncoder encoder(move(colorConv), move(blockProc), move(huffman));
+                    auto huffman = make_unique<SequentialHuffmanEncoder>(restartInterval);
+                    JpegEncoder encoder(move(colorConv), move(blockProc), move(huffman), subsampling);
                     auto encoded = encoder.encode(img);
                     return {encoded, blocks};
-                },
-                quantTable
+                }
             ));
             
             // 7. Только MultiThread BlockProcessor
@@ -320,16 +1607,50 @@ int main() {
                 [quality](const RgbImage& img) -> EncodingResult {
                     vector<QuantizedBlock> blocks;
                     auto colorConv = make_unique<SequentialColorConverter>();
-                    auto dct = make_unique<SequentialDctTransform>();
+                    auto dct = makeDctTransform(make_unique<SequentialDctTransform>());
+                    auto quant = make_unique<SequentialQuantizer>(quality);
+                    auto innerProc = make_unique<MultiThreadBlockProcessor>(move(dct), move(quant), 4);
+                    auto blockProc = make_unique<BlockCapturingProcessor>(move(innerProc), &blocks);
+                    auto huffman = make_unique<SequentialHuffmanEncoder>(restartInterval);
+                    JpegEncoder encoder(move(colorConv), move(blockProc), move(huffman), subsampling);
+                    auto encoded = encoder.encode(img);
+                    return {encoded, blocks};
+                }
+            ));
+            
+            // 8. MultiThread целиком, включая энтропийное кодирование по интервалам перезапуска
+            results.push_back(runBenchmark(
+                "8. MT all stages + Huffman slices(4)",
+                images,
+                [quality](const RgbImage& img) -> EncodingResult {
+                    vector<QuantizedBlock> blocks;
+                    auto colorConv = make_unique<MultiThreadColorConverter>(4);
+                    auto dct = makeDctTransform(make_unique<SequentialDctTransform>());
                     auto quant = make_unique<SequentialQuantizer>(quality);
                     auto innerProc = make_unique<MultiThreadBlockProcessor>(move(dct), move(quant), 4);
                     auto blockProc = make_unique<BlockCapturingProcessor>(move(innerProc), &blocks);
-                    auto huffman = make_unique<SequentialHuffmanEncoder>();
-                    JpegEncoder encoder(move(colorConv), move(blockProc), move(huffman));
+                    auto huffman = make_unique<MultiThreadHuffmanEncoder>(4);
+                    JpegEncoder encoder(move(colorConv), move(blockProc), move(huffman), subsampling);
                     auto encoded = encoder.encode(img);
                     return {encoded, blocks};
-                },
-                quantTable
+                }
+            ));
+            
+            // 9. Слитый проход по MCU: без промежуточного YCbCrImage
+            results.push_back(runBenchmark(
+                "9. Fused MCU (4 threads)",
+                images,
+                [quality](const RgbImage& img) -> EncodingResult {
+                    vector<QuantizedBlock> blocks;
+                    auto dct = makeDctTransform(make_unique<SequentialDctTransform>());
+                    auto quant = make_unique<SequentialQuantizer>(quality);
+                    auto innerProc = make_unique<FusedMcuProcessor>(move(dct), move(quant), 4);
+                    auto mcuProc = make_unique<McuCapturingProcessor>(move(innerProc), &blocks);
+                    auto huffman = make_unique<SequentialHuffmanEncoder>(restartInterval);
+                    JpegEncoder encoder(move(mcuProc), move(huffman), subsampling);
+                    auto encoded = encoder.encode(img);
+                    return {encoded, blocks};
+                }
             ));
             
             printResults(results);
@@ -1,13 +1,18 @@
 #include "multy_thread.h"
+#include "jpeg_format.h"
+#include "entropy_coder.h"
 #include <algorithm>
+#include <functional>
 #include <optional>
+#include <stdexcept>
 
 using namespace std;
 
 // ===== MultiThreadColorConverter =====
 
-MultiThreadColorConverter::MultiThreadColorConverter(int numThreads)
-    : numThreads(numThreads > 0 ? numThreads : 1) {}
+MultiThreadColorConverter::MultiThreadColorConverter(int numThreads, ThreadPool& pool)
+    : numThreads(numThreads > 0 ? numThreads : 1)
+    , pool(pool) {}
 
 YCbCrImage MultiThreadColorConverter::convert(const RgbImage& image) {
     YCbCrImage result(image.getWidth(), image.getHeight());
@@ -15,40 +20,17 @@ YCbCrImage MultiThreadColorConverter::convert(const RgbImage& image) {
     const int width  = image.getWidth();
     const int height = image.getHeight();
 
-    int threads = min(numThreads, height);
-    if (threads <= 0) {
-        threads = 1;
-    }
-
-    vector<thread> workers;
-    workers.reserve(threads);
-
-    int rowsPerThread = (height + threads - 1) / threads;
-
-    auto worker = [&](int tid) {
-        int yStart = tid * rowsPerThread;
-        int yEnd   = min(height, yStart + rowsPerThread);
-
-        for (int y = yStart; y < yEnd; ++y) {
-            for (int x = 0; x < width; ++x) {
-                auto rgb   = image.getPixel(x, y);
-                auto ycbcr = ColorMath::rgbToYCbCr(get<0>(rgb),
-                                                   get<1>(rgb),
-                                                   get<2>(rgb));
-                result.setPixel(x, y,
-                                get<0>(ycbcr),
-                                get<1>(ycbcr),
-                                get<2>(ycbcr));
-            }
+    // Полосы строк по числу потоков, задачи выполняет общий пул
+    size_t rowsPerTask = (height + numThreads - 1) / numThreads;
+    pool.parallelFor(0, height, rowsPerTask, [&](size_t yStart, size_t yEnd) {
+        for (size_t y = yStart; y < yEnd; ++y) {
+            ColorMath::rgbRowToYCbCr(image.row(y),
+                                     result.plane(0).row(y),
+                                     result.plane(1).row(y),
+                                     result.plane(2).row(y),
+                                     width);
         }
-    };
-
-    for (int t = 0; t < threads; ++t) {
-        workers.emplace_back(worker, t);
-    }
-    for (auto& th : workers) {
-        th.join();
-    }
+    }, numThreads);
 
     return result;
 }
@@ -57,40 +39,28 @@ YCbCrImage MultiThreadColorConverter::convert(const RgbImage& image) {
 
 MultiThreadBlockProcessor::MultiThreadBlockProcessor(unique_ptr<IDctTransform> dctTransform,
                                                      unique_ptr<IQuantizer>    quantizer,
-                                                     int numThreads)
+                                                     int numThreads,
+                                                     ThreadPool& pool)
     : dct(move(dctTransform))
     , quantizer(move(quantizer))
-    , numThreads(numThreads > 0 ? numThreads : 1) {}
+    , numThreads(numThreads > 0 ? numThreads : 1)
+    , pool(pool) {
+    this->quantizer->setInputScaling(dct->outputScaling());
+}
 
-vector<vector<double>> MultiThreadBlockProcessor::extractBlock(
-    const YCbCrImage& image, int x, int y, int component) {
+void MultiThreadBlockProcessor::extractBlock(
+    const YCbCrImage& image, int x, int y, int component, FloatBlock& block) {
 
-    vector<vector<double>> block(8, vector<double>(8));
+    const ImagePlane& plane = image.plane(component); // 0 = Y, 1 = Cb, 2 = Cr
+    const int maxX = plane.getWidth()  - 1;
+    const int maxY = plane.getHeight() - 1;
 
     for (int i = 0; i < 8; ++i) {
+        const unsigned char* src = plane.row(min(y + i, maxY));
         for (int j = 0; j < 8; ++j) {
-            int px = min(x + j, image.getWidth()  - 1);
-            int py = min(y + i, image.getHeight() - 1);
-            auto pixel = image.getPixel(px, py);
-
-            switch (component) {
-                case 0: // Y
-                    block[i][j] = get<0>(pixel) - 128;
-                    break;
-                case 1: // Cb
-                    block[i][j] = get<1>(pixel) - 128;
-                    break;
-                case 2: // Cr
-                    block[i][j] = get<2>(pixel) - 128;
-                    break;
-                default:
-                    block[i][j] = 0;
-                    break;
-            }
+            block.at(i, j) = src[min(x + j, maxX)] - 128;
         }
     }
-
-    return block;
 }
 
 vector<QuantizedBlock> MultiThreadBlockProcessor::processBlocks(const YCbCrImage& image) {
@@ -102,8 +72,9 @@ vector<QuantizedBlock> MultiThreadBlockProcessor::processBlocks(const YCbCrImage
     int nyY = (height + 7)  / 8;
     int yBlocksCount = nxY * nyY;
 
-    int nxC = (width  + 15) / 16;
-    int nyC = (height + 15) / 16;
+    // Цветность - по сетке своей (возможно прореженной) плоскости
+    int nxC = (image.getCb().getWidth()  + 7) / 8;
+    int nyC = (image.getCb().getHeight() + 7) / 8;
     int cbBlocksCount = nxC * nyC;
     int crBlocksCount = nxC * nyC;
 
@@ -111,55 +82,167 @@ vector<QuantizedBlock> MultiThreadBlockProcessor::processBlocks(const YCbCrImage
     // Ð¥Ñ€Ð°Ð½Ð¸Ð¼ Ð²Ñ€ÐµÐ¼ÐµÐ½Ð½Ð¾ Ð² optional, Ñ‚.Ðº. Ñƒ QuantizedBlock Ð½ÐµÑ‚ Ð´ÐµÑ„Ð¾Ð»Ñ‚Ð½Ð¾Ð³Ð¾ ÐºÐ¾Ð½ÑÑ‚Ñ€ÑƒÐºÑ‚Ð¾Ñ€Ð°
     vector<optional<QuantizedBlock>> tmpBlocks(totalBlocks);
 
-    auto processComponent = [&](int component,
-                                int blocksX, int blocksY,
-                                int step,
-                                int offset) {
-        int total = blocksX * blocksY;
-        if (total == 0) return;
+    // ÐŸÐ¾Ñ€ÑÐ´Ð¾Ðº Ñ‚Ð¾Ñ‚ Ð¶Ðµ, Ñ‡Ñ‚Ð¾ Ð¸ Ð² SequentialBlockProcessor:
+    // ÑÐ½Ð°Ñ‡Ð°Ð»Ð° Ð²ÑÐµ Y, Ð·Ð°Ñ‚ÐµÐ¼ Ð²ÑÐµ Cb, Ð·Ð°Ñ‚ÐµÐ¼ Ð²ÑÐµ Cr.
+    // Все три компоненты одним проходом пула; диапазоны по несколько блоков на задачу
+    size_t grain = max<size_t>(16, totalBlocks / (numThreads * 4));
+    pool.parallelFor(0, totalBlocks, grain, [&](size_t begin, size_t end) {
+        // Рабочие блоки задачи - на стеке, без аллокаций на каждый блок
+        FloatBlock block;
+        FloatBlock dctBlock;
+        CoeffBlock quantizat;
+
+        for (size_t index = begin; index < end; ++index) {
+            int component = 0;
+            int local = static_cast<int>(index);
+            int blocksX = nxY;
+            if (local >= yBlocksCount) {
+                local -= yBlocksCount;
+                component = 1 + local / cbBlocksCount;
+                local %= cbBlocksCount;
+                blocksX = nxC;
+            }
 
-        int threads = min(numThreads, total);
-        if (threads <= 0) threads = 1;
+            int bxIndex = local % blocksX;
+            int byIndex = local / blocksX;
 
-        vector<thread> workers;
-        workers.reserve(threads);
+            extractBlock(image, bxIndex * 8, byIndex * 8, component, block);
+            dct->forwardDct(block, dctBlock);
+            int last = quantizer->quantize(dctBlock, component, quantizat);
 
-        auto worker = [&](int tid) {
-            for (int index = tid; index < total; index += threads) {
-                int byIndex = index / blocksX;
-                int bxIndex = index % blocksX;
+            tmpBlocks[index].emplace(quantizat, bxIndex, byIndex, component, last);
+        }
+    }, numThreads);
 
-                int bx = bxIndex * step;
-                int by = byIndex * step;
+    vector<QuantizedBlock> blocks;
+    blocks.reserve(totalBlocks);
+    for (auto &opt : tmpBlocks) {
+        // Ð’ÑÐµ ÑÐ»ÐµÐ¼ÐµÐ½Ñ‚Ñ‹ Ð´Ð¾Ð»Ð¶Ð½Ñ‹ Ð±Ñ‹Ñ‚ÑŒ Ð·Ð°Ð¿Ð¾Ð»Ð½ÐµÐ½Ñ‹
+        blocks.push_back(move(opt.value()));
+    }
 
-                auto block     = extractBlock(image, bx, by, component);
-                auto dctBlock  = dct->forwardDct(block);
-                auto quantizat = quantizer->quantize(dctBlock);
+    return blocks;
+}
 
-                tmpBlocks[offset + index].emplace(quantizat, bxIndex, byIndex, component);
-            }
-        };
+// ===== MultiThreadHuffmanEncoder =====
+
+MultiThreadHuffmanEncoder::MultiThreadHuffmanEncoder(int numThreads, int mcuRowsPerInterval, ThreadPool& pool)
+    : numThreads(numThreads > 0 ? numThreads : 1)
+    , mcuRowsPerInterval(mcuRowsPerInterval)
+    , pool(pool) {
+    if (mcuRowsPerInterval < 1) {
+        throw invalid_argument("Restart interval must cover at least one MCU row");
+    }
+}
+
+JpegEncodedData MultiThreadHuffmanEncoder::encode(const vector<QuantizedBlock>& blocks,
+                                                  int width, int height,
+                                                  const shared_ptr<const QuantTable>& quantTables,
+                                                  ChromaSubsampling subsampling) {
+    JpegEncodedData result;
+    result.quantTables = quantTables;
+    result.width = width;
+    result.height = height;
+    result.subsampling = subsampling;
+
+    if (blocks.empty()) {
+        JpegFormat::setStandardTables(result);
+        return result;
+    }
 
-        for (int t = 0; t < threads; ++t) {
-            workers.emplace_back(worker, t);
+    for (const auto& block : blocks) {
+        switch (block.getComponent()) {
+            case 0: result.yBlockCount++; break;
+            case 1: result.cbBlockCount++; break;
+            case 2: result.crBlockCount++; break;
         }
-        for (auto& th : workers) {
-            th.join();
+    }
+
+    auto order = JpegFormat::interleaveBlocks(blocks, width, height, subsampling);
+    auto layout = JpegFormat::mcuLayout(width, height, subsampling);
+
+    // Интервал - целое число строк MCU, но не больше предела поля DRI
+    int interval = static_cast<int>(min<long long>(65535, static_cast<long long>(layout.mcusX) * mcuRowsPerInterval));
+    result.restartInterval = interval;
+
+    const size_t blocksPerSlice = static_cast<size_t>(layout.blocksPerMcu()) * interval;
+    const int sliceCount = static_cast<int>((order.size() + blocksPerSlice - 1) / blocksPerSlice);
+
+    // Интервалы раздаются задачам пула по одному
+    auto forEachSlice = [&](const function<void(int)>& body) {
+        pool.parallelFor(0, sliceCount, 1, [&](size_t begin, size_t end) {
+            for (size_t slice = begin; slice < end; ++slice) {
+                body(static_cast<int>(slice));
+            }
+        }, numThreads);
+    };
+
+    // Проход 1: гистограммы по интервалам (DC предсказание с нуля в каждом), затем сумма.
+    // Сумма не зависит от распределения интервалов по потокам
+    vector<JpegFormat::SymbolHistogram> histograms(sliceCount);
+
+    forEachSlice([&](int slice) {
+        JpegFormat::SymbolHistogram& histogram = histograms[slice];
+        int lastDc[3] = {0, 0, 0};
+        size_t end = min(order.size(), (slice + 1) * blocksPerSlice);
+        for (size_t i = slice * blocksPerSlice; i < end; i++) {
+            int component = order[i]->getComponent();
+            int table = component == 0 ? 0 : 1;
+            JpegFormat::countBlockSymbols(order[i]->getCoefficients(), lastDc[component],
+                                          histogram.dc[table], histogram.ac[table], order[i]->getLastNonZero());
         }
+    });
+
+    JpegFormat::SymbolHistogram total;
+    for (const auto& histogram : histograms) {
+        total.add(histogram);
+    }
+
+    result.dcLuminanceTable = HuffmanMath::buildSpec(total.dc[0]);
+    result.acLuminanceTable = HuffmanMath::buildSpec(total.ac[0]);
+    result.dcChrominanceTable = HuffmanMath::buildSpec(total.dc[1]);
+    result.acChrominanceTable = HuffmanMath::buildSpec(total.ac[1]);
+
+    HuffmanCodeTable dcCodes[2] = {
+        HuffmanMath::buildCodeTable(result.dcLuminanceTable),
+        HuffmanMath::buildCodeTable(result.dcChrominanceTable)
+    };
+    HuffmanCodeTable acCodes[2] = {
+        HuffmanMath::buildCodeTable(result.acLuminanceTable),
+        HuffmanMath::buildCodeTable(result.acChrominanceTable)
     };
 
-    // ÐŸÐ¾Ñ€ÑÐ´Ð¾Ðº Ñ‚Ð¾Ñ‚ Ð¶Ðµ, Ñ‡Ñ‚Ð¾ Ð¸ Ð² SequentialBlockProcessor:
-    // ÑÐ½Ð°Ñ‡Ð°Ð»Ð° Ð²ÑÐµ Y, Ð·Ð°Ñ‚ÐµÐ¼ Ð²ÑÐµ Cb, Ð·Ð°Ñ‚ÐµÐ¼ Ð²ÑÐµ Cr.
-    processComponent(0, nxY, nyY, 8,  0);
-    processComponent(1, nxC, nyC, 16, yBlocksCount);
-    processComponent(2, nxC, nyC, 16, yBlocksCount + cbBlocksCount);
+    // Проход 2: каждый интервал в свой буфер, выровненный до байта
+    vector<vector<unsigned char>> sliceData(sliceCount);
+
+    forEachSlice([&](int slice) {
+        size_t start = slice * blocksPerSlice;
+        size_t end = min(order.size(), start + blocksPerSlice);
+        BitWriter writer((end - start) * 16);
+        int lastDc[3] = {0, 0, 0};
+        for (size_t i = start; i < end; i++) {
+            int component = order[i]->getComponent();
+            int table = component == 0 ? 0 : 1;
+            EntropyCoder::encodeBlock(writer, order[i]->getCoefficients(), lastDc[component],
+                                      dcCodes[table], acCodes[table], order[i]->getLastNonZero());
+        }
+        sliceData[slice] = writer.toArray();
+    });
 
-    vector<QuantizedBlock> blocks;
-    blocks.reserve(totalBlocks);
-    for (auto &opt : tmpBlocks) {
-        // Ð’ÑÐµ ÑÐ»ÐµÐ¼ÐµÐ½Ñ‚Ñ‹ Ð´Ð¾Ð»Ð¶Ð½Ñ‹ Ð±Ñ‹Ñ‚ÑŒ Ð·Ð°Ð¿Ð¾Ð»Ð½ÐµÐ½Ñ‹
-        blocks.push_back(move(opt.value()));
+    // Склейка: RST0..RST7 по кругу между интервалами
+    size_t totalSize = 2 * static_cast<size_t>(sliceCount - 1);
+    for (const auto& data : sliceData) {
+        totalSize += data.size();
+    }
+    result.compressedData.reserve(totalSize);
+    for (int slice = 0; slice < sliceCount; slice++) {
+        if (slice > 0) {
+            result.compressedData.push_back(0xFF);
+            result.compressedData.push_back(static_cast<unsigned char>(JpegFormat::RST0 + ((slice - 1) & 7)));
+        }
+        result.compressedData.insert(result.compressedData.end(),
+                                     sliceData[slice].begin(), sliceData[slice].end());
     }
 
-    return blocks;
-}
\ No newline at end of file
+    return result;
+}
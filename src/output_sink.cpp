@@ -0,0 +1,89 @@
+#include "output_sink.h"
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+#include <unistd.h>
+
+using namespace std;
+
+// ========== MemorySink ==========
+
+void MemorySink::write(const unsigned char* data, size_t size) {
+    buffer.insert(buffer.end(), data, data + size);
+}
+
+vector<unsigned char> MemorySink::takeData() {
+    vector<unsigned char> result;
+    result.swap(buffer);
+    return result;
+}
+
+// ========== FileDescriptorSink ==========
+
+FileDescriptorSink::FileDescriptorSink(int fd, size_t bufferSize)
+    : fd(fd), buffer(bufferSize > 0 ? bufferSize : 1) {
+    if (fd < 0) {
+        throw invalid_argument("Invalid file descriptor");
+    }
+}
+
+FileDescriptorSink::~FileDescriptorSink() {
+    try {
+        flush();
+    } catch (...) {
+        // Деструктор не бросает; ошибку увидит явный вызов flush()
+    }
+}
+
+void FileDescriptorSink::writeAll(const unsigned char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw system_error(errno, generic_category(), "write failed");
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+void FileDescriptorSink::write(const unsigned char* data, size_t size) {
+    if (used + size <= buffer.size()) {
+        memcpy(buffer.data() + used, data, size);
+        used += size;
+        return;
+    }
+    
+    flush();
+    
+    // Большие куски идут мимо буфера
+    if (size >= buffer.size()) {
+        writeAll(data, size);
+    } else {
+        memcpy(buffer.data(), data, size);
+        used = size;
+    }
+}
+
+void FileDescriptorSink::flush() {
+    if (used > 0) {
+        size_t pending = used;
+        used = 0;
+        writeAll(buffer.data(), pending);
+    }
+}
+
+// ========== CallbackSink ==========
+
+CallbackSink::CallbackSink(Callback callback) : callback(move(callback)) {
+    if (!this->callback) {
+        throw invalid_argument("Callback must not be empty");
+    }
+}
+
+void CallbackSink::write(const unsigned char* data, size_t size) {
+    callback(data, size);
+}
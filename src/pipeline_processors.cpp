@@ -1,7 +1,12 @@
 #include "pipeline_processor.h"
+#include "jpeg_format.h"
+#include "entropy_coder.h"
+#include "jfif_writer.h"
 #include <algorithm>
 #include <cmath>
+#include <functional>
 #include <iostream>
+#include <stdexcept>
 
 using namespace std;
 
@@ -9,468 +14,277 @@ using namespace std;
 
 PipelineBlockProcessor::PipelineBlockProcessor(unique_ptr<IDctTransform> dctTransform,
                                              unique_ptr<IQuantizer> quantizer,
-                                             int numThreads)
-    : dct(move(dctTransform)), quantizer(move(quantizer)), numThreads(numThreads) {}
-
-PipelineBlockProcessor::~PipelineBlockProcessor() {
-    extractionDone = true;
-    dctDone = true;
-    quantDone = true;
-    
-    extractCV.notify_all();
-    dctCV.notify_all();
-    quantCV.notify_all();
-    
-    for (auto& t : extractThreads) if (t.joinable()) t.join();
-    for (auto& t : dctThreads) if (t.joinable()) t.join();
-    for (auto& t : quantThreads) if (t.joinable()) t.join();
+                                             int numThreads,
+                                             ThreadPool& pool)
+    : dct(move(dctTransform)), quantizer(move(quantizer)), numThreads(max(1, numThreads)), pool(pool) {
+    this->quantizer->setInputScaling(dct->outputScaling());
 }
 
-vector<vector<double>> PipelineBlockProcessor::extractBlock(
-    const YCbCrImage& image, int x, int y, int component) {
+void PipelineBlockProcessor::extractBlock(
+    const YCbCrImage& image, int x, int y, int component, FloatBlock& block) {
     
-    vector<vector<double>> block(8, vector<double>(8));
+    const ImagePlane& plane = image.plane(component);
+    int maxX = plane.getWidth() - 1;
+    int maxY = plane.getHeight() - 1;
     
     for (int i = 0; i < 8; i++) {
+        const unsigned char* src = plane.row(min(y + i, maxY));
         for (int j = 0; j < 8; j++) {
-            int px = min(x + j, image.getWidth() - 1);
-            int py = min(y + i, image.getHeight() - 1);
-            auto pixel = image.getPixel(px, py);
-            
-            switch (component) {
-                case 0: block[i][j] = get<0>(pixel) - 128; break;
-                case 1: block[i][j] = get<1>(pixel) - 128; break;
-                case 2: block[i][j] = get<2>(pixel) - 128; break;
-                default: block[i][j] = 0;
-            }
+            block.at(i, j) = src[min(x + j, maxX)] - 128;
         }
     }
-    
-    return block;
 }
 
-void PipelineBlockProcessor::extractionStage(const YCbCrImage& image) {
-    int width = image.getWidth();
-    int height = image.getHeight();
-    
-    // Y компоненты
-    for (int by = 0; by < height; by += 8) {
-        for (int bx = 0; bx < width; bx += 8) {
-            RawBlock block;
-            block.data = extractBlock(image, bx, by, 0);
-            block.x = bx / 8;
-            block.y = by / 8;
-            block.component = 0;
-            
-            unique_lock<mutex> lock(extractMutex);
-            extractQueue.push(move(block));
-            lock.unlock();
-            extractCV.notify_one();
-        }
-    }
-    
-    // Cb компоненты
-    for (int by = 0; by < height; by += 16) {
-        for (int bx = 0; bx < width; bx += 16) {
-            RawBlock block;
-            block.data = extractBlock(image, bx, by, 1);
-            block.x = bx / 16;
-            block.y = by / 16;
-            block.component = 1;
-            
-            unique_lock<mutex> lock(extractMutex);
-            extractQueue.push(move(block));
-            lock.unlock();
-            extractCV.notify_one();
-        }
-    }
-    
-    // Cr компоненты
-    for (int by = 0; by < height; by += 16) {
-        for (int bx = 0; bx < width; bx += 16) {
-            RawBlock block;
-            block.data = extractBlock(image, bx, by, 2);
-            block.x = bx / 16;
-            block.y = by / 16;
-            block.component = 2;
-            
-            unique_lock<mutex> lock(extractMutex);
-            extractQueue.push(move(block));
-            lock.unlock();
-            extractCV.notify_one();
-        }
+void PipelineBlockProcessor::BlockLayout::position(int index, int& component, int& blockX, int& blockY) const {
+    if (index < yCount()) {
+        component = 0;
+        blockX = index % yBlocksX;
+        blockY = index / yBlocksX;
+        return;
     }
-    
-    extractionDone = true;
-    extractCV.notify_all();
+    index -= yCount();
+    component = 1 + index / cCount();
+    index %= cCount();
+    blockX = index % cBlocksX;
+    blockY = index / cBlocksX;
 }
 
-void PipelineBlockProcessor::dctStage() {
-    while (true) {
-        unique_lock<mutex> lock(extractMutex);
-        extractCV.wait(lock, [&]() {
-            return !extractQueue.empty() || extractionDone;
-        });
-        
-        if (extractQueue.empty() && extractionDone) {
-            break;
-        }
-        
-        if (!extractQueue.empty()) {
-            RawBlock raw = move(extractQueue.front());
-            extractQueue.pop();
-            lock.unlock();
-            
-            DctBlock dctBlock;
-            dctBlock.dctCoeffs = dct->forwardDct(raw.data);
-            dctBlock.x = raw.x;
-            dctBlock.y = raw.y;
-            dctBlock.component = raw.component;
-            
-            unique_lock<mutex> dctLock(dctMutex);
-            dctQueue.push(move(dctBlock));
-            dctLock.unlock();
-            dctCV.notify_one();
+bool PipelineBlockProcessor::runStageStep(PipelineRun& run) {
+    int batchId;
+    if (run.transformedBatches.tryPop(batchId)) {
+        BlockBatch& batch = batches[batchId];
+        for (int i = 0; i < batch.count; i++) {
+            int index = batch.firstIndex + i;
+            lastNonZero[index] = quantizer->quantize(batch.blocks[i], batch.components[i], coefficients[index]);
         }
+        run.freeBatches.tryPush(batchId);
+        return true;
     }
     
-    dctDone = true;
-    dctCV.notify_all();
+    if (run.extractedBatches.tryPop(batchId)) {
+        BlockBatch& batch = batches[batchId];
+        FloatBlock transformed;
+        for (int i = 0; i < batch.count; i++) {
+            dct->forwardDct(batch.blocks[i], transformed);
+            batch.blocks[i] = transformed;
+        }
+        // Пакетов не больше ёмкости кольца, поэтому запись всегда успешна
+        run.transformedBatches.tryPush(batchId);
+        return true;
+    }
+    return false;
 }
 
-void PipelineBlockProcessor::quantizationStage() {
+void PipelineBlockProcessor::stageWorker(PipelineRun& run) {
     while (true) {
-        unique_lock<mutex> lock(dctMutex);
-        dctCV.wait(lock, [&]() {
-            return !dctQueue.empty() || dctDone;
-        });
-        
-        if (dctQueue.empty() && dctDone) {
-            break;
+        if (runStageStep(run)) {
+            continue;
         }
-        
-        if (!dctQueue.empty()) {
-            DctBlock dctBlock = move(dctQueue.front());
-            dctQueue.pop();
-            lock.unlock();
-            
-            QuantizedBlockData quantData;
-            quantData.quantized = quantizer->quantize(dctBlock.dctCoeffs);
-            quantData.x = dctBlock.x;
-            quantData.y = dctBlock.y;
-            quantData.component = dctBlock.component;
-            
-            QuantizedBlock finalBlock(quantData.quantized, quantData.x, quantData.y, quantData.component);
-            
-            unique_lock<mutex> finalLock(finalMutex);
-            finalBlocks.push_back(move(finalBlock));
+        if (run.extractionDone.load(memory_order_acquire)) {
+            // Последняя попытка после конца извлечения. Пакет, который в этот момент
+            // обрабатывает другая задача, она же доведёт до квантования
+            if (!runStageStep(run)) {
+                break;
+            }
+            continue;
         }
+        this_thread::yield();
     }
-    
-    quantDone = true;
 }
 
 vector<QuantizedBlock> PipelineBlockProcessor::processBlocks(const YCbCrImage& image) {
-    // Сброс состояния
-    extractionDone = false;
-    dctDone = false;
-    quantDone = false;
-    
-    while (!extractQueue.empty()) extractQueue.pop();
-    while (!dctQueue.empty()) dctQueue.pop();
-    while (!quantQueue.empty()) quantQueue.pop();
-    finalBlocks.clear();
+    int width = image.getWidth();
+    int height = image.getHeight();
+    const ImagePlane& chroma = image.getCb();
+    BlockLayout layout{(width + 7) / 8, (height + 7) / 8, (chroma.getWidth() + 7) / 8, (chroma.getHeight() + 7) / 8};
+    int totalBlocks = layout.total();
     
-    // Запуск стадий конвейера
-    thread extractThread(&PipelineBlockProcessor::extractionStage, this, ref(image));
+    coefficients.resize(totalBlocks);
+    lastNonZero.resize(totalBlocks);
+    batches.resize(kBatchCount);
     
-    int dctThreadCount = max(1, numThreads / 2);
-    for (int i = 0; i < dctThreadCount; i++) {
-        dctThreads.emplace_back(&PipelineBlockProcessor::dctStage, this);
+    PipelineRun run;
+    for (size_t i = 0; i < kBatchCount; i++) {
+        run.freeBatches.tryPush(static_cast<int>(i));
     }
     
-    int quantThreadCount = max(1, numThreads / 2);
-    for (int i = 0; i < quantThreadCount; i++) {
-        quantThreads.emplace_back(&PipelineBlockProcessor::quantizationStage, this);
+    // Стадии DCT/квантования - задачи пула, извлечение - в текущем потоке
+    TaskGroup stages(pool);
+    for (int i = 0; i < numThreads; i++) {
+        stages.run([this, &run]() { stageWorker(run); });
     }
     
-    // Ждем завершения
-    extractThread.join();
-    for (auto& t : dctThreads) t.join();
-    for (auto& t : quantThreads) t.join();
-    
-    dctThreads.clear();
-    quantThreads.clear();
-    
-    return finalBlocks;
+    for (int first = 0; first < totalBlocks; first += kBatchBlocks) {
+        // Нет свободного пакета - помогаем стадиям вместо ожидания
+        int batchId;
+        while (!run.freeBatches.tryPop(batchId)) {
+            if (!runStageStep(run)) {
+                this_thread::yield();
+            }
+        }
+        
+        BlockBatch& batch = batches[batchId];
+        batch.firstIndex = first;
+        batch.count = min(kBatchBlocks, totalBlocks - first);
+        for (int i = 0; i < batch.count; i++) {
+            int component, bx, by;
+            layout.position(first + i, component, bx, by);
+            extractBlock(image, bx * 8, by * 8, component, batch.blocks[i]);
+            batch.components[i] = component;
+        }
+        run.extractedBatches.tryPush(batchId);
+    }
+    run.extractionDone.store(true, memory_order_release);
+    
+    // Вызывающий поток тоже дорабатывает стадии, затем ждёт задачи пула
+    stageWorker(run);
+    stages.wait();
+    
+    vector<QuantizedBlock> result;
+    result.reserve(totalBlocks);
+    for (int index = 0; index < totalBlocks; index++) {
+        int component, bx, by;
+        layout.position(index, component, bx, by);
+        result.emplace_back(coefficients[index], bx, by, component, lastNonZero[index]);
+    }
+    return result;
 }
 
 // ========== PipelineColorConverter ==========
 
+PipelineColorConverter::PipelineColorConverter(ThreadPool& pool) : pool(pool) {}
+
 YCbCrImage PipelineColorConverter::convert(const RgbImage& image) {
     YCbCrImage result(image.getWidth(), image.getHeight());
     int height = image.getHeight();
     int width = image.getWidth();
     
-    vector<future<void>> futures;
-    int numThreads = thread::hardware_concurrency();
-    int rowsPerThread = (height + numThreads - 1) / numThreads;
-    
-    for (int t = 0; t < numThreads; t++) {
-        futures.push_back(async(launch::async, [&, t]() {
-            int startRow = t * rowsPerThread;
-            int endRow = min(startRow + rowsPerThread, height);
-            
-            for (int y = startRow; y < endRow; y++) {
-                for (int x = 0; x < width; x++) {
-                    auto rgb = image.getPixel(x, y);
-                    auto ycbcr = ColorMath::rgbToYCbCr(get<0>(rgb), get<1>(rgb), get<2>(rgb));
-                    result.setPixel(x, y, get<0>(ycbcr), get<1>(ycbcr), get<2>(ycbcr));
-                }
-            }
-        }));
-    }
-    
-    for (auto& future : futures) {
-        future.get();
-    }
+    // Полосы по 16 строк (одна строка MCU) раздаются задачам пула
+    pool.parallelFor(0, height, 16, [&](size_t startRow, size_t endRow) {
+        for (size_t y = startRow; y < endRow; y++) {
+            ColorMath::rgbRowToYCbCr(image.row(y), result.plane(0).row(y),
+                                     result.plane(1).row(y), result.plane(2).row(y), width);
+        }
+    });
     
     return result;
 }
 
 // ========== PipelineDctTransform ==========
 
-vector<vector<double>> PipelineDctTransform::forwardDct(const vector<vector<double>>& block) {
-    vector<vector<double>> result(8, vector<double>(8));
-    
+void PipelineDctTransform::forwardDct(const FloatBlock& block, FloatBlock& out) {
     for (int u = 0; u < 8; u++) {
         for (int v = 0; v < 8; v++) {
-            result[u][v] = DctMath::computeDctCoefficient(block, u, v);
+            out.at(u, v) = static_cast<float>(DctMath::computeDctCoefficient(block.data, u, v));
         }
     }
-    
-    return result;
 }
 
 // ========== PipelineQuantizer ==========
 
 PipelineQuantizer::PipelineQuantizer(int quality) 
-    : quantizationTable(generateQuantizationTable(quality)) {}
+    : quantTables(QuantTable::forQuality(quality)) {}
 
-vector<vector<int>> PipelineQuantizer::quantize(const vector<vector<double>>& dctBlock) {
-    vector<vector<int>> result(8, vector<int>(8));
-    
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            result[i][j] = static_cast<int>(round(
-                dctBlock[i][j] / quantizationTable[i][j]
-            ));
-        }
-    }
-    
-    return result;
+int PipelineQuantizer::quantize(const FloatBlock& dctBlock, int component, CoeffBlock& out) {
+    return QuantMath::quantizeBlock(quantTables->getReciprocals(QuantTable::channelOf(component), inputScaling),
+                                    dctBlock, out);
 }
 
-vector<vector<int>> PipelineQuantizer::defaultQuantizationTable() {
-    return vector<vector<int>>{
-        {16, 11, 10, 16, 24, 40, 51, 61},
-        {12, 12, 14, 19, 26, 58, 60, 55},
-        {14, 13, 16, 24, 40, 57, 69, 56},
-        {14, 17, 22, 29, 51, 87, 80, 62},
-        {18, 22, 37, 56, 68, 109, 103, 77},
-        {24, 35, 55, 64, 81, 104, 113, 92},
-        {49, 64, 78, 87, 103, 121, 120, 101},
-        {72, 92, 95, 98, 112, 100, 103, 99}
-    };
-}
+// ========== PipelineHuffmanEncoder ==========
 
-vector<vector<int>> PipelineQuantizer::generateQuantizationTable(int quality) {
-    auto baseTable = defaultQuantizationTable();
-    vector<vector<int>> result(8, vector<int>(8));
-    
-    double scale = quality < 50 ? 5000.0 / quality : 200.0 - 2 * quality;
-    
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            int value = static_cast<int>((baseTable[i][j] * scale + 50) / 100);
-            result[i][j] = max(1, min(255, value));
-        }
+PipelineHuffmanEncoder::PipelineHuffmanEncoder(int restartInterval, ThreadPool& pool)
+    : restartInterval(restartInterval), pool(pool) {
+    if (restartInterval < 0 || restartInterval > 65535) {
+        throw invalid_argument("Restart interval must be 0-65535 MCUs");
     }
-    
-    return result;
 }
 
-// ========== PipelineHuffmanEncoder ==========
-
 JpegEncodedData PipelineHuffmanEncoder::encode(const vector<QuantizedBlock>& blocks, 
                                               int width, int height, 
-                                              const vector<vector<int>>& quantTable) {
+                                              const shared_ptr<const QuantTable>& quantTables,
+                                              ChromaSubsampling subsampling) {
+    JpegEncodedData result;
+    result.quantTables = quantTables;
+    result.width = width;
+    result.height = height;
+    result.restartInterval = restartInterval;
+    result.subsampling = subsampling;
+    
     if (blocks.empty()) {
-        JpegEncodedData result;
-        result.compressedData = vector<unsigned char>();
-        result.quantizationTable = quantTable;
-        result.width = width;
-        result.height = height;
+        JpegFormat::setStandardTables(result);
         return result;
     }
     
-    // Разделяем блоки по компонентам
-    vector<QuantizedBlock> yBlocks, cbBlocks, crBlocks;
     for (const auto& block : blocks) {
         switch (block.getComponent()) {
-            case 0: yBlocks.push_back(block); break;
-            case 1: cbBlocks.push_back(block); break;
-            case 2: crBlocks.push_back(block); break;
+            case 0: result.yBlockCount++; break;
+            case 1: result.cbBlockCount++; break;
+            case 2: result.crBlockCount++; break;
         }
     }
     
-    // Параллельная обработка компонентов
-    auto yFuture = async(launch::async, &PipelineHuffmanEncoder::processComponent, this, yBlocks, "Y");
-    auto cbFuture = async(launch::async, &PipelineHuffmanEncoder::processComponent, this, cbBlocks, "Cb");
-    auto crFuture = async(launch::async, &PipelineHuffmanEncoder::processComponent, this, crBlocks, "Cr");
-    
-    auto yData = yFuture.get();
-    auto cbData = cbFuture.get();
-    auto crData = crFuture.get();
-    
-    // Кодируем все блоки (последовательно, BitWriter не thread-safe)
-    BitWriter writer;
-    
-    for (const auto& block : yData.blocks) {
-        auto zigzag = block.getZigzagOrder();
-        for (auto coef : zigzag) {
-            auto it = yData.huffmanTable.find(coef);
-            if (it != yData.huffmanTable.end()) {
-                writer.writeBits(it->second.first, it->second.second);
-            }
+    auto order = JpegFormat::interleaveBlocks(blocks, width, height, subsampling);
+    int blocksPerMcu = JpegFormat::mcuLayout(width, height, subsampling).blocksPerMcu();
+    
+    // Параллельный сбор статистики и построение таблиц яркости и цветности
+    TableSet luma, chroma;
+    TaskGroup tables(pool);
+    tables.run([&]() { chroma = prepareTables(order, blocksPerMcu, true); });
+    luma = prepareTables(order, blocksPerMcu, false);
+    tables.wait();
+    
+    result.dcLuminanceTable = luma.dcSpec;
+    result.acLuminanceTable = luma.acSpec;
+    result.dcChrominanceTable = chroma.dcSpec;
+    result.acChrominanceTable = chroma.acSpec;
+    
+    // Кодируем чередующийся скан (последовательно, BitWriter не thread-safe)
+    // Начальный буфер ~16 байт на блок, дальше растёт удвоением
+    BitWriter writer(order.size() * 16);
+    int lastDc[3] = {0, 0, 0};
+    int restartIndex = 0;
+    
+    for (size_t i = 0; i < order.size(); i++) {
+        if (JpegFormat::startsRestartInterval(i, restartInterval, blocksPerMcu)) {
+            writer.writeRestartMarker(restartIndex++);
+            fill(begin(lastDc), end(lastDc), 0);
         }
+        const QuantizedBlock* block = order[i];
+        int component = block->getComponent();
+        const TableSet& tables = component == 0 ? luma : chroma;
+        EntropyCoder::encodeBlock(writer, block->getCoefficients(), lastDc[component],
+                                  tables.dcCodes, tables.acCodes, block->getLastNonZero());
     }
     
-    for (const auto& block : cbData.blocks) {
-        auto zigzag = block.getZigzagOrder();
-        for (auto coef : zigzag) {
-            auto it = cbData.huffmanTable.find(coef);
-            if (it != cbData.huffmanTable.end()) {
-                writer.writeBits(it->second.first, it->second.second);
-            }
-        }
-    }
-    
-    for (const auto& block : crData.blocks) {
-        auto zigzag = block.getZigzagOrder();
-        for (auto coef : zigzag) {
-            auto it = crData.huffmanTable.find(coef);
-            if (it != crData.huffmanTable.end()) {
-                writer.writeBits(it->second.first, it->second.second);
-            }
-        }
-    }
-    
-    JpegEncodedData result;
     result.compressedData = writer.toArray();
-    result.yHuffmanTable = yData.huffmanTable;
-    result.cbHuffmanTable = cbData.huffmanTable;
-    result.crHuffmanTable = crData.huffmanTable;
-    result.dcLuminanceTable = yData.huffmanTable;
-    result.acLuminanceTable = yData.huffmanTable;
-    result.quantizationTable = quantTable;
-    result.width = width;
-    result.height = height;
-    result.yBlockCount = static_cast<int>(yData.blocks.size());
-    result.cbBlockCount = static_cast<int>(cbData.blocks.size());
-    result.crBlockCount = static_cast<int>(crData.blocks.size());
     return result;
 }
 
-PipelineHuffmanEncoder::ComponentData PipelineHuffmanEncoder::processComponent(
-    const vector<QuantizedBlock>& blocks, const string& name) {
-    
-    ComponentData data;
-    data.blocks = blocks;
+PipelineHuffmanEncoder::TableSet PipelineHuffmanEncoder::prepareTables(
+    const JpegFormat::BlockOrder& order, int blocksPerMcu, bool chroma) {
     
-    if (blocks.empty()) {
-        return data;
-    }
+    HuffmanFrequencies dcFrequencies = {};
+    HuffmanFrequencies acFrequencies = {};
+    int lastDc[3] = {0, 0, 0};
     
-    unordered_map<int, int> frequencies;
-    for (const auto& block : blocks) {
-        auto zigzag = block.getZigzagOrder();
-        for (auto coef : zigzag) {
-            frequencies[coef]++;
+    for (size_t i = 0; i < order.size(); i++) {
+        if (JpegFormat::startsRestartInterval(i, restartInterval, blocksPerMcu)) {
+            fill(begin(lastDc), end(lastDc), 0);
         }
-    }
-    
-    auto tree = HuffmanMath::buildTree(frequencies);
-    data.huffmanTable = HuffmanMath::buildCodeTable(tree);
-    delete tree;
-    
-    return data;
-}
-
-void PipelineHuffmanEncoder::encodeBlock(BitWriter& writer, const vector<int>& zigzag,
-                                        const unordered_map<int, pair<int, int>>& dcTable,
-                                        const unordered_map<int, pair<int, int>>& acTable) {
-    int dc = zigzag[0];
-    int dcDiff = dc - lastDc;
-    lastDc = dc;
-    
-    int dcCategory = getCategory(dcDiff);
-    auto dcIt = dcTable.find(dcCategory);
-    if (dcIt != dcTable.end()) {
-        writer.writeBits(dcIt->second.first, dcIt->second.second);
-    }
-    
-    if (dcCategory > 0) {
-        int magnitude = getMagnitude(dcDiff, dcCategory);
-        writer.writeBits(magnitude, dcCategory);
-    }
-    
-    int zeroRun = 0;
-    for (int i = 1; i < 64; i++) {
-        int ac = zigzag[i];
-        
-        if (ac == 0) {
-            zeroRun++;
-            if (i == 63) {
-                auto eobIt = acTable.find(0x00);
-                if (eobIt != acTable.end()) {
-                    writer.writeBits(eobIt->second.first, eobIt->second.second);
-                }
-            }
-        } else {
-            while (zeroRun > 15) {
-                auto zrlIt = acTable.find(0xF0);
-                if (zrlIt != acTable.end()) {
-                    writer.writeBits(zrlIt->second.first, zrlIt->second.second);
-                }
-                zeroRun -= 16;
-            }
-            
-            int category = getCategory(ac);
-            int symbol = (zeroRun << 4) | category;
-            auto acIt = acTable.find(symbol);
-            if (acIt != acTable.end()) {
-                writer.writeBits(acIt->second.first, acIt->second.second);
-            }
-            
-            int magnitude = getMagnitude(ac, category);
-            writer.writeBits(magnitude, category);
-            
-            zeroRun = 0;
+        const QuantizedBlock* block = order[i];
+        int component = block->getComponent();
+        if ((component != 0) == chroma) {
+            JpegFormat::countBlockSymbols(block->getCoefficients(), lastDc[component],
+                                          dcFrequencies, acFrequencies, block->getLastNonZero());
         }
     }
-}
-
-int PipelineHuffmanEncoder::getCategory(int value) {
-    int absValue = abs(value);
-    if (absValue == 0) return 0;
-    return static_cast<int>(floor(log2(absValue))) + 1;
-}
-
-int PipelineHuffmanEncoder::getMagnitude(int value, int category) {
-    if (value >= 0)
-        return value;
-    return value + (1 << category) - 1;
+    
+    TableSet tables;
+    tables.dcSpec = HuffmanMath::buildSpec(dcFrequencies);
+    tables.acSpec = HuffmanMath::buildSpec(acFrequencies);
+    tables.dcCodes = HuffmanMath::buildCodeTable(tables.dcSpec);
+    tables.acCodes = HuffmanMath::buildCodeTable(tables.acSpec);
+    return tables;
 }
 
 // ========== ProcessingPipeline ==========
@@ -479,7 +293,9 @@ ProcessingPipeline::ProcessingPipeline(unique_ptr<IDctTransform> dctTransform,
                                      unique_ptr<IQuantizer> quantizerObj,
                                      int threadCount)
     : dct(move(dctTransform)), quantizer(move(quantizerObj)), numThreads(threadCount),
-      ycbcrImage(nullptr) {}
+      ycbcrImage(nullptr) {
+    quantizer->setInputScaling(dct->outputScaling());
+}
 
 ProcessingPipeline::~ProcessingPipeline() {
     dctFinished = true;
@@ -517,24 +333,20 @@ vector<QuantizedBlock> ProcessingPipeline::processImage(const YCbCrImage& image)
     extractionFutures.push_back(async(launch::async, [&]() {
         for (int by = 0; by < height; by += 8) {
             for (int bx = 0; bx < width; bx += 8) {
-                vector<vector<double>> extracted(8, vector<double>(8));
+                FloatBlock extracted;
                 for (int i = 0; i < 8; i++) {
+                    const unsigned char* src = image.getY().row(min(by + i, height - 1));
                     for (int j = 0; j < 8; j++) {
-                        int px = min(bx + j, width - 1);
-                        int py = min(by + i, height - 1);
-                        auto pixel = image.getPixel(px, py);
-                        extracted[i][j] = get<0>(pixel) - 128;
+                        extracted.at(i, j) = src[min(bx + j, width - 1)] - 128;
                     }
                 }
                 
                 // DCT
-                auto dctCoeffs = dct->forwardDct(extracted);
-                
                 DctBlock dctBlock;
+                dct->forwardDct(extracted, dctBlock.dctCoeffs);
                 dctBlock.x = bx / 8;
                 dctBlock.y = by / 8;
                 dctBlock.component = 0;
-                dctBlock.dctCoeffs = move(dctCoeffs);
                 
                 unique_lock<mutex> lock(dctMutex);
                 dctQueue.push(move(dctBlock));
@@ -544,59 +356,35 @@ vector<QuantizedBlock> ProcessingPipeline::processImage(const YCbCrImage& image)
         }
     }));
     
-    // Cb и Cr компоненты - субсэмплинг 2x2
+    // Cb и Cr компоненты - блоки по сетке плоскостей цветности (прореживание уже сделал downsampleChroma)
     extractionFutures.push_back(async(launch::async, [&]() {
-        for (int by = 0; by < height; by += 16) {
-            for (int bx = 0; bx < width; bx += 16) {
-                // Cb блок
-                vector<vector<double>> cbExtracted(8, vector<double>(8));
-                for (int i = 0; i < 8; i++) {
-                    for (int j = 0; j < 8; j++) {
-                        int px = min(bx + j * 2, width - 1);
-                        int py = min(by + i * 2, height - 1);
-                        auto pixel = image.getPixel(px, py);
-                        cbExtracted[i][j] = get<1>(pixel) - 128;
+        const ImagePlane& cbPlane = image.getCb();
+        int chromaWidth = cbPlane.getWidth();
+        int chromaHeight = cbPlane.getHeight();
+        for (int by = 0; by < chromaHeight; by += 8) {
+            for (int bx = 0; bx < chromaWidth; bx += 8) {
+                for (int component = 1; component <= 2; component++) {
+                    const ImagePlane& plane = image.plane(component);
+                    FloatBlock extracted;
+                    for (int i = 0; i < 8; i++) {
+                        const unsigned char* src = plane.row(min(by + i, chromaHeight - 1));
+                        for (int j = 0; j < 8; j++) {
+                            extracted.at(i, j) = src[min(bx + j, chromaWidth - 1)] - 128;
+                        }
                     }
-                }
-                
-                auto cbDctCoeffs = dct->forwardDct(cbExtracted);
-                
-                DctBlock cbDctBlock;
-                cbDctBlock.x = bx / 16;
-                cbDctBlock.y = by / 16;
-                cbDctBlock.component = 1;
-                cbDctBlock.dctCoeffs = move(cbDctCoeffs);
-                
-                {
-                    unique_lock<mutex> lock(dctMutex);
-                    dctQueue.push(move(cbDctBlock));
-                }
-                dctCV.notify_one();
-                
-                // Cr блок
-                vector<vector<double>> crExtracted(8, vector<double>(8));
-                for (int i = 0; i < 8; i++) {
-                    for (int j = 0; j < 8; j++) {
-                        int px = min(bx + j * 2, width - 1);
-                        int py = min(by + i * 2, height - 1);
-                        auto pixel = image.getPixel(px, py);
-                        crExtracted[i][j] = get<2>(pixel) - 128;
+                    
+                    DctBlock dctBlock;
+                    dct->forwardDct(extracted, dctBlock.dctCoeffs);
+                    dctBlock.x = bx / 8;
+                    dctBlock.y = by / 8;
+                    dctBlock.component = component;
+                    
+                    {
+                        unique_lock<mutex> lock(dctMutex);
+                        dctQueue.push(move(dctBlock));
                     }
+                    dctCV.notify_one();
                 }
-                
-                auto crDctCoeffs = dct->forwardDct(crExtracted);
-                
-                DctBlock crDctBlock;
-                crDctBlock.x = bx / 16;
-                crDctBlock.y = by / 16;
-                crDctBlock.component = 2;
-                crDctBlock.dctCoeffs = move(crDctCoeffs);
-                
-                {
-                    unique_lock<mutex> lock(dctMutex);
-                    dctQueue.push(move(crDctBlock));
-                }
-                dctCV.notify_one();
             }
         }
     }));
@@ -640,9 +428,10 @@ void ProcessingPipeline::quantizationStage() {
             lock.unlock();
             
             // Квантизация
-            auto quantized = quantizer->quantize(dctBlock.dctCoeffs);
+            CoeffBlock quantized;
+            int last = quantizer->quantize(dctBlock.dctCoeffs, dctBlock.component, quantized);
             
-            QuantizedBlock finalBlock(quantized, dctBlock.x, dctBlock.y, dctBlock.component);
+            QuantizedBlock finalBlock(quantized, dctBlock.x, dctBlock.y, dctBlock.component, last);
             
             unique_lock<mutex> finalLock(finalMutex);
             finalBlocks.push_back(move(finalBlock));
@@ -656,15 +445,21 @@ PipelineJpegEncoder::PipelineJpegEncoder(unique_ptr<IColorConverter> colorConv,
                                        unique_ptr<IDctTransform> dctTransform,
                                        unique_ptr<IQuantizer> quantizer,
                                        unique_ptr<IHuffmanEncoder> huffmanEnc,
-                                       int threadCount)
+                                       int threadCount,
+                                       ChromaSubsampling subsampling)
     : colorConverter(move(colorConv)),
       pipeline(make_unique<ProcessingPipeline>(move(dctTransform), move(quantizer), threadCount)),
-      encoder(move(huffmanEnc)) {}
+      encoder(move(huffmanEnc)),
+      subsampling(subsampling) {}
 
 JpegEncodedData PipelineJpegEncoder::encode(const RgbImage& image) {
     auto ycbcr = colorConverter->convert(image);
+    ycbcr.downsampleChroma(subsampling);
     auto blocks = pipeline->processImage(ycbcr);
-    auto quantTable = PipelineQuantizer::defaultQuantizationTable();
     
-    return encoder->encode(blocks, image.getWidth(), image.getHeight(), quantTable);
+    return encoder->encode(blocks, image.getWidth(), image.getHeight(), pipeline->getQuantTable(), subsampling);
+}
+
+void PipelineJpegEncoder::encode(const RgbImage& image, IOutputSink& sink) {
+    JfifWriter::write(encode(image), sink);
 }
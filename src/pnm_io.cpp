@@ -0,0 +1,248 @@
+#include "pnm_io.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// ========== MappedFile ==========
+
+MappedFile::MappedFile(const string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw system_error(errno, generic_category(), "Cannot open " + path);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        int error = errno;
+        ::close(fd);
+        throw system_error(error, generic_category(), "Cannot stat " + path);
+    }
+    if (info.st_size == 0) {
+        ::close(fd);
+        throw runtime_error("Empty file: " + path);
+    }
+    length = static_cast<size_t>(info.st_size);
+
+    void* mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    int error = errno;
+    // Отображение остаётся действительным и после закрытия дескриптора
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        throw system_error(error, generic_category(), "Cannot map " + path);
+    }
+    address = static_cast<unsigned char*>(mapped);
+    madvise(address, length, MADV_SEQUENTIAL);
+}
+
+MappedFile::~MappedFile() {
+    if (address) {
+        munmap(address, length);
+    }
+}
+
+// ========== PnmIo ==========
+
+namespace {
+    struct PnmHeader {
+        int width = 0;
+        int height = 0;
+        int depth = 0;  // сэмплов на пиксель: 1 серый, 2 серый + альфа, 3 RGB, 4 RGB + альфа
+        int maxval = 0;
+        size_t rasterOffset = 0;
+    };
+
+    class HeaderParser {
+    private:
+        const unsigned char* data;
+        size_t size;
+        size_t pos = 2; // после магического числа
+
+    public:
+        HeaderParser(const unsigned char* data, size_t size) : data(data), size(size) {}
+
+        size_t position() const { return pos; }
+
+        void skipSpaceAndComments() {
+            while (pos < size) {
+                if (isspace(data[pos])) {
+                    pos++;
+                } else if (data[pos] == '#') {
+                    while (pos < size && data[pos] != '\n') {
+                        pos++;
+                    }
+                } else {
+                    break;
+                }
+            }
+        }
+
+        string readToken() {
+            skipSpaceAndComments();
+            size_t start = pos;
+            while (pos < size && !isspace(data[pos])) {
+                pos++;
+            }
+            if (start == pos) {
+                throw runtime_error("Unexpected end of PNM header");
+            }
+            return string(reinterpret_cast<const char*>(data + start), pos - start);
+        }
+
+        int readNumber() {
+            string token = readToken();
+            long value = 0;
+            for (char c : token) {
+                if (!isdigit(static_cast<unsigned char>(c)) || value > INT_MAX / 10) {
+                    throw runtime_error("Invalid number in PNM header: " + token);
+                }
+                value = value * 10 + (c - '0');
+            }
+            return static_cast<int>(value);
+        }
+
+        // Растр P5/P6 начинается после ровно одного пробельного символа за последним полем
+        void skipSingleSpace() {
+            if (pos >= size || !isspace(data[pos])) {
+                throw runtime_error("Missing whitespace before PNM raster");
+            }
+            pos++;
+        }
+
+        void skipLine() {
+            while (pos < size && data[pos] != '\n') {
+                pos++;
+            }
+            if (pos >= size) {
+                throw runtime_error("Unexpected end of PAM header");
+            }
+            pos++;
+        }
+    };
+
+    PnmHeader parseHeader(const unsigned char* data, size_t size) {
+        if (size < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6' && data[1] != '7')) {
+            throw runtime_error("Not a binary PGM/PPM/PAM file");
+        }
+
+        PnmHeader header;
+        HeaderParser parser(data, size);
+        if (data[1] == '7') {
+            for (string key = parser.readToken(); key != "ENDHDR"; key = parser.readToken()) {
+                if (key == "WIDTH") {
+                    header.width = parser.readNumber();
+                } else if (key == "HEIGHT") {
+                    header.height = parser.readNumber();
+                } else if (key == "DEPTH") {
+                    header.depth = parser.readNumber();
+                } else if (key == "MAXVAL") {
+                    header.maxval = parser.readNumber();
+                } else if (key == "TUPLTYPE") {
+                    // Раскладку определяет DEPTH, тип кортежа только описательный
+                    parser.readToken();
+                } else {
+                    throw runtime_error("Unknown PAM header field: " + key);
+                }
+            }
+            parser.skipLine();
+        } else {
+            header.depth = data[1] == '6' ? 3 : 1;
+            header.width = parser.readNumber();
+            header.height = parser.readNumber();
+            header.maxval = parser.readNumber();
+            parser.skipSingleSpace();
+        }
+        header.rasterOffset = parser.position();
+
+        if (header.width <= 0 || header.height <= 0 || header.width > INT_MAX / 8) {
+            throw runtime_error("Invalid PNM dimensions");
+        }
+        if (header.depth < 1 || header.depth > 4) {
+            throw runtime_error("Unsupported PAM depth " + to_string(header.depth));
+        }
+        if (header.maxval < 1 || header.maxval > 65535) {
+            throw runtime_error("Invalid PNM maxval " + to_string(header.maxval));
+        }
+
+        size_t bytesPerSample = header.maxval > 255 ? 2 : 1;
+        size_t rasterSize = static_cast<size_t>(header.width) * header.height * header.depth * bytesPerSample;
+        if (rasterSize > size - header.rasterOffset) {
+            throw runtime_error("Truncated PNM raster");
+        }
+        return header;
+    }
+
+    // Общий случай: серый размножается на три канала, альфа отбрасывается, сэмплы масштабируются к 0-255
+    RgbImage convertRaster(const unsigned char* raster, const PnmHeader& header) {
+        RgbImage image(header.width, header.height);
+        int bytesPerSample = header.maxval > 255 ? 2 : 1;
+        int colorChannels = header.depth >= 3 ? 3 : 1;
+        size_t rowBytes = static_cast<size_t>(header.width) * header.depth * bytesPerSample;
+
+        for (int y = 0; y < header.height; y++) {
+            const unsigned char* src = raster + y * rowBytes;
+            unsigned char* dst = image.row(y);
+            for (int x = 0; x < header.width; x++) {
+                const unsigned char* pixel = src + static_cast<size_t>(x) * header.depth * bytesPerSample;
+                for (int c = 0; c < 3; c++) {
+                    const unsigned char* sample = pixel + (colorChannels == 3 ? c : 0) * bytesPerSample;
+                    int value = bytesPerSample == 2 ? (sample[0] << 8) | sample[1] : sample[0];
+                    value = min(value, header.maxval);
+                    if (header.maxval != 255) {
+                        value = (value * 255 + header.maxval / 2) / header.maxval;
+                    }
+                    dst[x * 3 + c] = static_cast<unsigned char>(value);
+                }
+            }
+        }
+        return image;
+    }
+}
+
+namespace PnmIo {
+    RgbImage load(const string& path) {
+        auto file = make_shared<MappedFile>(path);
+        PnmHeader header = parseHeader(file->data(), file->size());
+        unsigned char* raster = file->data() + header.rasterOffset;
+
+        if (header.depth == 3 && header.maxval == 255) {
+            return RgbImage::view(raster, header.width, header.height, header.width * 3, move(file));
+        }
+        return convertRaster(raster, header);
+    }
+
+    void write(const RgbImage& image, IOutputSink& sink) {
+        string header = "P6\n" + to_string(image.getWidth()) + " " + to_string(image.getHeight()) + "\n255\n";
+        sink.write(reinterpret_cast<const unsigned char*>(header.data()), header.size());
+        for (int y = 0; y < image.getHeight(); y++) {
+            sink.write(image.row(y), static_cast<size_t>(image.getWidth()) * 3);
+        }
+    }
+
+    void save(const RgbImage& image, const string& path) {
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw system_error(errno, generic_category(), "Cannot create " + path);
+        }
+        try {
+            FileDescriptorSink sink(fd);
+            write(image, sink);
+            sink.flush();
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+        if (::close(fd) != 0) {
+            throw system_error(errno, generic_category(), "Cannot close " + path);
+        }
+    }
+}
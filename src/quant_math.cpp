@@ -0,0 +1,268 @@
+#include "quant_math.h"
+#include "dct_math.h"
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define QUANT_MATH_X86 1
+#endif
+
+using namespace std;
+
+namespace {
+    constexpr float kInputScale = 1 << QuantMath::kFractionBits;
+    // Насыщение до int16 до преобразования: как у packs, но и для значений вне диапазона int32
+    constexpr float kMinInput = -32768.0f;
+    constexpr float kMaxInput = 32767.0f;
+
+    // zigzagPosition[row * 8 + col] - номер коэффициента в порядке zigzag (обратная к JpegFormat::zigzagOrder)
+    constexpr int zigzagPosition[64] = {
+         0,  1,  5,  6, 14, 15, 27, 28,
+         2,  4,  7, 13, 16, 26, 29, 42,
+         3,  8, 12, 17, 25, 30, 41, 43,
+         9, 11, 18, 24, 31, 40, 44, 53,
+        10, 19, 23, 32, 39, 45, 52, 54,
+        20, 22, 33, 38, 46, 51, 55, 60,
+        21, 34, 37, 47, 50, 56, 59, 61,
+        35, 36, 48, 49, 57, 58, 62, 63
+    };
+
+    // zigzagNonZero - бит k на каждый ненулевой k-й в порядке zigzag коэффициент; DC не учитывается
+    inline int lastNonZero(uint64_t zigzagNonZero) {
+        zigzagNonZero &= ~uint64_t(1);
+        return zigzagNonZero == 0 ? 0 : 63 - __builtin_clzll(zigzagNonZero);
+    }
+
+    int quantizeReference(const QuantMath::ReciprocalTable& table, const FloatBlock& dctBlock, CoeffBlock& out) {
+        uint64_t nonZero = 0;
+        for (int i = 0; i < 64; i++) {
+            // Сравнения в том же порядке, что у maxps/minps: NaN становится kMinInput
+            float scaled = dctBlock[i] * table.inputScale[i];
+            scaled = scaled > kMinInput ? scaled : kMinInput;
+            scaled = scaled < kMaxInput ? scaled : kMaxInput;
+            int n = static_cast<int>(lrintf(scaled));
+
+            uint32_t magnitude = static_cast<uint32_t>(n < 0 ? -n : n);
+            uint32_t value = ((magnitude + table.bias[i]) * table.reciprocal[i]) >> 16;
+            value = (value * table.scale[i]) >> 16;
+
+            int quantized = n < 0 ? -static_cast<int>(value) : static_cast<int>(value);
+            out[i] = static_cast<int16_t>(quantized);
+            if (quantized != 0) {
+                nonZero |= uint64_t(1) << zigzagPosition[i];
+            }
+        }
+        return lastNonZero(nonZero);
+    }
+
+#ifdef QUANT_MATH_X86
+    // Маски pshufb, собирающие байты-признаки 64 коэффициентов в порядке zigzag:
+    // control[out][src] переносит байты src-й четверти блока в out-ю четверть zigzag (-128 - ноль)
+    struct alignas(16) ZigzagShuffle {
+        int8_t control[4][4][16];
+    };
+
+    constexpr ZigzagShuffle makeZigzagShuffle() {
+        ZigzagShuffle shuffle{};
+        for (int out = 0; out < 4; out++) {
+            for (int src = 0; src < 4; src++) {
+                for (int i = 0; i < 16; i++) {
+                    shuffle.control[out][src][i] = -128;
+                }
+            }
+        }
+        for (int natural = 0; natural < 64; natural++) {
+            int zigzag = zigzagPosition[natural];
+            shuffle.control[zigzag / 16][natural / 16][zigzag % 16] = static_cast<int8_t>(natural % 16);
+        }
+        return shuffle;
+    }
+
+    constexpr ZigzagShuffle kZigzagShuffle = makeZigzagShuffle();
+
+    // bytes[k] - по байту на коэффициенты 16k..16k + 15 построчно, ненулевой у ненулевого коэффициента
+    __attribute__((target("sse4.1")))
+    inline uint64_t zigzagNonZero(const __m128i (&bytes)[4]) {
+        const __m128i zero = _mm_setzero_si128();
+        uint64_t nonZero = 0;
+        for (int out = 0; out < 4; out++) {
+            __m128i gathered = zero;
+            for (int src = 0; src < 4; src++) {
+                const __m128i control =
+                    _mm_load_si128(reinterpret_cast<const __m128i*>(kZigzagShuffle.control[out][src]));
+                gathered = _mm_or_si128(gathered, _mm_shuffle_epi8(bytes[src], control));
+            }
+            unsigned zeroMask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(gathered, zero)));
+            nonZero |= static_cast<uint64_t>(~zeroMask & 0xFFFFu) << (out * 16);
+        }
+        return nonZero;
+    }
+
+    // 8 коэффициентов: float -> int16 с kFractionBits дробными битами -> частное со знаком
+    __attribute__((target("sse4.1")))
+    inline __m128i quantize8(const QuantMath::ReciprocalTable& table, const float* dct, int i) {
+        const __m128 minInput = _mm_set1_ps(kMinInput);
+        const __m128 maxInput = _mm_set1_ps(kMaxInput);
+        __m128 lo = _mm_mul_ps(_mm_load_ps(dct + i), _mm_load_ps(table.inputScale + i));
+        __m128 hi = _mm_mul_ps(_mm_load_ps(dct + i + 4), _mm_load_ps(table.inputScale + i + 4));
+        lo = _mm_min_ps(_mm_max_ps(lo, minInput), maxInput);
+        hi = _mm_min_ps(_mm_max_ps(hi, minInput), maxInput);
+        __m128i n = _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi));
+
+        // |-32768| = 0x8000 - верное беззнаковое значение для mulhi_epu16
+        __m128i value = _mm_add_epi16(_mm_abs_epi16(n), _mm_load_si128(reinterpret_cast<const __m128i*>(table.bias + i)));
+        value = _mm_mulhi_epu16(value, _mm_load_si128(reinterpret_cast<const __m128i*>(table.reciprocal + i)));
+        value = _mm_mulhi_epu16(value, _mm_load_si128(reinterpret_cast<const __m128i*>(table.scale + i)));
+        return _mm_sign_epi16(value, n);
+    }
+
+    __attribute__((target("sse4.1")))
+    int quantizeSse41(const QuantMath::ReciprocalTable& table, const FloatBlock& dctBlock, CoeffBlock& out) {
+        __m128i bytes[4];
+        for (int i = 0; i < 64; i += 16) {
+            __m128i q0 = quantize8(table, dctBlock.data, i);
+            __m128i q1 = quantize8(table, dctBlock.data, i + 8);
+            _mm_store_si128(reinterpret_cast<__m128i*>(out.data + i), q0);
+            _mm_store_si128(reinterpret_cast<__m128i*>(out.data + i + 8), q1);
+
+            // packs с насыщением сохраняет ненулевые значения ненулевыми: байт на коэффициент
+            bytes[i / 16] = _mm_packs_epi16(q0, q1);
+        }
+        return lastNonZero(zigzagNonZero(bytes));
+    }
+
+    // 16 коэффициентов; packs в AVX2 работает по 128-битным половинам, permute возвращает порядок
+    __attribute__((target("avx2")))
+    inline __m256i quantize16(const QuantMath::ReciprocalTable& table, const float* dct, int i) {
+        const __m256 minInput = _mm256_set1_ps(kMinInput);
+        const __m256 maxInput = _mm256_set1_ps(kMaxInput);
+        __m256 lo = _mm256_mul_ps(_mm256_load_ps(dct + i), _mm256_load_ps(table.inputScale + i));
+        __m256 hi = _mm256_mul_ps(_mm256_load_ps(dct + i + 8), _mm256_load_ps(table.inputScale + i + 8));
+        lo = _mm256_min_ps(_mm256_max_ps(lo, minInput), maxInput);
+        hi = _mm256_min_ps(_mm256_max_ps(hi, minInput), maxInput);
+        __m256i n = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_cvtps_epi32(lo), _mm256_cvtps_epi32(hi)),
+                                             0xD8);
+
+        __m256i value = _mm256_add_epi16(_mm256_abs_epi16(n),
+                                         _mm256_load_si256(reinterpret_cast<const __m256i*>(table.bias + i)));
+        value = _mm256_mulhi_epu16(value, _mm256_load_si256(reinterpret_cast<const __m256i*>(table.reciprocal + i)));
+        value = _mm256_mulhi_epu16(value, _mm256_load_si256(reinterpret_cast<const __m256i*>(table.scale + i)));
+        return _mm256_sign_epi16(value, n);
+    }
+
+    __attribute__((target("avx2")))
+    int quantizeAvx2(const QuantMath::ReciprocalTable& table, const FloatBlock& dctBlock, CoeffBlock& out) {
+        __m128i bytes[4];
+        for (int i = 0; i < 64; i += 32) {
+            __m256i q0 = quantize16(table, dctBlock.data, i);
+            __m256i q1 = quantize16(table, dctBlock.data, i + 16);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(out.data + i), q0);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(out.data + i + 16), q1);
+
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(q0, q1), 0xD8);
+            bytes[i / 16] = _mm256_castsi256_si128(packed);
+            bytes[i / 16 + 1] = _mm256_extracti128_si256(packed, 1);
+        }
+        return lastNonZero(zigzagNonZero(bytes));
+    }
+#endif
+
+    QuantMath::Kernel detectKernel() {
+#ifdef QUANT_MATH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return QuantMath::Kernel::Avx2;
+        }
+        if (__builtin_cpu_supports("sse4.1")) {
+            return QuantMath::Kernel::Sse41;
+        }
+#endif
+        return QuantMath::Kernel::Reference;
+    }
+}
+
+namespace QuantMath {
+
+    void buildReciprocalTable(const vector<vector<int>>& quantTable, ReciprocalTable& table, DctScaling scaling) {
+        if (quantTable.size() != 8) {
+            throw invalid_argument("Quantization table must be 8x8");
+        }
+
+        // Нормировку AAN можно умножить на 2^kFractionBits без потери точности: ядра видят тот же n,
+        // что дал бы отдельный проход масштабирования выхода DCT
+        float aanScale[64];
+        if (scaling == DctScaling::Aan) {
+            DctMath::aanOutputScale(aanScale);
+        }
+        for (int i = 0; i < 64; i++) {
+            table.inputScale[i] = scaling == DctScaling::Aan ? aanScale[i] * kInputScale : kInputScale;
+        }
+
+        for (int row = 0; row < 8; row++) {
+            if (quantTable[row].size() != 8) {
+                throw invalid_argument("Quantization table must be 8x8");
+            }
+            for (int col = 0; col < 8; col++) {
+                int step = quantTable[row][col];
+                if (step < 1 || step > 255) {
+                    throw invalid_argument("Quantization step out of range: " + to_string(step));
+                }
+
+                // Как compute_reciprocal в libjpeg-turbo: 2^shift / divisor с 16 значащими битами,
+                // ошибка округления обратной величины компенсируется смещением
+                uint32_t divisor = static_cast<uint32_t>(step) << kFractionBits;
+                int shift = 16 + (31 - __builtin_clz(divisor));
+                uint32_t reciprocal = (1u << shift) / divisor;
+                uint32_t remainder = (1u << shift) % divisor;
+                uint32_t bias = divisor / 2;
+                if (remainder == 0) {
+                    // Степень двойки: 2^16 не помещается в uint16
+                    reciprocal >>= 1;
+                    shift--;
+                } else if (remainder <= divisor / 2) {
+                    bias++;
+                } else {
+                    reciprocal++;
+                }
+
+                int i = row * 8 + col;
+                table.reciprocal[i] = static_cast<uint16_t>(reciprocal);
+                table.bias[i] = static_cast<uint16_t>(bias);
+                table.scale[i] = static_cast<uint16_t>(1u << (32 - shift));
+            }
+        }
+    }
+
+    Kernel activeKernel() {
+        static const Kernel kernel = detectKernel();
+        return kernel;
+    }
+
+    bool isKernelSupported(Kernel kernel) {
+        return static_cast<int>(kernel) <= static_cast<int>(activeKernel());
+    }
+
+    const char* kernelName(Kernel kernel) {
+        switch (kernel) {
+            case Kernel::Avx2: return "AVX2";
+            case Kernel::Sse41: return "SSE4.1";
+            default: return "scalar";
+        }
+    }
+
+    int quantizeBlock(Kernel kernel, const ReciprocalTable& table, const FloatBlock& dctBlock, CoeffBlock& out) {
+        switch (kernel) {
+#ifdef QUANT_MATH_X86
+            case Kernel::Avx2: return quantizeAvx2(table, dctBlock, out);
+            case Kernel::Sse41: return quantizeSse41(table, dctBlock, out);
+#endif
+            default: return quantizeReference(table, dctBlock, out);
+        }
+    }
+
+    int quantizeBlock(const ReciprocalTable& table, const FloatBlock& dctBlock, CoeffBlock& out) {
+        return quantizeBlock(activeKernel(), table, dctBlock, out);
+    }
+}
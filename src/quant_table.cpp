@@ -0,0 +1,95 @@
+#include "quant_table.h"
+#include "jpeg_format.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+using namespace std;
+
+const int QuantTable::annexKLuminance[64] = {
+    16, 11, 10, 16, 24, 40, 51, 61,
+    12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56,
+    14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68, 109, 103, 77,
+    24, 35, 55, 64, 81, 104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103, 99
+};
+
+const int QuantTable::annexKChrominance[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99
+};
+
+QuantTable::QuantTable(int quality) : quality(quality) {
+    if (quality < 1 || quality > 100) {
+        throw invalid_argument("JPEG quality must be 1-100");
+    }
+
+    // Целочисленно, как jpeg_quality_scaling и jpeg_add_quant_table в IJG: таблицы совпадают с libjpeg
+    int scale = quality < 50 ? 5000 / quality : 200 - 2 * quality;
+    const int* base[2] = {annexKLuminance, annexKChrominance};
+
+    for (int channel = 0; channel < 2; channel++) {
+        tables[channel].assign(8, vector<int>(8));
+        for (int i = 0; i < 64; i++) {
+            int value = (base[channel][i] * scale + 50) / 100;
+            tables[channel][i / 8][i % 8] = max(1, min(255, value));
+        }
+    }
+    buildForms();
+}
+
+QuantTable::QuantTable(const uint8_t (&lumaZigzag)[64], const uint8_t (&chromaZigzag)[64]) : quality(0) {
+    const uint8_t* zigzag[2] = {lumaZigzag, chromaZigzag};
+
+    for (int channel = 0; channel < 2; channel++) {
+        tables[channel].assign(8, vector<int>(8));
+        for (int k = 0; k < 64; k++) {
+            int index = JpegFormat::zigzagOrder[k];
+            tables[channel][index / 8][index % 8] = zigzag[channel][k];
+        }
+    }
+    buildForms();
+}
+
+void QuantTable::buildForms() {
+    for (int channel = 0; channel < 2; channel++) {
+        // Проверяет диапазон 1..255, поэтому zigzag-форма ниже помещается в байт
+        for (auto scaling : {QuantMath::DctScaling::Natural, QuantMath::DctScaling::Aan}) {
+            QuantMath::buildReciprocalTable(tables[channel], reciprocalTables[static_cast<int>(scaling)][channel], scaling);
+        }
+        for (int k = 0; k < 64; k++) {
+            int index = JpegFormat::zigzagOrder[k];
+            zigzagTables[channel][k] = static_cast<uint8_t>(tables[channel][index / 8][index % 8]);
+        }
+    }
+}
+
+bool QuantTable::operator==(const QuantTable& other) const {
+    return memcmp(zigzagTables, other.zigzagTables, sizeof(zigzagTables)) == 0;
+}
+
+shared_ptr<const QuantTable> QuantTable::forQuality(int quality) {
+    if (quality < 1 || quality > 100) {
+        throw invalid_argument("JPEG quality must be 1-100");
+    }
+
+    static mutex cacheMutex;
+    static shared_ptr<const QuantTable> cache[101];
+
+    lock_guard<mutex> lock(cacheMutex);
+    auto& entry = cache[quality];
+    if (!entry) {
+        entry = make_shared<const QuantTable>(quality);
+    }
+    return entry;
+}
@@ -3,7 +3,7 @@
 
 using namespace std;
 
-const vector<int> QuantizedBlock::zigzagIndices = {
+const int QuantizedBlock::zigzagIndices[64] = {
     0,  1,  8, 16,  9,  2,  3, 10,
     17, 24, 32, 25, 18, 11,  4,  5,
     12, 19, 26, 33, 40, 48, 41, 34,
@@ -14,30 +14,20 @@ const vector<int> QuantizedBlock::zigzagIndices = {
     53, 60, 61, 54, 47, 55, 62, 63
 };
 
-QuantizedBlock::QuantizedBlock(const vector<vector<int>>& inputCoefficients, 
-                              int blockX, int blockY, int component) 
-    : blockX(blockX), blockY(blockY), component(component), coefficients(64) {
-    
-    if (inputCoefficients.size() != 8 || inputCoefficients[0].size() != 8) {
-        throw invalid_argument("Block must be 8x8");
-    }
-    
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            coefficients[i * 8 + j] = inputCoefficients[i][j];
-        }
-    }
-}
+QuantizedBlock::QuantizedBlock(const CoeffBlock& inputCoefficients, 
+                              int blockX, int blockY, int component, int lastNonZero) 
+    : coefficients(inputCoefficients), blockX(blockX), blockY(blockY), component(component),
+      lastNonZero(lastNonZero) {}
 
 int QuantizedBlock::getCoefficient(int i, int j) const {
-    return coefficients[i * 8 + j];
+    return coefficients.at(i, j);
 }
 
 vector<int> QuantizedBlock::getZigzagOrder() const {
     return zigzagScan(coefficients);
 }
 
-vector<int> QuantizedBlock::zigzagScan(const vector<int>& coeffs) {
+vector<int> QuantizedBlock::zigzagScan(const CoeffBlock& coeffs) {
     vector<int> result(64);
     for (int i = 0; i < 64; i++) {
         result[i] = coeffs[zigzagIndices[i]];
@@ -54,7 +44,7 @@ vector<vector<int>> QuantizedBlock::toArray() const {
     vector<vector<int>> result(8, vector<int>(8));
     for (int i = 0; i < 8; i++) {
         for (int j = 0; j < 8; j++) {
-            result[i][j] = coefficients[i * 8 + j];
+            result[i][j] = coefficients.at(i, j);
         }
     }
     return result;
@@ -0,0 +1,47 @@
+#include "scratch_arena.h"
+#include <algorithm>
+
+using namespace std;
+
+// Запас на выравнивание: начало куска выровнено только по max_align_t
+static constexpr size_t kMaxAlignment = 64;
+
+ScratchArena::ScratchArena(size_t initialBytes) {
+    addChunk(max<size_t>(initialBytes, kMaxAlignment));
+}
+
+void ScratchArena::addChunk(size_t bytes) {
+    chunks.push_back(Chunk{make_unique<unsigned char[]>(bytes), bytes});
+    chunkAllocations++;
+}
+
+void* ScratchArena::allocateSlow(size_t bytes, size_t alignment) {
+    // Следующий кусок: уже выделенный, если вмещает запрос, иначе новый - не меньше вдвое от последнего
+    size_t needed = bytes + kMaxAlignment;
+    if (current + 1 >= chunks.size() || chunks[current + 1].size < needed) {
+        size_t size = max(needed, chunks.back().size * 2);
+        chunks.insert(chunks.begin() + current + 1, Chunk{make_unique<unsigned char[]>(size), size});
+        chunkAllocations++;
+    }
+    current++;
+    offset = 0;
+    return allocate(bytes, alignment);
+}
+
+void ScratchArena::reset() {
+    if (chunks.size() > 1) {
+        size_t total = capacity();
+        chunks.clear();
+        addChunk(total);
+    }
+    current = 0;
+    offset = 0;
+}
+
+size_t ScratchArena::capacity() const {
+    size_t total = 0;
+    for (const auto& chunk : chunks) {
+        total += chunk.size;
+    }
+    return total;
+}
@@ -1,14 +1,20 @@
 #include "sequential_processors.h"
+#include "jpeg_format.h"
+#include "entropy_coder.h"
+#include "jfif_writer.h"
 #include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <stdexcept>
 
 using namespace std;
 
 // SequentialBlockProcessor ÐºÐ¾Ð½ÑÑ‚Ñ€ÑƒÐºÑ‚Ð¾Ñ€
 SequentialBlockProcessor::SequentialBlockProcessor(unique_ptr<IDctTransform> dctTransform, 
                                                  unique_ptr<IQuantizer> quantizer)
-    : dct(move(dctTransform)), quantizer(move(quantizer)) {}
+    : dct(move(dctTransform)), quantizer(move(quantizer)) {
+    this->quantizer->setInputScaling(dct->outputScaling());
+}
 
 vector<QuantizedBlock> SequentialBlockProcessor::processBlocks(const YCbCrImage& image) {
     vector<QuantizedBlock> blocks;
@@ -16,69 +22,50 @@ vector<QuantizedBlock> SequentialBlockProcessor::processBlocks(const YCbCrImage&
     int width = image.getWidth();
     int height = image.getHeight();
     
+    // Рабочие блоки переиспользуются для всех блоков изображения
+    FloatBlock samples;
+    FloatBlock coeffs;
+    CoeffBlock quantized;
+    
     // ÐžÐ±Ñ€Ð°Ð±Ð°Ñ‚Ñ‹Ð²Ð°ÐµÐ¼ Y (luminance) ÐºÐ¾Ð¼Ð¿Ð¾Ð½ÐµÐ½Ñ‚Ñ‹ - Ð¿Ð¾Ð»Ð½Ð¾Ðµ Ñ€Ð°Ð·Ñ€ÐµÑˆÐµÐ½Ð¸Ðµ
     for (int by = 0; by < height; by += 8) {
         for (int bx = 0; bx < width; bx += 8) {
             // Y block (luminance)
-            auto yBlock = extractBlock(image, bx, by, 0); // component 0 = Y
-            auto yDctBlock = dct->forwardDct(yBlock);
-            auto yQuantized = quantizer->quantize(yDctBlock);
-            blocks.emplace_back(yQuantized, bx / 8, by / 8, 0);
-        }
-    }
-    
-    // ÐžÐ±Ñ€Ð°Ð±Ð°Ñ‚Ñ‹Ð²Ð°ÐµÐ¼ Cb ÐºÐ¾Ð¼Ð¿Ð¾Ð½ÐµÐ½Ñ‚Ñ‹ - ÑÑƒÐ±ÑÑÐ¼Ð¿Ð»Ð¸Ð½Ð³ 2x2
-    for (int by = 0; by < height; by += 16) {
-        for (int bx = 0; bx < width; bx += 16) {
-            // Cb block (chroma blue)
-            auto cbBlock = extractBlock(image, bx, by, 1); // component 1 = Cb
-            auto cbDctBlock = dct->forwardDct(cbBlock);
-            auto cbQuantized = quantizer->quantize(cbDctBlock);
-            blocks.emplace_back(cbQuantized, bx / 16, by / 16, 1);
+            extractBlock(image, bx, by, 0, samples);
+            dct->forwardDct(samples, coeffs);
+            int last = quantizer->quantize(coeffs, 0, quantized);
+            blocks.emplace_back(quantized, bx / 8, by / 8, 0, last);
         }
     }
     
-    // ÐžÐ±Ñ€Ð°Ð±Ð°Ñ‚Ñ‹Ð²Ð°ÐµÐ¼ Cr ÐºÐ¾Ð¼Ð¿Ð¾Ð½ÐµÐ½Ñ‚Ñ‹ - ÑÑƒÐ±ÑÑÐ¼Ð¿Ð»Ð¸Ð½Ð³ 2x2  
-    for (int by = 0; by < height; by += 16) {
-        for (int bx = 0; bx < width; bx += 16) {
-            // Cr block (chroma red)
-            auto crBlock = extractBlock(image, bx, by, 2); // component 2 = Cr
-            auto crDctBlock = dct->forwardDct(crBlock);
-            auto crQuantized = quantizer->quantize(crDctBlock);
-            blocks.emplace_back(crQuantized, bx / 16, by / 16, 2);
+    // Cb и Cr: блоки по сетке плоскости цветности (после downsampleChroma она меньше плоскости Y)
+    for (int component = 1; component <= 2; component++) {
+        const ImagePlane& plane = image.plane(component);
+        for (int by = 0; by < plane.getHeight(); by += 8) {
+            for (int bx = 0; bx < plane.getWidth(); bx += 8) {
+                extractBlock(image, bx, by, component, samples);
+                dct->forwardDct(samples, coeffs);
+                int last = quantizer->quantize(coeffs, component, quantized);
+                blocks.emplace_back(quantized, bx / 8, by / 8, component, last);
+            }
         }
     }
     
     return blocks;
 }
 
-vector<vector<double>> SequentialBlockProcessor::extractBlock(const YCbCrImage& image, 
-                                                             int x, int y, int component) {
-    vector<vector<double>> block(8, vector<double>(8));
+void SequentialBlockProcessor::extractBlock(const YCbCrImage& image, 
+                                           int x, int y, int component, FloatBlock& block) {
+    const ImagePlane& plane = image.plane(component);
+    int maxX = plane.getWidth() - 1;
+    int maxY = plane.getHeight() - 1;
     
     for (int i = 0; i < 8; i++) {
+        const unsigned char* src = plane.row(min(y + i, maxY));
         for (int j = 0; j < 8; j++) {
-            int px = min(x + j, image.getWidth() - 1);
-            int py = min(y + i, image.getHeight() - 1);
-            auto pixel = image.getPixel(px, py);
-            
-            switch (component) {
-                case 0: // Y component
-                    block[i][j] = get<0>(pixel) - 128;
-                    break;
-                case 1: // Cb component  
-                    block[i][j] = get<1>(pixel) - 128;
-                    break;
-                case 2: // Cr component
-                    block[i][j] = get<2>(pixel) - 128;
-                    break;
-                default:
-                    block[i][j] = 0;
-            }
+            block.at(i, j) = src[min(x + j, maxX)] - 128;
         }
     }
-    
-    return block;
 }
 
 // SequentialColorConverter
@@ -86,241 +73,184 @@ YCbCrImage SequentialColorConverter::convert(const RgbImage& image) {
     YCbCrImage result(image.getWidth(), image.getHeight());
     
     for (int y = 0; y < image.getHeight(); y++) {
-        for (int x = 0; x < image.getWidth(); x++) {
-            auto rgb = image.getPixel(x, y);
-            auto ycbcr = ColorMath::rgbToYCbCr(get<0>(rgb), get<1>(rgb), get<2>(rgb));
-            result.setPixel(x, y, get<0>(ycbcr), get<1>(ycbcr), get<2>(ycbcr));
-        }
+        ColorMath::rgbRowToYCbCr(image.row(y), result.plane(0).row(y), result.plane(1).row(y),
+                                 result.plane(2).row(y), image.getWidth());
     }
     
     return result;
 }
 
 // SequentialDctTransform
-vector<vector<double>> SequentialDctTransform::forwardDct(const vector<vector<double>>& block) {
-    vector<vector<double>> result(8, vector<double>(8));
-    
+void SequentialDctTransform::forwardDct(const FloatBlock& block, FloatBlock& out) {
     for (int u = 0; u < 8; u++) {
         for (int v = 0; v < 8; v++) {
-            result[u][v] = DctMath::computeDctCoefficient(block, u, v);
+            out.at(u, v) = static_cast<float>(DctMath::computeDctCoefficient(block.data, u, v));
         }
     }
-    
-    return result;
 }
 
 // SequentialHuffmanEncoder
+SequentialHuffmanEncoder::SequentialHuffmanEncoder(int restartInterval, ScratchArena* arena,
+                                                   JpegFormat::HuffmanTables tables)
+    : restartInterval(restartInterval), arena(arena), tables(tables) {
+    if (restartInterval < 0 || restartInterval > 65535) {
+        throw invalid_argument("Restart interval must be 0-65535 MCUs");
+    }
+}
+
 JpegEncodedData SequentialHuffmanEncoder::encode(const vector<QuantizedBlock>& blocks, 
                                                 int width, int height, 
-                                                const vector<vector<int>>& quantTable) {
+                                                const shared_ptr<const QuantTable>& quantTables,
+                                                ChromaSubsampling subsampling) {
+    JpegEncodedData result;
+    encode(blocks, width, height, quantTables, subsampling, result);
+    return result;
+}
+
+void SequentialHuffmanEncoder::encode(const vector<QuantizedBlock>& blocks, int width, int height,
+                                      const shared_ptr<const QuantTable>& quantTables, ChromaSubsampling subsampling,
+                                      JpegEncodedData& result) {
+    encodeScan(blocks, width, height, quantTables, subsampling, nullptr, result);
+}
+
+void SequentialHuffmanEncoder::encode(const vector<QuantizedBlock>& blocks, int width, int height,
+                                      const shared_ptr<const QuantTable>& quantTables, ChromaSubsampling subsampling,
+                                      const JpegFormat::SymbolHistogram& histogram, JpegEncodedData& result) {
+    encodeScan(blocks, width, height, quantTables, subsampling, &histogram, result);
+}
+
+void SequentialHuffmanEncoder::encodeScan(const vector<QuantizedBlock>& blocks, int width, int height,
+                                          const shared_ptr<const QuantTable>& quantTables, ChromaSubsampling subsampling,
+                                          const JpegFormat::SymbolHistogram* histogram, JpegEncodedData& result) {
+    result.quantTables = quantTables;
+    result.width = width;
+    result.height = height;
+    result.restartInterval = restartInterval;
+    result.subsampling = subsampling;
+    result.yBlockCount = 0;
+    result.cbBlockCount = 0;
+    result.crBlockCount = 0;
+    
     if (blocks.empty()) {
-        JpegEncodedData result;
-        result.compressedData = vector<unsigned char>();
-        result.quantizationTable = quantTable;
-        result.width = width;
-        result.height = height;
-        return result;
+        result.compressedData.clear();
+        JpegFormat::setStandardTables(result);
+        return;
     }
     
-    // Ð Ð°Ð·Ð´ÐµÐ»ÑÐµÐ¼ Ð±Ð»Ð¾ÐºÐ¸ Ð¿Ð¾ ÐºÐ¾Ð¼Ð¿Ð¾Ð½ÐµÐ½Ñ‚Ð°Ð¼
-    vector<QuantizedBlock> yBlocks, cbBlocks, crBlocks;
     for (const auto& block : blocks) {
         switch (block.getComponent()) {
-            case 0: yBlocks.push_back(block); break;
-            case 1: cbBlocks.push_back(block); break;
-            case 2: crBlocks.push_back(block); break;
+            case 0: result.yBlockCount++; break;
+            case 1: result.cbBlockCount++; break;
+            case 2: result.crBlockCount++; break;
         }
     }
     
-    // Ð¡Ð¾Ð·Ð´Ð°ÐµÐ¼ Ð¾Ñ‚Ð´ÐµÐ»ÑŒÐ½Ñ‹Ðµ Ñ‚Ð°Ð±Ð»Ð¸Ñ†Ñ‹ Ð¥Ð°Ñ„Ñ„Ð¼Ð°Ð½Ð° Ð´Ð»Ñ ÐºÐ°Ð¶Ð´Ð¾Ð³Ð¾ ÐºÐ¾Ð¼Ð¿Ð¾Ð½ÐµÐ½Ñ‚Ð°
-    auto yTable = buildHuffmanTable(yBlocks);
-    auto cbTable = buildHuffmanTable(cbBlocks);
-    auto crTable = buildHuffmanTable(crBlocks);
+    auto order = JpegFormat::interleaveBlocks(blocks, width, height, subsampling, arena);
+    int blocksPerMcu = JpegFormat::mcuLayout(width, height, subsampling).blocksPerMcu();
     
-    // ÐšÐ¾Ð´Ð¸Ñ€ÑƒÐµÐ¼ Ð²ÑÐµ Ð±Ð»Ð¾ÐºÐ¸
-    BitWriter writer;
+    int lastDc[3] = {0, 0, 0};
     
-    // ÐšÐ¾Ð´Ð¸Ñ€ÑƒÐµÐ¼ Y ÐºÐ¾Ð¼Ð¿Ð¾Ð½ÐµÐ½Ñ‚Ñ‹
-    for (const auto& block : yBlocks) {
-        auto zigzag = block.getZigzagOrder();
-        for (auto coef : zigzag) {
-            auto codeInfo = yTable[coef];
-            writer.writeBits(codeInfo.first, codeInfo.second);
-        }
-    }
+    // Стандартные таблицы: коды готовы при компиляции, скан пишется за один проход
+    const HuffmanCodeTable* dcTables[2] = {&JpegFormat::kStandardDcLuminanceCodes, &JpegFormat::kStandardDcChrominanceCodes};
+    const HuffmanCodeTable* acTables[2] = {&JpegFormat::kStandardAcLuminanceCodes, &JpegFormat::kStandardAcChrominanceCodes};
+    HuffmanCodeTable optimizedCodes[4];
     
-    // ÐšÐ¾Ð´Ð¸Ñ€ÑƒÐµÐ¼ Cb ÐºÐ¾Ð¼Ð¿Ð¾Ð½ÐµÐ½Ñ‚Ñ‹
-    for (const auto& block : cbBlocks) {
-        auto zigzag = block.getZigzagOrder();
-        for (auto coef : zigzag) {
-            auto codeInfo = cbTable[coef];
-            writer.writeBits(codeInfo.first, codeInfo.second);
+    // Первый проход (если гистограммы не собраны заранее): символы скана, индекс 0 - яркость, 1 - цветность
+    JpegFormat::SymbolHistogram counted;
+    if (tables == JpegFormat::HuffmanTables::Standard) {
+        JpegFormat::setStandardTables(result);
+    } else if (!histogram) {
+        for (size_t i = 0; i < order.size(); i++) {
+            if (JpegFormat::startsRestartInterval(i, restartInterval, blocksPerMcu)) {
+                fill(begin(lastDc), end(lastDc), 0);
+            }
+            const QuantizedBlock* block = order[i];
+            int component = block->getComponent();
+            int table = component == 0 ? 0 : 1;
+            JpegFormat::countBlockSymbols(block->getCoefficients(), lastDc[component],
+                                          counted.dc[table], counted.ac[table], block->getLastNonZero());
         }
+        histogram = &counted;
     }
     
-    // ÐšÐ¾Ð´Ð¸Ñ€ÑƒÐµÐ¼ Cr ÐºÐ¾Ð¼Ð¿Ð¾Ð½ÐµÐ½Ñ‚Ñ‹
-    for (const auto& block : crBlocks) {
-        auto zigzag = block.getZigzagOrder();
-        for (auto coef : zigzag) {
-            auto codeInfo = crTable[coef];
-            writer.writeBits(codeInfo.first, codeInfo.second);
-        }
+    if (tables == JpegFormat::HuffmanTables::Optimized) {
+        HuffmanMath::buildSpec(histogram->dc[0], result.dcLuminanceTable);
+        HuffmanMath::buildSpec(histogram->ac[0], result.acLuminanceTable);
+        HuffmanMath::buildSpec(histogram->dc[1], result.dcChrominanceTable);
+        HuffmanMath::buildSpec(histogram->ac[1], result.acChrominanceTable);
+        
+        optimizedCodes[0] = HuffmanMath::buildCodeTable(result.dcLuminanceTable);
+        optimizedCodes[1] = HuffmanMath::buildCodeTable(result.dcChrominanceTable);
+        optimizedCodes[2] = HuffmanMath::buildCodeTable(result.acLuminanceTable);
+        optimizedCodes[3] = HuffmanMath::buildCodeTable(result.acChrominanceTable);
+        dcTables[0] = &optimizedCodes[0];
+        dcTables[1] = &optimizedCodes[1];
+        acTables[0] = &optimizedCodes[2];
+        acTables[1] = &optimizedCodes[3];
     }
     
-    JpegEncodedData result;
-    result.compressedData = writer.toArray();
-    result.yHuffmanTable = yTable;
-    result.cbHuffmanTable = cbTable;
-    result.crHuffmanTable = crTable;
-    result.dcLuminanceTable = yTable;
-    result.acLuminanceTable = yTable;
-    result.quantizationTable = quantTable;
-    result.width = width;
-    result.height = height;
-    result.yBlockCount = static_cast<int>(yBlocks.size());
-    result.cbBlockCount = static_cast<int>(cbBlocks.size());
-    result.crBlockCount = static_cast<int>(crBlocks.size());
-    return result;
-}
-
-unordered_map<int, pair<int, int>> SequentialHuffmanEncoder::buildHuffmanTable(
-    const vector<QuantizedBlock>& blocks) {
-    
-    unordered_map<int, int> frequencies;
+    // Второй проход: один чередующийся скан, DC предсказывается отдельно для каждого компонента
+    // Начальный буфер ~16 байт на блок, дальше растёт удвоением; пишем поверх прежнего скана результата
+    BitWriter writer(move(result.compressedData), order.size() * 16);
+    fill(begin(lastDc), end(lastDc), 0);
+    int restartIndex = 0;
     
-    for (const auto& block : blocks) {
-        auto zigzag = block.getZigzagOrder();
-        for (auto coef : zigzag) {
-            frequencies[coef]++;
+    for (size_t i = 0; i < order.size(); i++) {
+        if (JpegFormat::startsRestartInterval(i, restartInterval, blocksPerMcu)) {
+            writer.writeRestartMarker(restartIndex++);
+            fill(begin(lastDc), end(lastDc), 0);
         }
+        const QuantizedBlock* block = order[i];
+        int component = block->getComponent();
+        int table = component == 0 ? 0 : 1;
+        EntropyCoder::encodeBlock(writer, block->getCoefficients(), lastDc[component],
+                                  *dcTables[table], *acTables[table], block->getLastNonZero());
     }
     
-    auto tree = HuffmanMath::buildTree(frequencies);
-    auto codeTable = HuffmanMath::buildCodeTable(tree);
-    delete tree;
-    
-    return codeTable;
-}
-
-void SequentialHuffmanEncoder::encodeBlock(BitWriter& writer, const vector<int>& zigzag,
-                                          const unordered_map<int, pair<int, int>>& dcTable,
-                                          const unordered_map<int, pair<int, int>>& acTable) {
-    // DC component
-    int dc = zigzag[0];
-    int dcDiff = dc - lastDc;
-    lastDc = dc;
-    
-    int dcCategory = getCategory(dcDiff);
-    auto dcCodeInfo = dcTable.at(dcCategory);
-    writer.writeBits(dcCodeInfo.first, dcCodeInfo.second);
-    
-    if (dcCategory > 0) {
-        int magnitude = getMagnitude(dcDiff, dcCategory);
-        writer.writeBits(magnitude, dcCategory);
-    }
-    
-    // AC components
-    int zeroRun = 0;
-    for (int i = 1; i < 64; i++) {
-        int ac = zigzag[i];
-        
-        if (ac == 0) {
-            zeroRun++;
-            if (i == 63) { // EOB
-                auto eobCodeInfo = acTable.at(0x00);
-                writer.writeBits(eobCodeInfo.first, eobCodeInfo.second);
-            }
-        } else {
-            while (zeroRun > 15) {
-                auto zrlCodeInfo = acTable.at(0xF0);
-                writer.writeBits(zrlCodeInfo.first, zrlCodeInfo.second);
-                zeroRun -= 16;
-            }
-            
-            int category = getCategory(ac);
-            int symbol = (zeroRun << 4) | category;
-            auto acCodeInfo = acTable.at(symbol);
-            writer.writeBits(acCodeInfo.first, acCodeInfo.second);
-            
-            int magnitude = getMagnitude(ac, category);
-            writer.writeBits(magnitude, category);
-            
-            zeroRun = 0;
-        }
-    }
-}
-
-int SequentialHuffmanEncoder::getCategory(int value) {
-    int absValue = abs(value);
-    if (absValue == 0) return 0;
-    return static_cast<int>(floor(log2(absValue))) + 1;
-}
-
-int SequentialHuffmanEncoder::getMagnitude(int value, int category) {
-    if (value >= 0)
-        return value;
-    return value + (1 << category) - 1;
+    result.compressedData = writer.release();
 }
 
 // SequentialQuantizer
 SequentialQuantizer::SequentialQuantizer(int quality) 
-    : quantizationTable(generateQuantizationTable(quality)) {}
+    : quantTables(QuantTable::forQuality(quality)) {}
 
-vector<vector<int>> SequentialQuantizer::quantize(const vector<vector<double>>& dctBlock) {
-    vector<vector<int>> result(8, vector<int>(8));
-    
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            result[i][j] = static_cast<int>(round(
-                dctBlock[i][j] / quantizationTable[i][j]
-            ));
-        }
-    }
-    
-    return result;
-}
-
-vector<vector<int>> SequentialQuantizer::defaultQuantizationTable() {
-    return vector<vector<int>>{
-        {16, 11, 10, 16, 24, 40, 51, 61},
-        {12, 12, 14, 19, 26, 58, 60, 55},
-        {14, 13, 16, 24, 40, 57, 69, 56},
-        {14, 17, 22, 29, 51, 87, 80, 62},
-        {18, 22, 37, 56, 68, 109, 103, 77},
-        {24, 35, 55, 64, 81, 104, 113, 92},
-        {49, 64, 78, 87, 103, 121, 120, 101},
-        {72, 92, 95, 98, 112, 100, 103, 99}
-    };
-}
-
-vector<vector<int>> SequentialQuantizer::generateQuantizationTable(int quality) {
-    auto baseTable = defaultQuantizationTable();
-    vector<vector<int>> result(8, vector<int>(8));
-    
-    double scale = quality < 50 ? 5000.0 / quality : 200.0 - 2 * quality;
-    
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            int value = static_cast<int>((baseTable[i][j] * scale + 50) / 100);
-            result[i][j] = max(1, min(255, value));
-        }
-    }
-    
-    return result;
+int SequentialQuantizer::quantize(const FloatBlock& dctBlock, int component, CoeffBlock& out) {
+    return QuantMath::quantizeBlock(quantTables->getReciprocals(QuantTable::channelOf(component), inputScaling),
+                                    dctBlock, out);
 }
 
 // JpegEncoder
 JpegEncoder::JpegEncoder(unique_ptr<IColorConverter> colorConv,
                         unique_ptr<IBlockProcessor> blockProc,
-                        unique_ptr<IHuffmanEncoder> huffmanEnc)
+                        unique_ptr<IHuffmanEncoder> huffmanEnc,
+                        ChromaSubsampling subsampling)
     : colorConverter(move(colorConv)),
       blockProcessor(move(blockProc)),
-      encoder(move(huffmanEnc)) {}
+      encoder(move(huffmanEnc)),
+      subsampling(subsampling) {}
+
+JpegEncoder::JpegEncoder(unique_ptr<IMcuProcessor> mcuProc,
+                        unique_ptr<IHuffmanEncoder> huffmanEnc,
+                        ChromaSubsampling subsampling)
+    : mcuProcessor(move(mcuProc)),
+      encoder(move(huffmanEnc)),
+      subsampling(subsampling) {}
 
 JpegEncodedData JpegEncoder::encode(const RgbImage& image) {
-    auto ycbcr = colorConverter->convert(image);
-    auto blocks = blockProcessor->processBlocks(ycbcr);
-    auto quantTable = SequentialQuantizer::defaultQuantizationTable();
+    vector<QuantizedBlock> blocks;
+    if (mcuProcessor) {
+        blocks = mcuProcessor->processImage(image, subsampling);
+    } else {
+        auto ycbcr = colorConverter->convert(image);
+        ycbcr.downsampleChroma(subsampling);
+        blocks = blockProcessor->processBlocks(ycbcr);
+    }
+    // В DQT идут таблицы, которыми блоки действительно квантованы
+    const auto& quantTables = mcuProcessor ? mcuProcessor->getQuantTable() : blockProcessor->getQuantTable();
     
-    return encoder->encode(blocks, image.getWidth(), image.getHeight(), quantTable);
+    return encoder->encode(blocks, image.getWidth(), image.getHeight(), quantTables, subsampling);
+}
+
+void JpegEncoder::encode(const RgbImage& image, IOutputSink& sink) {
+    JfifWriter::write(encode(image), sink);
 }
\ No newline at end of file
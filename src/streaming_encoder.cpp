@@ -0,0 +1,185 @@
+#include "streaming_encoder.h"
+#include "fast_dct_transform.h"
+#include "jfif_writer.h"
+#include "jpeg_format.h"
+#include "entropy_coder.h"
+#include "color_math.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+StreamingJpegEncoder::StreamingJpegEncoder(IOutputSink& output, unique_ptr<IDctTransform> dctTransform)
+    : sink(output),
+      dct(dctTransform ? move(dctTransform) : make_unique<FastDctTransform>()) {}
+
+const shared_ptr<const QuantTable>& StreamingJpegEncoder::getQuantTable() const {
+    if (!quantizer) {
+        throw logic_error("Encoder has not been started");
+    }
+    return quantizer->getQuantTable();
+}
+
+void StreamingJpegEncoder::begin(int imageWidth, int imageHeight, int quality, int interval,
+                                 ChromaSubsampling subsampling) {
+    if (active) {
+        throw logic_error("Previous image is not finished");
+    }
+    if (interval < 0 || interval > 65535) {
+        throw invalid_argument("Restart interval must be 0-65535 MCUs");
+    }
+
+    width = imageWidth;
+    height = imageHeight;
+    restartInterval = interval;
+    layout = JpegFormat::mcuLayout(width, height, subsampling);
+    quantizer = make_unique<SequentialQuantizer>(quality);
+    quantizer->setInputScaling(dct->outputScaling());
+
+    // Заголовки: стандартные таблицы и таблицы квантования, которыми действительно квантуем
+    JpegEncodedData header;
+    header.width = width;
+    header.height = height;
+    header.quantTables = quantizer->getQuantTable();
+    JpegFormat::setStandardTables(header);
+    header.restartInterval = restartInterval;
+    header.subsampling = subsampling;
+    JfifWriter(sink).writeHeaders(header);
+
+    rowBuffer = make_unique<YCbCrImage>(width, layout.mcuHeight());
+    int chromaWidth = (width + layout.lumaH - 1) / layout.lumaH;
+    chromaRows.assign(2, ImagePlane(chromaWidth, 8));
+    bufferedRows = 0;
+    nextScanline = 0;
+    mcuRow = 0;
+    mcusEncoded = 0;
+    std::fill(std::begin(lastDc), std::end(lastDc), 0);
+    writer.clearFlushed();
+    active = true;
+}
+
+void StreamingJpegEncoder::writeScanlines(const unsigned char* rgb, int rowCount, size_t stride) {
+    if (!active) {
+        throw logic_error("begin() must be called before writeScanlines()");
+    }
+    if (rowCount < 0 || rowCount > height - nextScanline) {
+        throw invalid_argument("More scanlines than image height");
+    }
+
+    for (int i = 0; i < rowCount; i++) {
+        const unsigned char* row = rgb + i * stride;
+        ColorMath::rgbRowToYCbCr(row, rowBuffer->plane(0).row(bufferedRows),
+                                 rowBuffer->plane(1).row(bufferedRows),
+                                 rowBuffer->plane(2).row(bufferedRows), width);
+        bufferedRows++;
+        nextScanline++;
+
+        if (bufferedRows == layout.mcuHeight()) {
+            encodeMcuRow();
+        }
+    }
+}
+
+void StreamingJpegEncoder::finish() {
+    if (!active) {
+        throw logic_error("begin() must be called before finish()");
+    }
+    if (nextScanline != height) {
+        throw runtime_error("Not all scanlines were written");
+    }
+
+    // Неполная последняя строка MCU (высота не кратна высоте MCU)
+    if (bufferedRows > 0) {
+        encodeMcuRow();
+    }
+
+    writer.padToByte();
+    JfifWriter jfif(sink);
+    jfif.writeScanData(writer.data(), writer.size());
+    writer.clearFlushed();
+    jfif.writeEnd();
+
+    rowBuffer.reset();
+    chromaRows.clear();
+    active = false;
+}
+
+void StreamingJpegEncoder::extractBlock(const ImagePlane& plane, int x, int y, int validRows, FloatBlock& block) {
+    // Края как у остальных процессоров: последний столбец и последняя строка плоскости повторяются
+    int maxX = plane.getWidth() - 1;
+    int maxY = validRows - 1;
+
+    for (int i = 0; i < 8; i++) {
+        const unsigned char* src = plane.row(min(y + i, maxY));
+        for (int j = 0; j < 8; j++) {
+            block.at(i, j) = src[min(x + j, maxX)] - 128;
+        }
+    }
+}
+
+void StreamingJpegEncoder::encodeMcuRow() {
+    int yBlocksX = (width + 7) / 8;
+    int yBlocksY = (height + 7) / 8;
+
+    // Прореживание цветности строки MCU тем же ядром, что и YCbCrImage::downsampleChroma
+    int chromaRowCount = (bufferedRows + layout.lumaV - 1) / layout.lumaV;
+    for (int c = 0; c < 2; c++) {
+        const ImagePlane& source = rowBuffer->plane(c + 1);
+        for (int y = 0; y < chromaRowCount; y++) {
+            const unsigned char* row0 = source.row(y * layout.lumaV);
+            if (layout.lumaH == 1) {
+                copy(row0, row0 + width, chromaRows[c].row(y));
+                continue;
+            }
+            const unsigned char* row1 = source.row(min(y * layout.lumaV + layout.lumaV - 1, bufferedRows - 1));
+            ColorMath::downsampleRow(row0, row1, chromaRows[c].row(y), width);
+        }
+    }
+
+    FloatBlock samples;
+    FloatBlock coeffs;
+    CoeffBlock quantized;
+
+    auto encode = [&](const ImagePlane& plane, int x, int y, int validRows, int component) {
+        extractBlock(plane, x, y, validRows, samples);
+        dct->forwardDct(samples, coeffs);
+        int lastNonZero = quantizer->quantize(coeffs, component, quantized);
+        if (component == 0) {
+            EntropyCoder::encodeBlock(writer, quantized, lastDc[0], JpegFormat::kStandardDcLuminanceCodes,
+                                      JpegFormat::kStandardAcLuminanceCodes, lastNonZero);
+        } else {
+            EntropyCoder::encodeBlock(writer, quantized, lastDc[component], JpegFormat::kStandardDcChrominanceCodes,
+                                      JpegFormat::kStandardAcChrominanceCodes, lastNonZero);
+        }
+    };
+
+    for (int mx = 0; mx < layout.mcusX; mx++) {
+        if (JpegFormat::startsRestartInterval(static_cast<size_t>(mcusEncoded) * layout.blocksPerMcu(),
+                                              restartInterval, layout.blocksPerMcu())) {
+            writer.writeRestartMarker((mcusEncoded / restartInterval - 1) & 7);
+            std::fill(std::begin(lastDc), std::end(lastDc), 0);
+        }
+
+        // Блоки Y построчно; блоки за краем изображения повторяют ближайший существующий,
+        // как JpegFormat::interleaveBlocks
+        for (int v = 0; v < layout.lumaV; v++) {
+            for (int h = 0; h < layout.lumaH; h++) {
+                int bx = min(mx * layout.lumaH + h, yBlocksX - 1);
+                int by = min(mcuRow * layout.lumaV + v, yBlocksY - 1);
+                encode(rowBuffer->plane(0), bx * 8, by * 8 - mcuRow * layout.mcuHeight(), bufferedRows, 0);
+            }
+        }
+
+        // Cb, Cr: один блок прореженной цветности на MCU
+        encode(chromaRows[0], mx * 8, 0, chromaRowCount, 1);
+        encode(chromaRows[1], mx * 8, 0, chromaRowCount, 2);
+        mcusEncoded++;
+    }
+
+    // Готовые байты строки MCU сразу уходят в sink, в регистре остаются только неполные биты
+    JfifWriter(sink).writeScanData(writer.data(), writer.size());
+    writer.clearFlushed();
+
+    bufferedRows = 0;
+    mcuRow++;
+}
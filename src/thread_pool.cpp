@@ -0,0 +1,196 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+
+// Пул и индекс рабочего для текущего потока (nullptr / -1 вне пулов)
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local int currentIndex = -1;
+
+// ===== ThreadPool =====
+
+ThreadPool::ThreadPool(int threadCount) {
+    threadCount = max(1, threadCount);
+    for (int i = 0; i < threadCount; ++i) {
+        queues.push_back(make_unique<WorkerQueue>());
+    }
+    workers.reserve(threadCount);
+    for (int i = 0; i < threadCount; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    sleepCV.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+int ThreadPool::currentWorkerIndex() const {
+    return currentPool == this ? currentIndex : -1;
+}
+
+void ThreadPool::submit(Task task) {
+    // Задача рабочего остаётся в его очереди, внешние - по кругу
+    int self = currentWorkerIndex();
+    size_t index = self >= 0 ? static_cast<size_t>(self) : nextQueue++ % queues.size();
+    // Счётчик - до публикации: задачу могут извлечь сразу после push_back
+    {
+        lock_guard<mutex> lock(sleepMutex);
+        ++queuedTasks;
+    }
+    {
+        lock_guard<mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(move(task));
+    }
+    sleepCV.notify_one();
+}
+
+bool ThreadPool::popTask(int self, Task& task) {
+    if (queuedTasks == 0) {
+        return false;
+    }
+
+    if (self >= 0) {
+        WorkerQueue& own = *queues[self];
+        lock_guard<mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = move(own.tasks.back());
+            own.tasks.pop_back();
+            --queuedTasks;
+            return true;
+        }
+    }
+
+    // Перехват: самые старые задачи остальных очередей
+    size_t count = queues.size();
+    size_t start = self >= 0 ? static_cast<size_t>(self) + 1 : 0;
+    for (size_t i = 0; i < count; ++i) {
+        size_t victim = (start + i) % count;
+        if (static_cast<int>(victim) == self) {
+            continue;
+        }
+        WorkerQueue& queue = *queues[victim];
+        lock_guard<mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --queuedTasks;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::tryRunTask(int self) {
+    Task task;
+    if (!popTask(self, task)) {
+        return false;
+    }
+    task();
+    return true;
+}
+
+void ThreadPool::workerLoop(int index) {
+    currentPool = this;
+    currentIndex = index;
+
+    while (true) {
+        if (tryRunTask(index)) {
+            continue;
+        }
+        unique_lock<mutex> lock(sleepMutex);
+        sleepCV.wait(lock, [&]() { return stopping || queuedTasks > 0; });
+        if (stopping && queuedTasks == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t first, size_t last, size_t grain,
+                             const function<void(size_t, size_t)>& body, int maxTasks) {
+    if (first >= last) {
+        return;
+    }
+    grain = max<size_t>(1, grain);
+    size_t chunks = (last - first + grain - 1) / grain;
+    size_t tasks = maxTasks > 0 ? static_cast<size_t>(maxTasks) : workers.size() + 1;
+    tasks = min(tasks, chunks);
+
+    // Диапазоны раздаются через общий счётчик: задача берёт следующий свободный
+    atomic<size_t> nextChunk{0};
+    auto worker = [&]() {
+        for (size_t chunk = nextChunk++; chunk < chunks; chunk = nextChunk++) {
+            size_t begin = first + chunk * grain;
+            body(begin, min(last, begin + grain));
+        }
+    };
+
+    TaskGroup group(*this);
+    for (size_t t = 1; t < tasks; ++t) {
+        group.run(worker);
+    }
+    worker();
+    group.wait();
+}
+
+// ===== TaskGroup =====
+
+TaskGroup::TaskGroup(ThreadPool& pool) : pool(pool) {}
+
+TaskGroup::~TaskGroup() {
+    // Задачи ссылаются на группу: дожидаемся их даже при раскрутке стека
+    try {
+        wait();
+    } catch (...) {
+    }
+}
+
+void TaskGroup::run(function<void()> task) {
+    ++pending;
+    pool.submit([this, task = move(task)]() {
+        try {
+            task();
+        } catch (...) {
+            lock_guard<mutex> lock(groupMutex);
+            if (!error) {
+                error = current_exception();
+            }
+        }
+        lock_guard<mutex> lock(groupMutex);
+        if (--pending == 0) {
+            doneCV.notify_all();
+        }
+    });
+}
+
+void TaskGroup::wait() {
+    int self = pool.currentWorkerIndex();
+    while (pending > 0) {
+        if (pool.tryRunTask(self)) {
+            continue;
+        }
+        // Свободных задач нет - остальные выполняются другими потоками
+        unique_lock<mutex> lock(groupMutex);
+        doneCV.wait_for(lock, chrono::microseconds(200), [&]() { return pending == 0; });
+    }
+
+    // Захват мьютекса гарантирует, что последняя задача вышла из notify_all
+    lock_guard<mutex> lock(groupMutex);
+    if (error) {
+        exception_ptr failure = error;
+        error = nullptr;
+        rethrow_exception(failure);
+    }
+}